@@ -0,0 +1,230 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+  A minimal micro-benchmark harness for the mplot++ benchmarks.
+
+  Each benchmark is timed over a number of repetitions.  Within a repetition
+  the body is run enough times to take at least the minimum time, which is
+  calibrated once per benchmark, so that clock resolution is irrelevant.  The
+  per-call times of the repetitions are summarised by their minimum, median,
+  mean and standard deviation, printed as a table and optionally written as
+  JSON for comparison between runs.
+
+  Command line options:
+    --json FILE         Write results to FILE
+    --repetitions N     Number of timed repetitions (default 10)
+    --min-time SECONDS  Minimum duration of a repetition (default 0.05)
+    --filter TEXT       Only run benchmarks whose name contains TEXT
+*/
+namespace bench {
+
+/*
+  Prevent the compiler from discarding a computed value.
+*/
+template<class T>
+inline void
+keep(const T& value)
+{
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Result
+{
+  std::string name;
+  long size;
+  long iterations;
+  std::vector<double> times;
+  double min, median, mean, stddev;
+};
+
+class Suite
+{
+public:
+  Suite(const std::string& name, int argc, char** argv)
+    : name_(name)
+  {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      auto value = [&]() -> std::string {
+        if (i + 1 >= argc) {
+          std::cerr << "Missing value for " << arg << std::endl;
+          std::exit(2);
+        }
+        return argv[++i];
+      };
+      if (arg == "--json") {
+        json_ = value();
+      } else if (arg == "--repetitions") {
+        repetitions_ = std::max(1, std::stoi(value()));
+      } else if (arg == "--min-time") {
+        min_time_ = std::stod(value());
+      } else if (arg == "--filter") {
+        filter_ = value();
+      } else {
+        std::cerr << "Unknown option " << arg << std::endl;
+        std::exit(2);
+      }
+    }
+    std::cout << std::left << std::setw(40) << name_ << std::right
+              << std::setw(10) << "size" << std::setw(12) << "min"
+              << std::setw(12) << "median" << std::setw(12) << "mean"
+              << std::setw(10) << "stddev" << std::endl;
+  }
+
+  ~Suite() { write_json(); }
+
+  /*
+    Add information describing the environment to the JSON output.
+  */
+  void context(const std::string& key, const std::string& value)
+  {
+    context_.emplace_back(key, value);
+  }
+
+  /*
+    Time f(), which is one call of the operation being measured.
+  */
+  template<class F>
+  void run(const std::string& name, long size, F&& f)
+  {
+    if (not filter_.empty() and name.find(filter_) == std::string::npos) {
+      return;
+    }
+    using clock = std::chrono::steady_clock;
+    auto elapsed = [](clock::time_point start) {
+      return std::chrono::duration<double>(clock::now() - start).count();
+    };
+
+    // Warm up and calibrate the number of iterations per repetition
+    long iterations = 1;
+    while (true) {
+      auto start = clock::now();
+      for (long i = 0; i < iterations; ++i) {
+        f();
+      }
+      double t = elapsed(start);
+      if (t >= min_time_ or iterations >= (1L << 30)) {
+        break;
+      }
+      double scale = t > 0 ? 1.4 * min_time_ / t : 10.0;
+      iterations = std::max(iterations + 1,
+                            long(double(iterations) * std::min(scale, 10.0)));
+    }
+
+    Result r{ name, size, iterations, {}, 0, 0, 0, 0 };
+    for (int rep = 0; rep < repetitions_; ++rep) {
+      auto start = clock::now();
+      for (long i = 0; i < iterations; ++i) {
+        f();
+      }
+      r.times.push_back(elapsed(start) / double(iterations));
+    }
+
+    std::vector<double> sorted = r.times;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    r.min = sorted.front();
+    r.median =
+      n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    r.mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / double(n);
+    double ss = 0;
+    for (double t : sorted) {
+      ss += (t - r.mean) * (t - r.mean);
+    }
+    r.stddev = n > 1 ? std::sqrt(ss / double(n - 1)) : 0.0;
+
+    std::cout << std::left << std::setw(40) << name << std::right
+              << std::setw(10) << size << std::setw(12) << format(r.min)
+              << std::setw(12) << format(r.median) << std::setw(12)
+              << format(r.mean) << std::setw(9) << std::fixed
+              << std::setprecision(1) << 100 * r.stddev / r.mean << "%"
+              << std::defaultfloat << std::endl;
+    results_.push_back(std::move(r));
+  }
+
+private:
+  static std::string format(double seconds)
+  {
+    const char* units[] = { "s", "ms", "us", "ns" };
+    int u = 0;
+    while (seconds < 1 and u < 3) {
+      seconds *= 1000;
+      ++u;
+    }
+    std::ostringstream out;
+    out << std::setprecision(4) << seconds << " " << units[u];
+    return out.str();
+  }
+
+  static std::string quote(const std::string& s)
+  {
+    std::string out = "\"";
+    for (char c : s) {
+      if (c == '"' or c == '\\') {
+        out += '\\';
+        out += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+    return out + "\"";
+  }
+
+  void write_json() const
+  {
+    if (json_.empty()) {
+      return;
+    }
+    std::ofstream out(json_);
+    out << std::setprecision(9);
+    out << "{\n  \"suite\": " << quote(name_) << ",\n  \"context\": {";
+    for (size_t i = 0; i < context_.size(); ++i) {
+      out << (i ? ",\n    " : "\n    ") << quote(context_[i].first) << ": "
+          << quote(context_[i].second);
+    }
+    out << "\n  },\n  \"unit\": \"seconds\",\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results_.size(); ++i) {
+      const Result& r = results_[i];
+      out << (i ? ",\n    {" : "\n    {") << "\"name\": " << quote(r.name)
+          << ", \"size\": " << r.size << ", \"iterations\": " << r.iterations
+          << ", \"repetitions\": " << r.times.size() << ", \"min\": " << r.min
+          << ", \"median\": " << r.median << ", \"mean\": " << r.mean
+          << ", \"stddev\": " << r.stddev << ", \"times\": [";
+      for (size_t j = 0; j < r.times.size(); ++j) {
+        out << (j ? ", " : "") << r.times[j];
+      }
+      out << "]}";
+    }
+    out << "\n  ]\n}\n";
+  }
+
+  std::string name_;
+  std::string json_;
+  std::string filter_;
+  int repetitions_ = 10;
+  double min_time_ = 0.05;
+  std::vector<std::pair<std::string, std::string>> context_;
+  std::vector<Result> results_;
+};
+
+}
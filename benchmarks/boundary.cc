@@ -0,0 +1,86 @@
+#include "bench.h"
+#include <mplot++/mplot++.h>
+#include <pybind11/eigen.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+namespace mp = mplotpp;
+
+/*
+  Costs at the c++/python boundary: converting data to python, the mplot++
+  helpers, and python attribute lookup and call overhead.
+*/
+int
+main(int argc, char** argv)
+{
+  py::scoped_interpreter guard;
+  bench::Suite suite("boundary", argc, argv);
+
+  auto sys = py::module_::import("sys");
+  suite.context("python", sys.attr("version").cast<std::string>());
+  suite.context("pybind11",
+                std::to_string(PYBIND11_VERSION_MAJOR) + "." +
+                  std::to_string(PYBIND11_VERSION_MINOR) + "." +
+                  std::to_string(PYBIND11_VERSION_PATCH));
+  suite.context("eigen",
+                std::to_string(EIGEN_WORLD_VERSION) + "." +
+                  std::to_string(EIGEN_MAJOR_VERSION) + "." +
+                  std::to_string(EIGEN_MINOR_VERSION));
+
+  for (long n : { 10L, 1000L, 100000L, 10000000L }) {
+    Eigen::ArrayXd eig = Eigen::ArrayXd::LinSpaced(n, 0, 1);
+    std::vector<double> vec(eig.data(), eig.data() + n);
+
+    suite.run("cast/eigen", n, [&]() { bench::keep(py::cast(eig)); });
+    suite.run("cast/std::vector", n, [&]() { bench::keep(py::cast(vec)); });
+    suite.run("cast/array_t", n, [&]() {
+      bench::keep(py::array_t<double>(n, eig.data()));
+    });
+    suite.run("cast/view", n, [&]() { bench::keep(mp::view(eig)); });
+    suite.run("cast/adopt", n, [&]() {
+      Eigen::ArrayXd copy = eig;
+      bench::keep(mp::adopt(std::move(copy)));
+    });
+    suite.run("arange", n, [&]() {
+      bench::keep(mp::arange(0.0, double(n), 1.0));
+    });
+  }
+
+  for (long n : { 10L, 100L, 1000L, 3000L }) {
+    Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(n, -1, 1);
+    suite.run("meshgrid", n * n, [&]() { bench::keep(mp::meshgrid(x, x)); });
+    suite.run("meshgrid_view", n * n, [&]() {
+      auto grid = mp::meshgrid_view(x, x);
+      bench::keep(grid.pyX());
+      bench::keep(grid.pyY());
+    });
+  }
+
+  py::object pair = py::make_tuple(1, 2);
+  py::object quad = py::make_tuple(1, 2, 3, 4);
+  suite.run("tuple<2>", 2, [&]() { bench::keep(mp::tuple<2>(pair)); });
+  suite.run("tuple<4>", 4, [&]() { bench::keep(mp::tuple<4>(quad)); });
+  suite.run("list/3", 3, [&]() { bench::keep(mp::list(1, 2.5, "three")); });
+  suite.run("list/8", 8, [&]() {
+    bench::keep(mp::list(1, 2, 3, 4, 5.0, 6.0, "seven", "eight"));
+  });
+
+  auto builtins = py::module_::import("builtins");
+  py::object len = builtins.attr("len");
+  py::object abs = builtins.attr("abs");
+  suite.run("attr/lookup", 1, [&]() { bench::keep(builtins.attr("len")); });
+  suite.run("call/no-args", 1, [&]() {
+    bench::keep(builtins.attr("object")());
+  });
+  suite.run("call/int-arg", 1, [&]() { bench::keep(abs(-1)); });
+  suite.run("call/lookup+call", 1, [&]() {
+    bench::keep(builtins.attr("abs")(-1));
+  });
+  py::dict kwargs;
+  kwargs["base"] = 10;
+  suite.run("call/kwargs", 1, [&]() {
+    bench::keep(builtins.attr("int")("42", **kwargs));
+  });
+  py::list list = mp::list(1, 2, 3);
+  suite.run("call/len", 3, [&]() { bench::keep(len(list)); });
+}
@@ -0,0 +1,58 @@
+#include "bench.h"
+#include <mplot++/mplot++.h>
+#include <pybind11/eigen.h>
+
+namespace py = pybind11;
+namespace mp = mplotpp;
+using namespace py::literals;
+
+/*
+  Headless rendering time with the Agg backend over a range of data sizes.
+  The figure is drawn to its canvas, which excludes any file encoding.
+*/
+int
+main(int argc, char** argv)
+{
+  py::scoped_interpreter guard;
+  bench::Suite suite("render", argc, argv);
+
+  auto matplotlib = py::module_::import("matplotlib");
+  matplotlib.attr("use")("Agg");
+  auto plt = py::module_::import("matplotlib.pyplot");
+  suite.context("matplotlib",
+                matplotlib.attr("__version__").cast<std::string>());
+
+  for (long n : { 100L, 10000L, 1000000L }) {
+    Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(n, 0, 100);
+    Eigen::ArrayXd y = x.sin();
+    auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+    ax.attr("plot")(mp::view(x), mp::view(y));
+    auto canvas = fig.attr("canvas");
+    suite.run("agg/plot", n, [&]() { canvas.attr("draw")(); });
+    suite.run("agg/plot+setup", n, [&]() {
+      auto [f, a] = mp::tuple<2>(plt.attr("subplots")());
+      a.attr("plot")(mp::view(x), mp::view(y));
+      f.attr("canvas").attr("draw")();
+      plt.attr("close")(f);
+    });
+    plt.attr("close")(fig);
+  }
+
+  for (long n : { 100L, 1000L }) {
+    Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(n, -3, 3);
+    auto grid = mp::meshgrid_view(x, x);
+    Eigen::ArrayXXd Z = (grid.X().pow(2) + grid.Y().pow(2)).sqrt().sin();
+
+    auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+    ax.attr("imshow")(Z);
+    auto canvas = fig.attr("canvas");
+    suite.run("agg/imshow", n * n, [&]() { canvas.attr("draw")(); });
+    plt.attr("close")(fig);
+
+    auto [fig2, ax2] = mp::tuple<2>(plt.attr("subplots")());
+    ax2.attr("contourf")(grid.pyX(), grid.pyY(), Z);
+    auto canvas2 = fig2.attr("canvas");
+    suite.run("agg/contourf", n * n, [&]() { canvas2.attr("draw")(); });
+    plt.attr("close")(fig2);
+  }
+}
@@ -0,0 +1,60 @@
+#include <Eigen/Dense>
+#include <chrono>
+#include <iostream>
+#include <mplot++/async.h>
+#include <mplot++/mplot++.h>
+#include <string>
+#include <utility>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+
+/*
+  A stand-in for an expensive simulation step
+*/
+Eigen::ArrayXd
+solve(int step)
+{
+  Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(2000000, 0, 10);
+  for (int k = 0; k < 20; ++k) {
+    x = (x + 0.01 * step).sin().abs().sqrt() * 10;
+  }
+  return x.head(1000);
+}
+
+/*
+  Solve ten steps while the previous ones are plotted and saved on the
+  render thread.  The total time is close to the larger of the solving and
+  the rendering time rather than their sum.
+*/
+int
+main()
+{
+  const int nsteps = 10;
+  auto start = std::chrono::steady_clock::now();
+
+  mp::AsyncPlotter plotter("Agg");
+  plotter.submit([](py::dict& ns) {
+    auto plt = py::module_::import("matplotlib.pyplot");
+    auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+    ns["fig"] = fig;
+    ns["ax"] = ax;
+  });
+  for (int step = 0; step < nsteps; ++step) {
+    Eigen::ArrayXd y = solve(step);
+    plotter.submit([step, y = std::move(y)](py::dict& ns) mutable {
+      ns["ax"].attr("plot")(mp::adopt(std::move(y)));
+      ns["fig"].attr("savefig")("async" + std::to_string(step) + ".png");
+    });
+  }
+  // A command may return a value that is not a python object
+  auto lines = plotter.submit([](py::dict& ns) {
+    return py::len(ns["ax"].attr("get_lines")());
+  });
+  std::cout << lines.get() << " lines plotted" << std::endl;
+  plotter.wait();
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  std::cout << "Total time " << elapsed.count() << " s" << std::endl;
+}
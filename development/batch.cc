@@ -0,0 +1,61 @@
+#include <Eigen/Dense>
+#include <chrono>
+#include <iostream>
+#include <mplot++/batch.h>
+#include <mplot++/mplot++.h>
+#include <random>
+#include <string>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+/*
+  Render 200 report figures from one long series in worker processes.  The
+  series is placed in a SharedArena, so the workers read it without copies.
+*/
+int
+main()
+{
+  const int njobs = 200;
+  const Eigen::Index chunk = 100000;
+  std::mt19937 gen(1);
+  std::normal_distribution<double> normal;
+  Eigen::ArrayXd series(njobs * chunk);
+  double walk = 0;
+  for (Eigen::Index i = 0; i < series.size(); ++i) {
+    walk += normal(gen);
+    series[i] = walk;
+  }
+
+  mp::SharedArena arena(size_t(series.size()) * sizeof(double));
+  auto y = arena.copy(series);
+
+  mp::BatchRenderer batch;
+  for (int i = 0; i < njobs; ++i) {
+    batch.add([&, i]() {
+      auto plt = py::module_::import("matplotlib.pyplot");
+      auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+      ax.attr("plot")(y.numpy()[py::slice(i * chunk, (i + 1) * chunk, 1)],
+                      "lw"_a = 0.5);
+      ax.attr("set_title")("report " + std::to_string(i));
+      std::string name = "batch" + std::to_string(i) + ".png";
+      fig.attr("savefig")(name);
+      return name;
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto results = batch.run();
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  int failed = 0;
+  int retried = 0;
+  for (const auto& r : results) {
+    failed += not r.ok;
+    retried += r.attempts > 1;
+  }
+  std::cout << results.size() << " figures in " << elapsed.count() << " s, "
+            << retried << " retried, " << failed << " failed" << std::endl;
+}
@@ -0,0 +1,50 @@
+#include <Eigen/Dense>
+#include <chrono>
+#include <iostream>
+#include <mplot++/cache.h>
+#include <mplot++/mplot++.h>
+#include <string>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+
+/*
+  Regenerate a "dashboard" of eight panels twice.  The first run draws every
+  panel; the second finds them all in the cache and only copies the stored
+  images.  Run the program again to see every panel served from the store
+  left by the previous run.
+*/
+int
+main()
+{
+  py::scoped_interpreter guard;
+  py::module_::import("matplotlib").attr("use")("Agg");
+  auto plt = py::module_::import("matplotlib.pyplot");
+
+  mp::RenderCache cache("cache-store", 64 << 20);
+  Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(100000, 0, 10);
+
+  for (int run = 0; run < 2; ++run) {
+    auto start = std::chrono::steady_clock::now();
+    for (int panel = 0; panel < 8; ++panel) {
+      Eigen::ArrayXd y = (x * (panel + 1)).sin() * (-0.1 * x).exp();
+      std::string title = "panel " + std::to_string(panel);
+
+      // Everything the figure depends on goes into its fingerprint
+      mp::Fingerprint fp;
+      fp.command("plot", x, y).command("set_title", title);
+      std::string file = "cache" + std::to_string(panel) + ".png";
+      cache.render_file(fp, file, [&]() {
+        auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+        ax.attr("plot")(mp::view(x), mp::view(y));
+        ax.attr("set_title")(title);
+        return fig;
+      });
+    }
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    std::cout << "Run " << run << ": " << elapsed.count() << " s, "
+              << cache.hits() << " hits, " << cache.misses() << " misses, "
+              << cache.size() << " bytes stored" << std::endl;
+  }
+}
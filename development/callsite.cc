@@ -0,0 +1,68 @@
+#include <chrono>
+#include <iostream>
+#include <mplot++/callsite.h>
+#include <mplot++/mplot++.h>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+/*
+  Label 5000 points twice, first with `ax.attr("text")(...)`, which looks up
+  the method and builds every keyword argument on each call, then with a
+  CallSite and a Keyword, which do both once.
+*/
+int
+main()
+{
+  py::scoped_interpreter guard;
+  py::module_::import("matplotlib").attr("use")("Agg");
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, axes] = mp::tuple<2>(plt.attr("subplots")(1, 2));
+  auto [left, right] = mp::tuple<2>(axes);
+
+  const size_t n = 5000;
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> uniform;
+  std::vector<double> x(n);
+  std::vector<double> y(n);
+  std::vector<std::string> labels(n);
+  std::vector<std::string> colors(n);
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = uniform(gen);
+    y[i] = uniform(gen);
+    labels[i] = std::to_string(i);
+    colors[i] = "C" + std::to_string(i % 10);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; ++i) {
+    left.attr("text")(x[i],
+                      y[i],
+                      labels[i],
+                      "transform"_a = left.attr("transAxes"),
+                      "fontsize"_a = 4,
+                      "color"_a = colors[i]);
+  }
+  std::chrono::duration<double> plain =
+    std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  mp::CallSite text(right,
+                    "text",
+                    py::dict("transform"_a = right.attr("transAxes"),
+                             "fontsize"_a = 4));
+  static mp::Keyword color("color");
+  for (size_t i = 0; i < n; ++i) {
+    text(x[i], y[i], labels[i], color = colors[i]);
+  }
+  std::chrono::duration<double> cached =
+    std::chrono::steady_clock::now() - start;
+
+  std::cout << "attr: " << plain.count() << " s, CallSite: " << cached.count()
+            << " s" << std::endl;
+  fig.attr("savefig")("callsite.png", "dpi"_a = 200);
+}
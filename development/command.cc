@@ -0,0 +1,60 @@
+#include <Eigen/Dense>
+#include <chrono>
+#include <iostream>
+#include <mplot++/command.h>
+#include <mplot++/mplot++.h>
+#include <random>
+#include <string>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+/*
+  Draw 3000 labelled boxes, recording the 9000 calls in a CommandBuffer and
+  running them with a single call into python.  Results of recorded calls
+  are used as the targets and arguments of later ones.
+*/
+int
+main()
+{
+  py::scoped_interpreter guard;
+  py::module_::import("matplotlib").attr("use")("Agg");
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto patches = py::module_::import("matplotlib.patches");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+
+  const int n = 3000;
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> uniform;
+  Eigen::ArrayXd x(n);
+  Eigen::ArrayXd y(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = uniform(gen);
+    y[i] = uniform(gen);
+  }
+  Eigen::ArrayXXd image = Eigen::ArrayXXd::Random(50, 50);
+
+  auto start = std::chrono::steady_clock::now();
+  mp::CommandBuffer cmd;
+  for (int i = 0; i < n; ++i) {
+    auto box = cmd.on(patches, "Rectangle")(
+      py::make_tuple(x[i], y[i]), 0.01, 0.01, "fill"_a = false);
+    cmd.on(ax, "add_patch")(box);
+    cmd.on(ax, "text")(x[i], y[i], std::to_string(i), "fontsize"_a = 2);
+  }
+  auto mesh = cmd.on(ax, "imshow")(image,
+                                    "extent"_a = py::make_tuple(0, 1, 0, 1),
+                                    "alpha"_a = 0.3);
+  cmd.on(fig, "colorbar")(mesh);
+  std::cout << cmd.size() << " calls recorded" << std::endl;
+  cmd.execute();
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  std::cout << "Recorded and executed in " << elapsed.count() << " s"
+            << std::endl;
+
+  // The python objects created are available until the next execute()
+  cmd.result(mesh).attr("set_cmap")("gray");
+  fig.attr("savefig")("command.png", "dpi"_a = 300);
+}
@@ -0,0 +1,41 @@
+#include <Eigen/Dense>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <mplot++/parallel.h>
+
+namespace mp = mplotpp;
+
+/*
+  Time a transcendental kernel over 50 million elements with parallel_for()
+  on 1, 2, 4, ... threads, up to the default of num_threads().  The result
+  is the same whatever the number of threads, as each chunk writes only its
+  own elements.
+*/
+int
+main()
+{
+  const Eigen::Index n = 50000000;
+  Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(n, 0, 100);
+  Eigen::ArrayXd y(n);
+
+  const unsigned max_threads = mp::num_threads();
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    mp::set_num_threads(threads);
+    auto start = std::chrono::steady_clock::now();
+    mp::parallel_for(Eigen::Index(0),
+                     n,
+                     Eigen::Index(1 << 16),
+                     [&](Eigen::Index first, Eigen::Index last) {
+                       Eigen::Index m = last - first;
+                       y.segment(first, m) =
+                         x.segment(first, m).sin() * x.segment(first, m).exp();
+                     });
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    std::cout << threads << " threads: " << elapsed.count() << " s, sum "
+              << y.sum() << std::endl;
+  }
+  // Back to the default of one thread per hardware thread
+  mp::set_num_threads(0);
+}
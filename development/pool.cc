@@ -0,0 +1,44 @@
+#include <Eigen/Dense>
+#include <chrono>
+#include <iostream>
+#include <mplot++/mplot++.h>
+#include <mplot++/pool.h>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+/*
+  Redraw a line of a million points 100 times with buffers from a
+  BufferPool.  Once the loop reaches a steady state every buffer is reused,
+  which the allocation and reuse counts at the end confirm.
+*/
+int
+main()
+{
+  py::scoped_interpreter guard;
+  py::module_::import("matplotlib").attr("use")("Agg");
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  auto [line] = mp::tuple<1>(ax.attr("plot")(py::list(), py::list()));
+  ax.attr("set_xlim")(0, 1);
+  ax.attr("set_ylim")(-1.1, 1.1);
+
+  const Eigen::Index n = 1000000;
+  mp::BufferPool pool;
+  auto start = std::chrono::steady_clock::now();
+  for (int cycle = 0; cycle < 100; ++cycle) {
+    auto x = pool.get<Eigen::ArrayXd>(n);
+    auto y = pool.get<Eigen::ArrayXd>(n);
+    x.map() = Eigen::ArrayXd::LinSpaced(n, 0, 1);
+    y.map() = (x.map() * 20 + 0.1 * cycle).sin();
+    line.attr("set_data")(x.numpy(false), y.numpy(false));
+    fig.attr("canvas").attr("draw")();
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  std::cout << "100 frames in " << elapsed.count() << " s: "
+            << pool.allocations() << " buffers allocated, " << pool.reuses()
+            << " reused, " << pool.idle_bytes() << " bytes idle" << std::endl;
+}
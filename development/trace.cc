@@ -0,0 +1,42 @@
+// Comment out to see that the instrumented calls still work, at no cost
+#define MPLOTPP_TRACE
+#include <Eigen/Dense>
+#include <iostream>
+#include <mplot++/mplot++.h>
+#include <mplot++/trace.h>
+#include <pybind11/eigen.h>
+#include <string>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+/*
+  Trace a small plotting session and show where the time goes: argument
+  conversion, python execution, layout or rasterisation.  The trace is
+  written to trace.json for chrome://tracing or https://ui.perfetto.dev.
+*/
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  mp::trace_matplotlib();
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, axes] = mp::tuple<2>(MPLOTPP_ATTR(plt, "subplots")(2, 2));
+
+  Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(1000000, 0, 10);
+  for (int i = 0; i < 4; ++i) {
+    MPLOTPP_TRACE_SCOPE("panel");
+    Eigen::ArrayXd y = (x * (i + 1)).sin();
+    auto ax = axes.attr("flat")[py::int_(i)];
+    MPLOTPP_ATTR(ax, "plot")(x, y, "lw"_a = 0.5);
+    MPLOTPP_ATTR(ax, "set_title")("panel " + std::to_string(i));
+  }
+  MPLOTPP_ATTR(fig, "tight_layout")();
+  MPLOTPP_ATTR(fig, "savefig")("trace.png", "dpi"_a = 150);
+
+  auto& tracer = mp::Tracer::instance();
+  tracer.summary(std::cout);
+  tracer.write_chrome_trace("trace.json");
+}
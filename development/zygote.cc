@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mplot++/mplot++.h>
+#include <mplot++/zygote.h>
+#include <stdexcept>
+#include <string>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+
+/*
+  A plotting server and its client in one program:
+
+    zygote serve &            start the zygote, importing matplotlib once
+    zygote plot 3             plot a sine of frequency 3 to plot3.png
+    zygote shutdown           stop the zygote
+    zygote local 3            plot without the zygote, for comparison
+
+  Compare the time of "plot" with that of "local", which pays for starting
+  python and importing matplotlib every time.
+*/
+namespace {
+
+const char* socket_path = "/tmp/mplotpp-zygote.sock";
+
+std::string
+plot(const std::string& frequency)
+{
+  auto plt = py::module_::import("matplotlib.pyplot");
+  double f = std::stod(frequency);
+  Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(1000, 0, 1);
+  Eigen::ArrayXd y = (2 * 3.14159265358979 * f * x).sin();
+  plt.attr("plot")(mp::view(x), mp::view(y));
+  plt.attr("savefig")("plot" + frequency + ".png");
+  return "plot" + frequency + ".png";
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    std::cerr << "Usage: zygote serve|plot <f>|shutdown|local <f>\n";
+    return 2;
+  }
+  auto start = std::chrono::steady_clock::now();
+  try {
+    if (std::strcmp(argv[1], "serve") == 0) {
+      mp::Zygote zygote(socket_path);
+      zygote.handle("plot", plot);
+      zygote.serve();
+    } else if (std::strcmp(argv[1], "plot") == 0 and argc > 2) {
+      std::cout << mp::zygote_request(socket_path, "plot", argv[2]) << '\n';
+    } else if (std::strcmp(argv[1], "shutdown") == 0) {
+      mp::zygote_request(socket_path, "shutdown");
+    } else if (std::strcmp(argv[1], "local") == 0 and argc > 2) {
+      // Nothing is imported, nor the interpreter started, until first use
+      mp::LazyModule matplotlib("matplotlib");
+      matplotlib.attr("use")("Agg");
+      std::cout << plot(argv[2]) << '\n';
+    } else {
+      std::cerr << "Unknown command " << argv[1] << '\n';
+      return 2;
+    }
+  } catch (std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  std::cerr << elapsed.count() << " s\n";
+}
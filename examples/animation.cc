@@ -0,0 +1,52 @@
+#include <cmath>
+#include <iostream>
+#include <mplot++/animation.h>
+#include <mplot++/mplot++.h>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+/*
+  Render a travelling wave packet to a movie.  By default the frames are
+  written to animation.y4m, which most players and encoders read; an encoder
+  command may be given instead, for example
+  ```
+  animation "ffmpeg -y -loglevel error -i - -pix_fmt yuv420p animation.mp4"
+  ```
+*/
+int
+main(int argc, char* argv[])
+{
+  py::scoped_interpreter guard;
+
+  py::module_::import("matplotlib").attr("use")("Agg");
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("animation");
+
+  Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(1000, 0, 20);
+  Eigen::ArrayXd y = Eigen::ArrayXd::Zero(x.size());
+  auto [line] = mp::tuple<1>(ax.attr("plot")(mp::view(x), mp::view(y)));
+  ax.attr("set_ylim")(-1.1, 1.1);
+
+  /*
+    Each frame is drawn by Agg and its pixels copied to a free buffer.  A
+    writer thread converts and writes it while the next frame is drawn.
+  */
+  auto sink =
+    argc > 1 ? mp::StreamSink::command(argv[1], mp::FrameFormat::Y4M, 30)
+             : mp::StreamSink::file("animation.y4m", mp::FrameFormat::Y4M, 30);
+  mp::AnimationWriter writer(fig, std::move(sink));
+  for (int step = 0; step < 300; ++step) {
+    double t = step / 30.0;
+    y = (-(x - 2 - 2 * t).square() / 2).exp() * (4 * (x - 3 * t)).sin();
+    line.attr("set_ydata")(mp::view(y));
+    writer.capture();
+  }
+  writer.close();
+
+  mp::CanvasFrame frame(fig, false);
+  std::cout << "Wrote 300 frames of " << frame.width() << " x "
+            << frame.height() << " pixels\n";
+}
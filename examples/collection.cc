@@ -0,0 +1,44 @@
+#include <mplot++/collection.h>
+#include <mplot++/mplot++.h>
+#include <random>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("collection");
+
+  /*
+    Two thousand random walks of different lengths.  Calling `ax.plot()` for
+    each would create two thousand Line2D artists; instead all of them go
+    into one buffer and are drawn as a single LineCollection.
+  */
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<Eigen::Index> length(50, 500);
+  std::normal_distribution<double> step(0, 1);
+  mp::SegmentBuilder<double> paths;
+  paths.reserve(2000, 2000 * 275);
+  for (int k = 0; k < 2000; ++k) {
+    Eigen::Index n = length(gen);
+    Eigen::ArrayXd t = Eigen::ArrayXd::LinSpaced(n, 0, double(n - 1));
+    Eigen::ArrayXd y(n);
+    y[0] = 0;
+    for (Eigen::Index i = 1; i < n; ++i) {
+      y[i] = y[i - 1] + step(gen);
+    }
+    paths.add(t, y);
+  }
+
+  ax.attr("add_collection")(
+    paths.line_collection(py::dict("lw"_a = 0.5, "alpha"_a = 0.3)));
+  ax.attr("autoscale_view")();
+
+  plt.attr("show")();
+}
@@ -0,0 +1,48 @@
+#include <mplot++/colormap.h>
+#include <mplot++/mplot++.h>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  /*
+    The field of contour.cc on a 4000 x 6000 grid.  Passed to `imshow` it
+    would be normalised and colour-mapped by numpy on one core, with several
+    float64 temporaries the size of the image.
+  */
+  Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(6000, -3, 3);
+  Eigen::ArrayXd y = Eigen::ArrayXd::LinSpaced(4000, -2, 2);
+  auto grid = mp::meshgrid_view(x, y);
+  auto X = grid.X();
+  auto Y = grid.Y();
+  Eigen::ArrayXXd Z = 2 * ((-X.pow(2) - Y.pow(2)).exp() -
+                           (-(X - 1).pow(2) - (Y - 1).pow(2)).exp());
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("colormap");
+
+  /*
+    Instead the colours are looked up in c++, on all cores, and only the
+    uint8 RGBA image reaches matplotlib.  A symlog norm shows the shallow
+    tails of both peaks.
+  */
+  mp::Colormap cmap("RdBu_r");
+  auto norm = mp::autoscale(mp::Normalize::symlog(0.01), Z);
+  mp::imshow_rgba(ax,
+                  Z,
+                  cmap,
+                  norm,
+                  py::dict("origin"_a = "lower",
+                           "extent"_a = py::make_tuple(-3, 3, -2, 2)));
+  fig.attr("colorbar")(cmap.scalar_mappable(norm), "ax"_a = ax);
+  ax.attr("set_xlabel")("$x$");
+  ax.attr("set_ylabel")("$y$");
+
+  plt.attr("show")();
+}
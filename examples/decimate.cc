@@ -0,0 +1,48 @@
+#include <cmath>
+#include <memory>
+#include <mplot++/decimate.h>
+#include <mplot++/mplot++.h>
+#include <random>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+
+  // Ten million noisy samples of a chirp
+  const Eigen::Index n = 10000000;
+  auto x =
+    std::make_shared<Eigen::ArrayXd>(Eigen::ArrayXd::LinSpaced(n, 0, 100));
+  std::mt19937 gen(1);
+  std::normal_distribution<double> noise(0, 0.1);
+  auto y = std::make_shared<Eigen::ArrayXd>(n);
+  for (Eigen::Index i = 0; i < n; ++i) {
+    double t = (*x)[i];
+    (*y)[i] = std::sin(t * t / 20) + noise(gen);
+  }
+
+  auto [fig, axes] = mp::tuple<2>(plt.attr("subplots")(2, 1));
+  auto [top, bottom] = mp::tuple<2>(axes);
+  fig.attr("suptitle")("decimate");
+
+  /*
+    Only a few points per pixel column reach matplotlib.  Zooming or panning
+    decimates the full series again for the new view, so detail appears as
+    you zoom in.  MinMax keeps every peak; LTTB keeps the shape with fewer
+    points.
+  */
+  mp::plot_decimated(
+    top, x, y, mp::Decimation::MinMax, py::dict("lw"_a = 0.5));
+  top.attr("set_title")("min/max");
+  mp::plot_decimated(
+    bottom, x, y, mp::Decimation::LTTB, py::dict("lw"_a = 0.5));
+  bottom.attr("set_title")("LTTB");
+
+  plt.attr("show")();
+}
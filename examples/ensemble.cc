@@ -0,0 +1,70 @@
+#include <cmath>
+#include <mplot++/ensemble.h>
+#include <mplot++/mplot++.h>
+#include <random>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+/*
+  Simulate `n` runs of geometric Brownian motion, one per row, sampled at
+  the times `t`
+*/
+Eigen::ArrayXXd
+simulate(Eigen::Index n, const Eigen::ArrayXd& t, std::mt19937& gen)
+{
+  std::normal_distribution<double> normal;
+  const double dt = t[1] - t[0];
+  Eigen::ArrayXXd runs(n, t.size());
+  for (Eigen::Index i = 0; i < n; ++i) {
+    double log_s = 0;
+    for (Eigen::Index j = 0; j < t.size(); ++j) {
+      runs(i, j) = std::exp(log_s);
+      log_s += 0.05 * dt + 0.3 * std::sqrt(dt) * normal(gen);
+    }
+  }
+  return runs;
+}
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, axes] =
+    mp::tuple<2>(plt.attr("subplots")(1, 2, "sharey"_a = true));
+  auto [left, right] = mp::tuple<2>(axes);
+  fig.attr("suptitle")("ensemble");
+
+  Eigen::ArrayXd t = Eigen::ArrayXd::LinSpaced(500, 0, 5);
+  std::mt19937 gen(1);
+
+  /*
+    The statistics of 20000 runs held in memory, computed for all times at
+    once on all cores
+  */
+  Eigen::ArrayXXd runs = simulate(20000, t, gen);
+  auto stats = mp::ensemble_stats(runs, { 0.05, 0.25, 0.75, 0.95 });
+  stats.fill_between(left, t, 0, 3, py::dict("alpha"_a = 0.2));
+  stats.fill_between(left, t, 1, 2, py::dict("alpha"_a = 0.4));
+  left.attr("plot")(mp::view(t), mp::view(stats.mean));
+  left.attr("set_title")("20000 runs");
+
+  /*
+    The approximate statistics of 200000 runs, simulated in blocks that are
+    discarded once summarised
+  */
+  mp::StreamingEnsemble ensemble(t.size());
+  for (int block = 0; block < 20; ++block) {
+    ensemble.add(simulate(10000, t, gen));
+  }
+  auto streamed = ensemble.stats({ 0.01, 0.5, 0.99 });
+  streamed.fill_between(right, t, 0, 2, py::dict("alpha"_a = 0.3));
+  Eigen::ArrayXd median = streamed.quantiles.col(1);
+  right.attr("plot")(mp::view(t), mp::view(median));
+  right.attr("set_title")("200000 runs, streamed");
+
+  plt.attr("show")();
+}
@@ -0,0 +1,49 @@
+#include <mplot++/grid.h>
+#include <mplot++/mplot++.h>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto cm = py::module_::import("matplotlib").attr("cm");
+
+  auto [fig, ax] = mp::tuple<2>(
+    plt.attr("subplots")("subplot_kw"_a = py::dict("projection"_a = "3d")));
+  fig.attr("suptitle")("grid");
+
+  double delta = 0.05;
+  Eigen::ArrayXd x = mp::arange(-5.0, 5.01, delta);
+  Eigen::ArrayXd y = mp::arange(-5.0, 5.01, delta);
+
+  /*
+    meshgrid_view() holds only x and y.  Its pyX() and pyY() are read-only
+    numpy arrays that broadcast them to the size of the grid without copying.
+  */
+  auto grid = mp::meshgrid_view(x, y);
+
+  /*
+    grid_eval() evaluates the function one segment of a grid row at a time,
+    on all cores, and returns the result as a numpy array.  X and Y are never
+    materialised.
+  */
+  auto Z = mp::grid_eval(grid, [](const auto& X, const auto& Y) {
+    return (X.pow(2) + Y.pow(2)).sqrt().sin();
+  });
+
+  auto surf = ax.attr("plot_surface")(grid.pyX(),
+                                      grid.pyY(),
+                                      Z,
+                                      "cmap"_a = cm.attr("coolwarm"),
+                                      "linewidth"_a = 0,
+                                      "antialiased"_a = false);
+  ax.attr("set_zlim")(-1.0, 1.0);
+  fig.attr("colorbar")(surf, "shrink"_a = 0.5, "aspect"_a = 5);
+
+  plt.attr("show")();
+}
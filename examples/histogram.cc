@@ -0,0 +1,53 @@
+#include <mplot++/histogram.h>
+#include <mplot++/mplot++.h>
+#include <random>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, axes] = mp::tuple<2>(
+    plt.attr("subplots")(1, 3, "figsize"_a = py::make_tuple(15, 4.5)));
+  auto [left, middle, right] = mp::tuple<3>(axes);
+  fig.attr("suptitle")("histogram");
+
+  mp::Histogram hist(mp::Bins::log(1e-3, 1e3, 200));
+  mp::Histogram2D density(mp::Bins::linear(-4, 4, 400),
+                          mp::Bins::linear(-4, 4, 400));
+  mp::Hexbin hex(-4, 4, -4, 4, 60);
+
+  /*
+    Fifty million correlated normal pairs, arriving in blocks as they would
+    from a simulation or a file.  Only the counts are kept; each block is
+    binned on all cores and then discarded.
+  */
+  std::mt19937 gen(1);
+  std::normal_distribution<double> normal;
+  Eigen::ArrayXd x(1000000);
+  Eigen::ArrayXd y(x.size());
+  for (int block = 0; block < 50; ++block) {
+    for (Eigen::Index i = 0; i < x.size(); ++i) {
+      x[i] = normal(gen);
+      y[i] = 0.6 * x[i] + 0.8 * normal(gen);
+    }
+    hist.add((x * y).abs());
+    density.add(x, y);
+    hex.add(x, y);
+  }
+
+  hist.stairs(left);
+  left.attr("set_xscale")("log");
+  left.attr("set_title")("$|xy|$");
+  density.imshow(middle, py::dict("norm"_a = "log"));
+  middle.attr("set_title")("Histogram2D");
+  hex.plot(right, py::dict("cmap"_a = "inferno", "bins"_a = "log"));
+  right.attr("set_title")("Hexbin");
+
+  plt.attr("show")();
+}
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <mplot++/mapped.h>
+#include <mplot++/mplot++.h>
+#include <utility>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  auto np = py::module_::import("numpy");
+  auto plt = py::module_::import("matplotlib.pyplot");
+
+  // A capture of ten million samples saved by numpy
+  Eigen::ArrayXf t = Eigen::ArrayXf::LinSpaced(10000000, 0, 100);
+  Eigen::ArrayXf y = (t * t).sin();
+  np.attr("save")("capture.npy", mp::adopt(std::move(y)));
+
+  /*
+    The file is memory-mapped, not read.  Only the pages of the slice that is
+    plotted, and of the segment searched for its peak, are read from disk.
+  */
+  auto capture = mp::mapped_array<float>::npy("capture.npy");
+  auto samples = capture.numpy();
+  double peak = capture.vector().segment(1000000, 100000).maxCoeff();
+  std::cout << capture.size() << " samples, peak " << peak << '\n';
+
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("mapped");
+  ax.attr("plot")(samples[py::slice(1000000, 1100000, 1)]);
+  ax.attr("axhline")(peak, "color"_a = "C1", "ls"_a = "--");
+
+  plt.attr("show")();
+}
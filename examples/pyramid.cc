@@ -0,0 +1,56 @@
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <mplot++/mplot++.h>
+#include <mplot++/pyramid.h>
+#include <vector>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  /*
+    Write a raw file of 2^26 float samples, 256 MB, taken every microsecond.
+    In practice this would be a capture far larger than memory.
+  */
+  const size_t n = size_t(1) << 26;
+  const double dx = 1e-6;
+  {
+    std::ofstream out("pyramid.f32", std::ios::binary);
+    std::vector<float> block(1 << 20);
+    for (size_t i = 0; i < n; i += block.size()) {
+      for (size_t j = 0; j < block.size(); ++j) {
+        double t = double(i + j) * dx;
+        block[j] = float(std::sin(2 * t) * std::sin(4000 * t * t));
+      }
+      out.write(reinterpret_cast<const char*>(block.data()),
+                std::streamsize(block.size() * sizeof(float)));
+    }
+  }
+
+  /*
+    Index the file once.  The index holds the minimum and maximum of every
+    bucket of samples at several resolutions.
+  */
+  mp::Pyramid<float>::build("pyramid.f32", "pyramid.idx", 0.0, dx);
+
+  py::scoped_interpreter guard;
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("pyramid");
+
+  /*
+    Both files are memory-mapped.  Each zoom reads only the level of the index
+    matching the view and the width of the axes.
+  */
+  auto pyramid =
+    std::make_shared<mp::Pyramid<float>>("pyramid.f32", "pyramid.idx");
+  mp::plot_pyramid(ax, pyramid, py::dict("lw"_a = 0.5));
+  ax.attr("set_xlabel")("$t$ (s)");
+
+  plt.attr("show")();
+}
@@ -0,0 +1,55 @@
+#include <cmath>
+#include <memory>
+#include <mplot++/mplot++.h>
+#include <mplot++/raster.h>
+#include <random>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  /*
+    Twenty million points of a noisy Clifford attractor.  As a scatter plot
+    they would be far too many for matplotlib, and would merge into a solid
+    blot.
+  */
+  const Eigen::Index n = 20000000;
+  auto x = std::make_shared<Eigen::ArrayXd>(n);
+  auto y = std::make_shared<Eigen::ArrayXd>(n);
+  std::mt19937 gen(1);
+  std::normal_distribution<double> noise(0, 0.002);
+  double u = 0.1;
+  double v = 0.1;
+  for (Eigen::Index i = 0; i < n; ++i) {
+    double un = std::sin(-1.4 * v) + 1.6 * std::cos(-1.4 * u);
+    v = std::sin(1.6 * u) + 0.7 * std::cos(1.6 * v);
+    u = un;
+    (*x)[i] = u + noise(gen);
+    (*y)[i] = v + noise(gen);
+  }
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("raster");
+
+  /*
+    The points are counted per screen pixel in c++ and shown as an image.
+    Zooming rasterises the new view again at full resolution.
+  */
+  auto image = mp::plot_raster(ax,
+                               x,
+                               y,
+                               mp::RasterMode::Points,
+                               mp::Reduction::Count,
+                               nullptr,
+                               py::dict("norm"_a = "log",
+                                        "cmap"_a = "inferno"));
+  fig.attr("colorbar")(image, "ax"_a = ax, "label"_a = "points per pixel");
+
+  plt.attr("show")();
+}
@@ -0,0 +1,39 @@
+#include <cmath>
+#include <mplot++/mplot++.h>
+#include <mplot++/scene.h>
+#include <string>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("scene");
+
+  /*
+    The scene retains what is shown.  Each sync() creates artists on first
+    use and afterwards only pushes the properties that changed, so the label
+    below is only updated when its text changes.
+  */
+  mp::SceneFigure scene(fig);
+  auto& axes = scene.axes(ax);
+  auto& wave = axes.line(py::dict("color"_a = "C1"));
+  auto& label =
+    axes.text(0.05, 0.9, "", py::dict("transform"_a = ax.attr("transAxes")));
+
+  const Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(500, 0, 10);
+  for (int frame = 0; frame < 500; ++frame) {
+    double phase = frame * 0.05;
+    // Plotted against the indices 0, 1, ... as no abscissas are set
+    wave.set_ydata((x + phase).sin() * std::exp(-0.002 * frame));
+    label.set_text("cycle " + std::to_string(int(phase / (2 * 3.14159265))));
+    scene.sync();
+    plt.attr("pause")(0.01);
+  }
+}
@@ -0,0 +1,53 @@
+#include <cmath>
+#include <mplot++/mplot++.h>
+#include <mplot++/spectrogram.h>
+#include <random>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  /*
+    Ten minutes of a 48 kHz recording, 28.8 million samples, holding a
+    slow chirp and a steady tone in noise
+  */
+  const double fs = 48000;
+  const Eigen::Index n = Eigen::Index(600 * fs);
+  const double pi = 3.14159265358979323846;
+  std::mt19937 gen(1);
+  std::normal_distribution<float> noise(0, 0.5f);
+  Eigen::ArrayXf x(n);
+  for (Eigen::Index i = 0; i < n; ++i) {
+    double t = double(i) / fs;
+    x[i] = float(std::sin(2 * pi * (1000 + 15 * t) * t) +
+                 0.3 * std::sin(2 * pi * 6000 * t)) +
+           noise(gen);
+  }
+
+  /*
+    The segments are transformed on all cores.  Groups of segments are
+    averaged so that at most 2000 columns, about the width of a screen,
+    reach matplotlib.
+  */
+  mp::STFTOptions options;
+  options.nfft = 4096;
+  options.noverlap = 2048;
+  options.fs = fs;
+  options.max_columns = 2000;
+  auto spec = mp::spectrogram(x, options);
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("spectrogram");
+  auto image = spec.imshow(ax, py::dict("cmap"_a = "magma"));
+  fig.attr("colorbar")(image, "ax"_a = ax, "label"_a = "dB");
+  ax.attr("set_xlabel")("$t$ (s)");
+  ax.attr("set_ylabel")("$f$ (Hz)");
+
+  plt.attr("show")();
+}
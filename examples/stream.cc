@@ -0,0 +1,43 @@
+#include <cmath>
+#include <mplot++/mplot++.h>
+#include <mplot++/stream.h>
+#include <random>
+
+namespace mp = mplotpp;
+namespace py = pybind11;
+using namespace py::literals;
+
+int
+main()
+{
+  py::scoped_interpreter guard;
+
+  auto plt = py::module_::import("matplotlib.pyplot");
+  auto [fig, ax] = mp::tuple<2>(plt.attr("subplots")());
+  fig.attr("suptitle")("stream");
+  plt.attr("show")("block"_a = false);
+
+  /*
+    Two live traces showing their most recent 2000 samples.  Only the traces
+    are redrawn each frame, over a saved background, and at most 60 times a
+    second however often update() is called.
+  */
+  mp::StreamingPlot stream(fig, 60);
+  auto& signal = stream.add_series(ax, 2000, py::dict("color"_a = "C0"));
+  auto& mean = stream.add_series(ax, 2000, py::dict("color"_a = "C1"));
+
+  std::mt19937 gen(1);
+  std::normal_distribution<double> noise(0, 0.2);
+  double average = 0;
+  auto fignum_exists = plt.attr("fignum_exists");
+  auto number = fig.attr("number");
+  // Stop early if the window is closed
+  for (int i = 0; i < 20000 and fignum_exists(number).cast<bool>(); ++i) {
+    double t = i * 0.01;
+    double y = std::sin(t) + noise(gen);
+    average += (y - average) * 0.05;
+    signal.append(t, y);
+    mean.append(t, average);
+    stream.update();
+  }
+}
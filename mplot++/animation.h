@@ -0,0 +1,485 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mplot++/mapped.h>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+/// Row-major RGBA bytes of a frame, `height` rows of `4 * width` bytes
+using RGBAMap = Eigen::Map<const Eigen::Array<std::uint8_t,
+                                              Eigen::Dynamic,
+                                              Eigen::Dynamic,
+                                              Eigen::RowMajor>>;
+
+/**
+   @brief The pixels of an Agg canvas, without copying
+
+   The figure is drawn and its `buffer_rgba()` is exposed to `c++`
+   ```
+   mplotpp::CanvasFrame frame(fig);
+   auto alpha = frame.rgba().rightCols(1);
+   ```
+   The pixels are those of the canvas itself, so they are valid until the
+   figure is next drawn or resized.  A CanvasFrame holds a python buffer, so
+   it must be destroyed while the GIL is held.
+*/
+class CanvasFrame
+{
+public:
+  /**
+     @brief Expose the canvas of a figure
+
+     @param fig A figure with an Agg-based canvas
+     @param draw Whether to draw the figure first
+     @throw std::runtime_error if the canvas does not give RGBA pixels
+  */
+  explicit CanvasFrame(pybind11::object fig, bool draw = true)
+  {
+    auto canvas = fig.attr("canvas");
+    if (draw) {
+      canvas.attr("draw")();
+    }
+    info_ = pybind11::buffer(canvas.attr("buffer_rgba")()).request();
+    if (info_.ndim != 3 or info_.shape[2] != 4 or info_.itemsize != 1 or
+        info_.strides[2] != 1 or info_.strides[1] != 4 or
+        info_.strides[0] != 4 * info_.shape[1]) {
+      throw(std::runtime_error("Canvas buffer is not contiguous RGBA"));
+    }
+  }
+
+  /// The width in pixels
+  Eigen::Index width() const { return Eigen::Index(info_.shape[1]); }
+
+  /// The height in pixels
+  Eigen::Index height() const { return Eigen::Index(info_.shape[0]); }
+
+  /// The first byte of the top row
+  const std::uint8_t* data() const
+  {
+    return static_cast<const std::uint8_t*>(info_.ptr);
+  }
+
+  /// The pixels as `height()` rows of `4 * width()` bytes
+  RGBAMap rgba() const { return RGBAMap(data(), height(), 4 * width()); }
+
+private:
+  pybind11::buffer_info info_;
+};
+
+/// A frame handed to a FrameSink
+struct Frame
+{
+  /// Row-major RGBA bytes, from the top row down
+  const std::uint8_t* data;
+  Eigen::Index width;
+  Eigen::Index height;
+  /// The number of frames before this one
+  size_t index;
+
+  /// The pixels as `height` rows of `4 * width` bytes
+  RGBAMap rgba() const { return RGBAMap(data, height, 4 * width); }
+};
+
+/**
+   @brief The destination of the frames of an AnimationWriter
+
+   Sinks are called on the writer thread, without the GIL, so they must not
+   use python.
+*/
+class FrameSink
+{
+public:
+  virtual ~FrameSink() = default;
+
+  /// Consume a frame.  The data is only valid during the call.
+  virtual void write(const Frame& frame) = 0;
+
+  /// Finish after the last frame
+  virtual void close() {}
+};
+
+/// The encoding of frames written by a StreamSink
+enum class FrameFormat
+{
+  /// Bare RGBA bytes, as `ffmpeg -f rawvideo -pix_fmt rgba`
+  Raw,
+  /// YUV4MPEG2 with 4:4:4 BT.601 video-range chroma, ignoring alpha
+  Y4M
+};
+
+namespace detail {
+
+/**
+   @private
+   @brief Convert RGBA rows to the Y, U and V planes of `out`
+*/
+inline void
+rgba_to_yuv444(const Frame& frame, std::vector<std::uint8_t>& out)
+{
+  const Eigen::Index w = frame.width;
+  const Eigen::Index h = frame.height;
+  const Eigen::Index plane = w * h;
+  out.resize(size_t(3 * plane));
+  std::uint8_t* y = out.data();
+  std::uint8_t* u = y + plane;
+  std::uint8_t* v = u + plane;
+  parallel_for(
+    Eigen::Index(0),
+    h,
+    Eigen::Index(16),
+    [&](Eigen::Index first, Eigen::Index last) {
+      for (Eigen::Index k = first * w; k < last * w; ++k) {
+        const int r = frame.data[4 * k];
+        const int g = frame.data[4 * k + 1];
+        const int b = frame.data[4 * k + 2];
+        y[k] = std::uint8_t(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        u[k] = std::uint8_t(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        v[k] = std::uint8_t(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+      }
+    });
+}
+
+}
+
+/**
+   @brief Writes frames to a file or to the standard input of a command
+
+   A command receiving YUV4MPEG2 needs no description of the frames, so an
+   encoder can be run directly
+   ```
+   auto sink = mplotpp::StreamSink::command(
+     "ffmpeg -y -loglevel error -i - -pix_fmt yuv420p movie.mp4",
+     mplotpp::FrameFormat::Y4M, 30);
+   ```
+   If the command exits early, writing raises `SIGPIPE`, which terminates the
+   process unless it is ignored.
+*/
+class StreamSink : public FrameSink
+{
+public:
+  /**
+     @brief Write frames to a file
+
+     @param path The file, which is replaced
+     @param format The encoding
+     @param fps Frames per second, recorded in YUV4MPEG2 headers
+     @throw std::runtime_error if the file cannot be created
+  */
+  static std::unique_ptr<StreamSink> file(const std::string& path,
+                                          FrameFormat format = FrameFormat::Y4M,
+                                          double fps = 25)
+  {
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (not f) {
+      detail::throw_errno("Cannot create", path);
+    }
+    return std::unique_ptr<StreamSink>(
+      new StreamSink(f, false, path, format, fps));
+  }
+
+  /**
+     @brief Write frames to the standard input of a shell command
+
+     @param cmd The command, run with `popen()`
+     @param format The encoding
+     @param fps Frames per second, recorded in YUV4MPEG2 headers
+     @throw std::runtime_error if the command cannot be started
+  */
+  static std::unique_ptr<StreamSink> command(
+    const std::string& cmd,
+    FrameFormat format = FrameFormat::Y4M,
+    double fps = 25)
+  {
+    FILE* f = ::popen(cmd.c_str(), "w");
+    if (not f) {
+      detail::throw_errno("Cannot start", cmd);
+    }
+    return std::unique_ptr<StreamSink>(
+      new StreamSink(f, true, cmd, format, fps));
+  }
+
+  StreamSink(const StreamSink&) = delete;
+  StreamSink& operator=(const StreamSink&) = delete;
+
+  ~StreamSink() override
+  {
+    if (file_) {
+      finish();
+    }
+  }
+
+  /**
+     @throw std::runtime_error if writing fails
+     @throw std::invalid_argument if the frame size changes in a YUV4MPEG2
+     stream
+  */
+  void write(const Frame& frame) override
+  {
+    if (format_ == FrameFormat::Raw) {
+      put(frame.data, size_t(4 * frame.width * frame.height));
+      return;
+    }
+    if (frame.index == 0) {
+      char header[128];
+      int n = std::snprintf(header,
+                            sizeof(header),
+                            "YUV4MPEG2 W%ld H%ld F%ld:1000 Ip A1:1 C444\n",
+                            long(frame.width),
+                            long(frame.height),
+                            std::lround(fps_ * 1000));
+      put(header, size_t(n));
+      width_ = frame.width;
+      height_ = frame.height;
+    } else if (frame.width != width_ or frame.height != height_) {
+      throw(std::invalid_argument("Frame size changed in " + name_));
+    }
+    detail::rgba_to_yuv444(frame, planes_);
+    put("FRAME\n", 6);
+    put(planes_.data(), planes_.size());
+  }
+
+  /**
+     @throw std::runtime_error if the file cannot be flushed or the command
+     fails
+  */
+  void close() override
+  {
+    if (file_ and finish() != 0) {
+      throw(std::runtime_error("Cannot finish writing " + name_));
+    }
+  }
+
+private:
+  StreamSink(FILE* file,
+             bool pipe,
+             std::string name,
+             FrameFormat format,
+             double fps)
+    : file_(file)
+    , pipe_(pipe)
+    , name_(std::move(name))
+    , format_(format)
+    , fps_(fps)
+  {}
+
+  void put(const void* data, size_t n)
+  {
+    if (std::fwrite(data, 1, n, file_) != n) {
+      detail::throw_errno("Cannot write to", name_);
+    }
+  }
+
+  int finish()
+  {
+    FILE* f = file_;
+    file_ = nullptr;
+    return pipe_ ? ::pclose(f) : std::fclose(f);
+  }
+
+  FILE* file_;
+  bool pipe_;
+  std::string name_;
+  FrameFormat format_;
+  double fps_;
+  Eigen::Index width_ = 0;
+  Eigen::Index height_ = 0;
+  std::vector<std::uint8_t> planes_;
+};
+
+/**
+   @brief Capture the frames of an animation and write them on a background
+   thread.
+
+   Saving every frame with `savefig` spends most of its time compressing
+   PNG files.  An AnimationWriter instead takes the pixels of the Agg canvas
+   after each draw and passes them to a FrameSink, such as a StreamSink
+   feeding a video encoder
+   ```
+   mplotpp::AnimationWriter writer(
+     fig,
+     mplotpp::StreamSink::command("ffmpeg -y -i - movie.mp4",
+                                  mplotpp::FrameFormat::Y4M, 30));
+   for (int step = 0; step < nsteps; ++step) {
+     line.attr("set_ydata")(mplotpp::view(solve(step)));
+     writer.capture();
+   }
+   writer.close();
+   ```
+   Each frame is copied once from the canvas into one of a ring of buffers,
+   so the next frame can be drawn while the sink writes the previous one.
+   capture() only waits if every buffer is still waiting to be written.
+
+   An error on the writer thread is rethrown by the next capture() or by
+   close().  The destructor closes the writer, discarding any error.
+*/
+class AnimationWriter
+{
+public:
+  /**
+     @brief Start the writer thread
+
+     @param fig A figure with an Agg-based canvas
+     @param sink The destination of the frames
+     @param buffers The number of frames that may wait to be written, at
+     least 2
+  */
+  AnimationWriter(pybind11::object fig,
+                  std::unique_ptr<FrameSink> sink,
+                  size_t buffers = 2)
+    : fig_(std::move(fig))
+    , sink_(std::move(sink))
+    , slots_(std::max<size_t>(2, buffers))
+    , thread_([this]() { run(); })
+  {}
+
+  AnimationWriter(const AnimationWriter&) = delete;
+  AnimationWriter& operator=(const AnimationWriter&) = delete;
+
+  ~AnimationWriter()
+  {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  /**
+     @brief Draw the figure and queue its pixels for writing
+
+     The GIL must be held.  It is released while waiting for a free buffer.
+
+     @throw std::invalid_argument if the canvas size has changed
+     @throw std::logic_error if the writer is closed
+     @throw any exception raised by the sink for an earlier frame
+  */
+  void capture()
+  {
+    CanvasFrame frame(fig_);
+    if (frames_ == 0) {
+      width_ = frame.width();
+      height_ = frame.height();
+    } else if (frame.width() != width_ or frame.height() != height_) {
+      throw(std::invalid_argument("Canvas size changed during animation"));
+    }
+    Slot* slot = nullptr;
+    {
+      pybind11::gil_scoped_release release;
+      std::unique_lock<std::mutex> lock(mutex_);
+      slot = &slots_[frames_ % slots_.size()];
+      changed_.wait(
+        lock, [&]() { return not slot->full or error_ or closed_; });
+      rethrow();
+      if (closed_) {
+        throw(std::logic_error("AnimationWriter is closed"));
+      }
+    }
+    slot->data.assign(frame.data(), frame.data() + 4 * width_ * height_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    slot->full = true;
+    ++frames_;
+    changed_.notify_all();
+  }
+
+  /// The number of frames captured
+  size_t frames() const { return frames_; }
+
+  /**
+     @brief Write the remaining frames, stop the thread and close the sink
+
+     Closing again has no effect.
+
+     @throw any exception raised by the sink
+  */
+  void close()
+  {
+    if (not thread_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+      changed_.notify_all();
+    }
+    if (Py_IsInitialized() and PyGILState_Check()) {
+      pybind11::gil_scoped_release release;
+      thread_.join();
+    } else {
+      thread_.join();
+    }
+    rethrow();
+    sink_->close();
+  }
+
+private:
+  struct Slot
+  {
+    std::vector<std::uint8_t> data;
+    bool full = false;
+  };
+
+  void run()
+  {
+    for (size_t n = 0;; ++n) {
+      Slot& slot = slots_[n % slots_.size()];
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [&]() { return slot.full or closed_; });
+        if (not slot.full) {
+          return;
+        }
+      }
+      try {
+        sink_->write(Frame{ slot.data.data(), width_, height_, n });
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        error_ = std::current_exception();
+        changed_.notify_all();
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      slot.full = false;
+      changed_.notify_all();
+    }
+  }
+
+  /// Rethrow the writer's error once, with the mutex held or after the writer
+  /// has stopped
+  void rethrow()
+  {
+    if (error_) {
+      closed_ = true;
+      std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+  }
+
+  pybind11::object fig_;
+  std::unique_ptr<FrameSink> sink_;
+  std::vector<Slot> slots_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::exception_ptr error_;
+  bool closed_ = false;
+  size_t frames_ = 0;
+  Eigen::Index width_ = 0;
+  Eigen::Index height_ = 0;
+  std::thread thread_;
+};
+
+}
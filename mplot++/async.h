@@ -0,0 +1,326 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mplot++/mplot++.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief Intrusive multi-producer single-consumer queue
+
+   This is Dmitry Vyukov's non-blocking MPSC queue.  push() is wait-free and
+   may be called from any thread; pop() must only be called from a single
+   consumer thread.  The queue never owns its nodes.
+*/
+class MPSCQueue
+{
+public:
+  struct Node
+  {
+    std::atomic<Node*> next{ nullptr };
+  };
+
+  MPSCQueue()
+    : head_(&stub_)
+    , tail_(&stub_)
+  {}
+
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  /// Append a node.  Safe to call concurrently from any number of threads.
+  void push(Node* node)
+  {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  /**
+     @brief Remove the oldest node
+
+     @return The node, or nullptr if the queue is empty or a producer is part
+     way through linking the next node.
+  */
+  Node* pop()
+  {
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (next == nullptr) {
+        return nullptr;
+      }
+      tail_ = next;
+      tail = next;
+      next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+      tail_ = next;
+      return tail;
+    }
+    if (tail != head_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      tail_ = next;
+      return tail;
+    }
+    return nullptr;
+  }
+
+private:
+  std::atomic<Node*> head_;
+  Node* tail_;
+  Node stub_;
+};
+
+/**
+   @private
+   @brief A unit of work for the render thread
+*/
+struct RenderTask : MPSCQueue::Node
+{
+  virtual ~RenderTask() = default;
+  virtual void run(pybind11::dict& ns) = 0;
+};
+
+/**
+   @private
+   @brief A RenderTask that fulfils a std::future with the result of a
+   callable.
+*/
+template<class F, class R>
+struct RenderTaskImpl : RenderTask
+{
+  explicit RenderTaskImpl(F&& f)
+    : func(std::move(f))
+  {}
+
+  void run(pybind11::dict& ns) override
+  {
+    try {
+      if constexpr (std::is_void<R>::value) {
+        invoke(ns);
+        promise.set_value();
+      } else {
+        promise.set_value(invoke(ns));
+      }
+    } catch (pybind11::error_already_set& e) {
+      // The python exception must not outlive the interpreter, so only its
+      // message crosses back to the caller
+      promise.set_exception(
+        std::make_exception_ptr(std::runtime_error(e.what())));
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+    }
+  }
+
+  R invoke(pybind11::dict& ns)
+  {
+    if constexpr (std::is_invocable<F&, pybind11::dict&>::value) {
+      return func(ns);
+    } else {
+      return func();
+    }
+  }
+
+  F func;
+  std::promise<R> promise;
+};
+
+}
+
+/**
+   @brief Run matplotlib on a dedicated background thread.
+
+   An AsyncPlotter owns the embedded python interpreter.  The interpreter is
+   started on a render thread, which then executes plotting commands submitted
+   from any `c++` thread in the order they were submitted.  Submitting is
+   lock-free and returns immediately with a `std::future`, so that plotting
+   does not stall the computation that produces the data
+   ```
+   mplotpp::AsyncPlotter plotter("Agg");
+   plotter.submit([](py::dict& ns) {
+     auto plt = py::module_::import("matplotlib.pyplot");
+     auto [fig, ax] = mplotpp::tuple<2>(plt.attr("subplots")());
+     ns["fig"] = fig;
+     ns["ax"] = ax;
+   });
+   for (int step = 0; step < nsteps; ++step) {
+     Eigen::ArrayXd y = solve(step);
+     plotter.submit([step, y = std::move(y)](py::dict& ns) mutable {
+       ns["ax"].attr("plot")(mplotpp::adopt(std::move(y)));
+       ns["fig"].attr("savefig")("step" + std::to_string(step) + ".png");
+     });
+   }
+   plotter.wait();
+   ```
+   Commands are callables taking either no arguments or a `pybind11::dict&`,
+   a namespace that persists between commands for keeping python objects such
+   as figures and axes.  Data needed by a command should be moved into it, as
+   above, where adopt() then hands the buffer to python without copying.
+
+   Python objects must only be created, used and destroyed by commands.  In
+   particular, a command must not return a python object and must not capture
+   one by value.  A python exception raised by a command is rethrown by the
+   future as `std::runtime_error` with the python error message.
+
+   Since the render thread owns the interpreter, a process may have only one
+   AsyncPlotter and must not also use `pybind11::scoped_interpreter`.
+   Interactive backends that insist on running on the main thread (notably
+   the macOS backend) cannot be used; `Agg` and the other file-based backends
+   work everywhere.
+*/
+class AsyncPlotter
+{
+public:
+  /**
+     @brief Start the interpreter on a new render thread
+
+     @param backend If not empty, the matplotlib backend to select with
+     `matplotlib.use()` before `matplotlib.pyplot` is imported.
+     @throw std::runtime_error if the interpreter cannot be started or the
+     backend cannot be selected.
+  */
+  explicit AsyncPlotter(const std::string& backend = "")
+  {
+    std::promise<void> started;
+    auto ready = started.get_future();
+    thread_ = std::thread([this, backend, &started]() {
+      render_loop(backend, started);
+    });
+    try {
+      ready.get();
+    } catch (...) {
+      thread_.join();
+      throw;
+    }
+  }
+
+  AsyncPlotter(const AsyncPlotter&) = delete;
+  AsyncPlotter& operator=(const AsyncPlotter&) = delete;
+
+  /**
+     @brief Execute all outstanding commands, then stop the render thread and
+     the interpreter.
+  */
+  ~AsyncPlotter()
+  {
+    stop_ = true;
+    wake();
+    thread_.join();
+  }
+
+  /**
+     @brief Queue a command for execution on the render thread
+
+     @tparam F A callable with signature `R()` or `R(pybind11::dict&)`
+     @param f The command.  It is moved into the queue.
+     @return A future for the value returned by `f`
+  */
+  template<class F>
+  auto submit(F&& f)
+  {
+    using Func = std::decay_t<F>;
+    using R = typename std::conditional_t<
+      std::is_invocable<Func&, pybind11::dict&>::value,
+      std::invoke_result<Func&, pybind11::dict&>,
+      std::invoke_result<Func&>>::type;
+    static_assert(not std::is_base_of<pybind11::handle, R>::value,
+                  "Python objects must not leave the render thread");
+
+    auto task = new detail::RenderTaskImpl<Func, R>(Func(std::forward<F>(f)));
+    auto result = task->promise.get_future();
+    ++pending_;
+    queue_.push(task);
+    wake();
+    return result;
+  }
+
+  /**
+     @brief Block until all commands submitted so far have been executed
+  */
+  void wait()
+  {
+    submit([]() {}).get();
+  }
+
+private:
+  void wake()
+  {
+    if (sleeping_) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ready_.notify_one();
+    }
+  }
+
+  void render_loop(const std::string& backend, std::promise<void>& started)
+  {
+    std::unique_ptr<pybind11::scoped_interpreter> guard;
+    try {
+      guard = std::make_unique<pybind11::scoped_interpreter>();
+      if (not backend.empty()) {
+        pybind11::module_::import("matplotlib").attr("use")(backend);
+      }
+      pybind11::module_::import("matplotlib.pyplot");
+    } catch (pybind11::error_already_set& e) {
+      started.set_exception(
+        std::make_exception_ptr(std::runtime_error(e.what())));
+      return;
+    } catch (...) {
+      started.set_exception(std::current_exception());
+      return;
+    }
+    started.set_value();
+
+    pybind11::dict ns;
+    while (true) {
+      auto task = static_cast<detail::RenderTask*>(queue_.pop());
+      if (task != nullptr) {
+        --pending_;
+        task->run(ns);
+        delete task;
+        continue;
+      }
+      if (pending_ > 0) {
+        // A producer is part way through push()
+        std::this_thread::yield();
+        continue;
+      }
+      if (stop_) {
+        break;
+      }
+      pybind11::gil_scoped_release release;
+      std::unique_lock<std::mutex> lock(mutex_);
+      sleeping_ = true;
+      ready_.wait(lock, [this]() { return pending_ > 0 or stop_; });
+      sleeping_ = false;
+    }
+  }
+
+  detail::MPSCQueue queue_;
+  std::atomic<size_t> pending_{ 0 };
+  std::atomic<bool> sleeping_{ false };
+  std::atomic<bool> stop_{ false };
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::thread thread_;
+};
+
+}
@@ -0,0 +1,589 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <functional>
+#include <mplot++/zygote.h>
+#include <new>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief RAII wrapper around an anonymous mapping shared with forked children
+*/
+class SharedMapping
+{
+public:
+  SharedMapping() = default;
+
+  explicit SharedMapping(size_t size)
+    : size_(size)
+  {
+    if (size_ > 0) {
+      void* p = ::mmap(nullptr,
+                       size_,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS,
+                       -1,
+                       0);
+      if (p == MAP_FAILED) {
+        throw_errno("Cannot map", "shared memory");
+      }
+      data_ = static_cast<char*>(p);
+    }
+  }
+
+  SharedMapping(const SharedMapping&) = delete;
+  SharedMapping& operator=(const SharedMapping&) = delete;
+
+  SharedMapping(SharedMapping&& other) noexcept
+    : data_(other.data_)
+    , size_(other.size_)
+  {
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+
+  SharedMapping& operator=(SharedMapping&& other) noexcept
+  {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  ~SharedMapping()
+  {
+    if (data_) {
+      ::munmap(data_, size_);
+    }
+  }
+
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+/**
+   @private
+   @brief Work-stealing schedule shared by the workers of one batch round
+
+   Each worker owns a range of positions in `order`, packed as begin and end
+   in one 64 bit atomic so that the owner taking from the front and thieves
+   taking half from the back never see a torn range.  The layout lives in a
+   shared mapping, so it relies on lock-free atomics being address-free.
+*/
+class BatchSchedule
+{
+  static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                "Work stealing across processes needs lock-free atomics");
+
+public:
+  BatchSchedule(const std::vector<uint32_t>& jobs, size_t workers)
+    : workers_(workers)
+    , memory_(workers * sizeof(std::atomic<uint64_t>) +
+              jobs.size() * sizeof(uint32_t))
+  {
+    ranges_ = reinterpret_cast<std::atomic<uint64_t>*>(memory_.data());
+    order_ = reinterpret_cast<uint32_t*>(ranges_ + workers_);
+    std::copy(jobs.begin(), jobs.end(), order_);
+    uint64_t n = jobs.size();
+    for (size_t w = 0; w < workers_; ++w) {
+      new (ranges_ + w)
+        std::atomic<uint64_t>(pack(n * w / workers_, n * (w + 1) / workers_));
+    }
+  }
+
+  /**
+     @brief The next job for a worker, taken from its own range or stolen
+     from another.  Returns false when no work is left anywhere.
+  */
+  bool next(size_t self, uint32_t& job)
+  {
+    while (true) {
+      uint64_t r = ranges_[self].load();
+      while (begin(r) < end(r)) {
+        if (ranges_[self].compare_exchange_weak(
+              r, pack(begin(r) + 1, end(r)))) {
+          job = order_[begin(r)];
+          return true;
+        }
+      }
+      if (not steal(self)) {
+        return false;
+      }
+    }
+  }
+
+  /// Whether any range still holds work
+  bool remaining() const
+  {
+    for (size_t w = 0; w < workers_; ++w) {
+      uint64_t r = ranges_[w].load();
+      if (begin(r) < end(r)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  static uint64_t pack(uint64_t b, uint64_t e) { return b << 32 | e; }
+  static uint64_t begin(uint64_t r) { return r >> 32; }
+  static uint64_t end(uint64_t r) { return r & 0xffffffffu; }
+
+  bool steal(size_t self)
+  {
+    for (size_t k = 1; k < workers_; ++k) {
+      auto& victim = ranges_[(self + k) % workers_];
+      uint64_t r = victim.load();
+      while (begin(r) < end(r)) {
+        uint64_t half = (end(r) - begin(r) + 1) / 2;
+        if (victim.compare_exchange_weak(r,
+                                         pack(begin(r), end(r) - half))) {
+          ranges_[self].store(pack(end(r) - half, end(r)));
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  size_t workers_;
+  SharedMapping memory_;
+  std::atomic<uint64_t>* ranges_;
+  uint32_t* order_;
+};
+
+}
+
+/**
+   @brief A contiguous array in a SharedArena, visible to all batch workers
+*/
+template<class T>
+struct SharedArray
+{
+  T* data = nullptr;
+  size_t size = 0;
+
+  /// An Eigen view of the array
+  Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>> vector() const
+  {
+    return { data, Eigen::Index(size) };
+  }
+
+  /// A read-only numpy view of the array, which must not outlive the arena
+  pybind11::array_t<T> numpy() const
+  {
+    pybind11::array_t<T> a(
+      { pybind11::ssize_t(size) }, { pybind11::ssize_t(sizeof(T)) }, data,
+      pybind11::capsule(data, [](void*) {}));
+    a.attr("setflags")(pybind11::arg("write") = false);
+    return a;
+  }
+};
+
+/**
+   @brief Memory shared between a process and the batch workers it forks.
+
+   Arrays are allocated in the parent before BatchRenderer::run().  Since the
+   workers are forked from the parent they see the arena at the same address,
+   so jobs can simply capture SharedArray objects and plot them without the
+   data ever being copied or serialised.
+*/
+class SharedArena
+{
+public:
+  /**
+     @brief Reserve shared memory
+
+     @param capacity The total number of bytes available for arrays
+  */
+  explicit SharedArena(size_t capacity)
+    : memory_(capacity)
+  {}
+
+  /**
+     @brief Allocate an uninitialised array
+
+     @param n The number of elements
+     @throw std::bad_alloc if the arena is full
+  */
+  template<class T>
+  SharedArray<T> allocate(size_t n)
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Shared arrays hold plain data");
+    size_t start = (used_ + 63) / 64 * 64;
+    // Compared by division, as n * sizeof(T) can overflow
+    if (start > memory_.size() or n > (memory_.size() - start) / sizeof(T)) {
+      throw(std::bad_alloc());
+    }
+    used_ = start + n * sizeof(T);
+    return { reinterpret_cast<T*>(memory_.data() + start), n };
+  }
+
+  /**
+     @brief Copy an Eigen vector into a new shared array
+
+     @param v The data to copy
+  */
+  template<class Derived>
+  SharedArray<typename Derived::Scalar> copy(const Eigen::DenseBase<Derived>& v)
+  {
+    static_assert(Derived::IsVectorAtCompileTime, "Only vectors are copied");
+    auto a = allocate<typename Derived::Scalar>(size_t(v.size()));
+    for (Eigen::Index i = 0; i < v.size(); ++i) {
+      a.data[i] = v.derived().coeff(i);
+    }
+    return a;
+  }
+
+  /// The number of bytes allocated so far
+  size_t used() const { return used_; }
+
+  /// The capacity in bytes
+  size_t capacity() const { return memory_.size(); }
+
+private:
+  detail::SharedMapping memory_;
+  size_t used_ = 0;
+};
+
+/// The outcome of one batch job
+struct BatchResult
+{
+  /// Whether the job eventually succeeded
+  bool ok = false;
+  /// The number of times the job was run
+  unsigned attempts = 0;
+  /// The value returned by the job, or the error of its last attempt
+  std::string output;
+};
+
+/// Options for a BatchRenderer
+struct BatchOptions
+{
+  /// The number of worker processes, or 0 for one per core
+  unsigned workers = 0;
+  /// How many times a failed or crashed job is run again
+  unsigned retries = 2;
+  /// The matplotlib backend used by the workers
+  std::string backend = "Agg";
+  /// Modules imported by each worker before it takes jobs
+  std::vector<std::string> modules = { "matplotlib.pyplot" };
+};
+
+/**
+   @brief Render many independent figures in parallel worker processes.
+
+   A single interpreter serialises all plotting on the GIL.  A BatchRenderer
+   instead forks a pool of workers, each with its own interpreter using the
+   Agg backend, and spreads the jobs over them with work stealing so that
+   a few slow figures do not leave the other cores idle.  A job is a `c++`
+   function run in a worker with the GIL held.  It typically plots and
+   saves one figure and returns its file name or the image itself
+   ```
+   mplotpp::SharedArena arena(1 << 30);
+   auto y = arena.copy(series);
+   mplotpp::BatchRenderer batch;
+   for (int i = 0; i < 1000; ++i) {
+     batch.add([&, i]() {
+       auto plt = py::module_::import("matplotlib.pyplot");
+       plt.attr("plot")(y.numpy()[py::slice(i * 100, i * 100 + 100, 1)]);
+       plt.attr("savefig")("report" + std::to_string(i) + ".png");
+     });
+   }
+   auto results = batch.run();
+   ```
+   Data reaches the workers through fork() or a SharedArena, without copies.
+   After each job, all figures are closed.  A job that throws, or whose worker
+   crashes, is run again up to BatchOptions::retries times, and a crashed
+   worker is replaced.  Results are returned in the order the jobs were
+   added, whichever worker ran them.
+
+   If the calling process already runs an interpreter, the calling thread
+   must hold the GIL and the workers inherit a copy of it; otherwise each
+   worker starts its own.
+*/
+class BatchRenderer
+{
+public:
+  /// A job, returning an arbitrary result
+  using Job = std::function<std::string()>;
+
+  /// Construct with the given options
+  explicit BatchRenderer(BatchOptions options = {})
+    : options_(std::move(options))
+  {
+    if (options_.workers == 0) {
+      options_.workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+  }
+
+  /**
+     @brief Add a job
+
+     @param f A callable returning `std::string` or `void`
+     @return The index of the job, and of its result
+  */
+  template<class F>
+  size_t add(F&& f)
+  {
+    using R = decltype(f());
+    if constexpr (std::is_void<R>::value) {
+      jobs_.emplace_back([f = std::forward<F>(f)]() {
+        f();
+        return std::string();
+      });
+    } else {
+      jobs_.emplace_back(std::forward<F>(f));
+    }
+    return jobs_.size() - 1;
+  }
+
+  /// The number of jobs added
+  size_t size() const { return jobs_.size(); }
+
+  /**
+     @brief Run all jobs and wait for them to finish
+
+     @return One result per job, in the order the jobs were added
+     @throw std::runtime_error if no worker can be started
+  */
+  std::vector<BatchResult> run()
+  {
+    if (jobs_.size() > 0xffffffffu) {
+      throw(std::length_error("Too many batch jobs"));
+    }
+    std::vector<BatchResult> results(jobs_.size());
+    std::vector<uint32_t> pending(jobs_.size());
+    for (size_t i = 0; i < pending.size(); ++i) {
+      pending[i] = uint32_t(i);
+    }
+    for (unsigned round = 0; round <= options_.retries and not pending.empty();
+         ++round) {
+      std::vector<bool> reported(jobs_.size(), false);
+      run_round(pending, results, reported);
+      std::vector<uint32_t> failed;
+      for (auto job : pending) {
+        if (not reported[job]) {
+          results[job].ok = false;
+          results[job].attempts += 1;
+          results[job].output = "Worker terminated while running job";
+        }
+        if (not results[job].ok) {
+          failed.push_back(job);
+        }
+      }
+      pending.swap(failed);
+    }
+    return results;
+  }
+
+private:
+  struct Worker
+  {
+    pid_t pid = -1;
+    int fd = -1;
+  };
+
+  void run_round(const std::vector<uint32_t>& pending,
+                 std::vector<BatchResult>& results,
+                 std::vector<bool>& reported)
+  {
+    size_t nworkers = std::min<size_t>(options_.workers, pending.size());
+    detail::BatchSchedule schedule(pending, nworkers);
+    std::vector<Worker> workers(nworkers);
+    for (size_t w = 0; w < nworkers; ++w) {
+      try {
+        workers[w] = spawn(schedule, w);
+      } catch (...) {
+        // Stop the workers already started rather than leave them running
+        // with nobody reading their results
+        stop(workers);
+        throw;
+      }
+    }
+
+    // Bound the replacements so that workers that cannot start do not
+    // respawn forever
+    size_t respawns = nworkers * (options_.retries + 1);
+    size_t open = nworkers;
+    while (open > 0) {
+      std::vector<pollfd> fds;
+      std::vector<size_t> slots;
+      for (size_t w = 0; w < nworkers; ++w) {
+        if (workers[w].fd >= 0) {
+          fds.push_back({ workers[w].fd, POLLIN, 0 });
+          slots.push_back(w);
+        }
+      }
+      if (::poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        int error = errno;
+        stop(workers);
+        errno = error;
+        detail::throw_errno("Cannot poll", "batch workers");
+      }
+      for (size_t k = 0; k < fds.size(); ++k) {
+        if (fds[k].revents == 0) {
+          continue;
+        }
+        Worker& worker = workers[slots[k]];
+        uint32_t job;
+        char status;
+        std::string output;
+        if (detail::read_all(worker.fd, &job, sizeof(job)) and
+            detail::read_all(worker.fd, &status, 1) and
+            detail::receive_frame(worker.fd, output)) {
+          reported[job] = true;
+          results[job].ok = status == 0;
+          results[job].attempts += 1;
+          results[job].output = std::move(output);
+          continue;
+        }
+        ::close(worker.fd);
+        int wstatus = 0;
+        ::waitpid(worker.pid, &wstatus, 0);
+        worker = Worker();
+        --open;
+        bool crashed = not WIFEXITED(wstatus) or WEXITSTATUS(wstatus) != 0;
+        if (crashed and respawns > 0 and schedule.remaining()) {
+          --respawns;
+          worker = spawn(schedule, slots[k], false);
+          if (worker.fd >= 0) {
+            ++open;
+          }
+        }
+      }
+    }
+
+    // Every worker has gone, so jobs still in the schedule were never run
+    uint32_t job;
+    while (schedule.next(0, job)) {
+      reported[job] = true;
+      results[job].ok = false;
+      results[job].output = "No batch worker could be started for job";
+    }
+  }
+
+  /// Stop the workers still running, without waiting for their jobs
+  static void stop(std::vector<Worker>& workers)
+  {
+    for (auto& worker : workers) {
+      if (worker.fd >= 0) {
+        ::close(worker.fd);
+        ::kill(worker.pid, SIGKILL);
+        ::waitpid(worker.pid, nullptr, 0);
+        worker = Worker();
+      }
+    }
+  }
+
+  Worker spawn(detail::BatchSchedule& schedule, size_t slot, bool fail = true)
+  {
+    int pipefd[2];
+    if (::pipe(pipefd) != 0) {
+      detail::throw_errno("Cannot create pipe for", "batch worker");
+    }
+    auto work = [&]() {
+      ::close(pipefd[0]);
+      return work_loop(schedule, slot, pipefd[1]);
+    };
+    pid_t pid;
+    try {
+      if (Py_IsInitialized()) {
+        pid = Zygote::fork(work);
+      } else {
+        std::fflush(nullptr);
+        pid = ::fork();
+        if (pid == 0) {
+          int status = 1;
+          try {
+            pybind11::initialize_interpreter();
+            status = work();
+          } catch (std::exception& e) {
+            std::fprintf(stderr, "%s\n", e.what());
+          } catch (...) {
+            std::fprintf(stderr, "Unknown exception in batch worker\n");
+          }
+          std::fflush(nullptr);
+          ::_exit(status);
+        }
+        if (pid < 0) {
+          detail::throw_errno("Cannot fork", "batch worker");
+        }
+      }
+    } catch (...) {
+      ::close(pipefd[0]);
+      ::close(pipefd[1]);
+      if (fail) {
+        throw;
+      }
+      return Worker();
+    }
+    ::close(pipefd[1]);
+    return { pid, pipefd[0] };
+  }
+
+  int work_loop(detail::BatchSchedule& schedule, size_t slot, int fd)
+  {
+    if (not options_.backend.empty()) {
+      pybind11::module_::import("matplotlib").attr("use")(options_.backend);
+    }
+    for (const auto& m : options_.modules) {
+      pybind11::module_::import(m.c_str());
+    }
+    auto close = pybind11::module_::import("matplotlib.pyplot").attr("close");
+
+    uint32_t job;
+    while (schedule.next(slot, job)) {
+      char status = 0;
+      std::string output;
+      try {
+        output = jobs_[job]();
+      } catch (std::exception& e) {
+        status = 1;
+        output = e.what();
+      } catch (...) {
+        status = 1;
+        output = "Unknown exception";
+      }
+      close("all");
+      if (not(detail::write_all(fd, &job, sizeof(job)) and
+              detail::write_all(fd, &status, 1) and
+              detail::send_frame(fd, output))) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  BatchOptions options_;
+  std::vector<Job> jobs_;
+};
+
+}
@@ -0,0 +1,565 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mplot++/mplot++.h>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief A streaming 128 bit non-cryptographic hash.
+
+   The input is consumed 32 bytes at a time by four independent 64 bit lanes
+   in the manner of xxHash, so the lanes run in parallel in the pipeline and
+   hashing large arrays runs at close to memory bandwidth.
+*/
+class Hasher
+{
+public:
+  Hasher()
+  {
+    lanes_[0] = seed_ + p1 + p2;
+    lanes_[1] = seed_ + p2;
+    lanes_[2] = seed_;
+    lanes_[3] = seed_ - p1;
+  }
+
+  void update(const void* data, size_t size)
+  {
+    auto p = static_cast<const unsigned char*>(data);
+    length_ += size;
+    if (buffered_ > 0) {
+      size_t n = std::min(size, sizeof(buffer_) - buffered_);
+      std::memcpy(buffer_ + buffered_, p, n);
+      buffered_ += n;
+      p += n;
+      size -= n;
+      if (buffered_ < sizeof(buffer_)) {
+        return;
+      }
+      block(buffer_);
+      buffered_ = 0;
+    }
+    for (; size >= sizeof(buffer_);
+         p += sizeof(buffer_), size -= sizeof(buffer_)) {
+      block(p);
+    }
+    std::memcpy(buffer_, p, size);
+    buffered_ = size;
+  }
+
+  /// The hash of everything consumed so far, as 32 hex digits
+  std::string hex() const
+  {
+    uint64_t h = rotl(lanes_[0], 1) + rotl(lanes_[1], 7) +
+                 rotl(lanes_[2], 12) + rotl(lanes_[3], 18);
+    for (auto lane : lanes_) {
+      h = (h ^ round(0, lane)) * p1 + p4;
+    }
+    h += length_;
+    for (size_t i = 0; i < buffered_; ++i) {
+      h = rotl(h ^ (buffer_[i] * p5), 11) * p1;
+    }
+    uint64_t hi = avalanche(h);
+    uint64_t lo = avalanche(h ^ lanes_[1] ^ rotl(lanes_[3], 32) ^ p3);
+
+    static const char digits[] = "0123456789abcdef";
+    std::string s(32, '0');
+    for (int i = 0; i < 16; ++i) {
+      s[15 - i] = digits[(hi >> (4 * i)) & 15];
+      s[31 - i] = digits[(lo >> (4 * i)) & 15];
+    }
+    return s;
+  }
+
+private:
+  static constexpr uint64_t p1 = 0x9E3779B185EBCA87ull;
+  static constexpr uint64_t p2 = 0xC2B2AE3D27D4EB4Full;
+  static constexpr uint64_t p3 = 0x165667B19E3779F9ull;
+  static constexpr uint64_t p4 = 0x85EBCA77C2B2AE63ull;
+  static constexpr uint64_t p5 = 0x27D4EB2F165667C5ull;
+  static constexpr uint64_t seed_ = 0x6D706C6F742B2B00ull;
+
+  static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+  static uint64_t round(uint64_t lane, uint64_t word)
+  {
+    return rotl(lane + word * p2, 31) * p1;
+  }
+
+  static uint64_t avalanche(uint64_t h)
+  {
+    h ^= h >> 33;
+    h *= p2;
+    h ^= h >> 29;
+    h *= p3;
+    h ^= h >> 32;
+    return h;
+  }
+
+  void block(const unsigned char* p)
+  {
+    uint64_t w[4];
+    std::memcpy(w, p, sizeof(w));
+    for (int k = 0; k < 4; ++k) {
+      lanes_[k] = round(lanes_[k], w[k]);
+    }
+  }
+
+  uint64_t lanes_[4];
+  unsigned char buffer_[32];
+  size_t buffered_ = 0;
+  uint64_t length_ = 0;
+};
+
+}
+
+/**
+   @brief The identity of a figure: its drawing commands and their data.
+
+   Record everything that determines the rendered image, typically as one
+   command() per matplotlib call.  Arrays are hashed in full, so two
+   fingerprints match only if the data is identical
+   ```
+   mplotpp::Fingerprint fp;
+   fp.command("plot", x, y, "r-").command("set_title", title).add(dpi);
+   ```
+   Arithmetic values, strings, `std::vector`, Eigen objects and plain python
+   values can be added.  Each is tagged with its kind and size so that
+   different sequences of values cannot produce the same byte stream.
+*/
+class Fingerprint
+{
+public:
+  /// Add raw bytes
+  Fingerprint& bytes(const void* data, size_t size)
+  {
+    hasher_.update(data, size);
+    return *this;
+  }
+
+  /// Add a string
+  Fingerprint& add(const std::string& s)
+  {
+    tag('s', s.size());
+    return bytes(s.data(), s.size());
+  }
+
+  /// Add a string
+  Fingerprint& add(const char* s) { return add(std::string(s)); }
+
+  /// Add a number or boolean
+  template<class T,
+           std::enable_if_t<std::is_arithmetic<T>::value, bool> = true>
+  Fingerprint& add(T value)
+  {
+    tag('n', sizeof(T));
+    return bytes(&value, sizeof(T));
+  }
+
+  /// Add a vector of numbers
+  template<class T>
+  Fingerprint& add(const std::vector<T>& v)
+  {
+    static_assert(std::is_arithmetic<T>::value, "Only numeric vectors");
+    tag('v', v.size());
+    return bytes(v.data(), v.size() * sizeof(T));
+  }
+
+  /// Add a plain Eigen array or matrix, hashing its storage directly
+  template<class Derived>
+  Fingerprint& add(const Eigen::PlainObjectBase<Derived>& a)
+  {
+    tag('e', size_t(a.rows()));
+    tag('e', size_t(a.cols()));
+    return bytes(a.data(), size_t(a.size()) * sizeof(typename Derived::Scalar));
+  }
+
+  /// Add an Eigen expression, which is evaluated first
+  template<class Derived>
+  Fingerprint& add(const Eigen::DenseBase<Derived>& a)
+  {
+    return add(a.derived().eval());
+  }
+
+  /**
+     @brief Add a plain python value by content
+
+     The value may be None, a bool, int, float, str or bytes, a numpy array
+     or scalar of numbers, or a tuple, list or dict with string keys of such
+     values.
+     Arrays are hashed in full, and dicts in the order of their sorted keys.
+
+     @throw std::invalid_argument for any other value, whose `repr` would
+     not identify it reliably
+  */
+  Fingerprint& add(pybind11::handle value)
+  {
+    auto builtins = pybind11::module_::import("builtins");
+    auto numpy = pybind11::module_::import("numpy");
+    auto numeric = [&](pybind11::handle a) {
+      if (not pybind11::isinstance(a, numpy.attr("ndarray")) and
+          not pybind11::isinstance(a, numpy.attr("generic"))) {
+        return false;
+      }
+      auto kind = a.attr("dtype").attr("kind").cast<std::string>();
+      return kind.find_first_of("biufc") != std::string::npos;
+    };
+    if (value.is_none()) {
+      tag('z', 0);
+    } else if (pybind11::isinstance<pybind11::bool_>(value)) {
+      add(value.cast<bool>());
+    } else if (pybind11::isinstance<pybind11::int_>(value)) {
+      // Decimal, as python integers are unbounded
+      tag('i', 0);
+      add(std::string(pybind11::str(value)));
+    } else if (pybind11::isinstance<pybind11::float_>(value)) {
+      add(value.cast<double>());
+    } else if (pybind11::isinstance<pybind11::str>(value)) {
+      add(value.cast<std::string>());
+    } else if (pybind11::isinstance<pybind11::bytes>(value)) {
+      auto b = value.cast<std::string>();
+      tag('y', b.size());
+      bytes(b.data(), b.size());
+    } else if (pybind11::isinstance<pybind11::tuple>(value) or
+               pybind11::isinstance<pybind11::list>(value)) {
+      tag('l', pybind11::len(value));
+      for (auto item : value) {
+        add(item);
+      }
+    } else if (pybind11::isinstance<pybind11::dict>(value)) {
+      auto d = pybind11::reinterpret_borrow<pybind11::dict>(value);
+      tag('d', d.size());
+      for (auto key : builtins.attr("sorted")(d)) {
+        if (not pybind11::isinstance<pybind11::str>(key)) {
+          throw(std::invalid_argument("Cannot fingerprint a dict whose keys "
+                                      "are not strings"));
+        }
+        pybind11::object item = d[key];
+        add(key.cast<std::string>());
+        add(item);
+      }
+    } else if (numeric(value)) {
+      auto a = pybind11::reinterpret_borrow<pybind11::array>(
+        numpy.attr("ascontiguousarray")(value));
+      tag('a', size_t(a.ndim()));
+      add(a.dtype().attr("str").cast<std::string>());
+      for (pybind11::ssize_t k = 0; k < a.ndim(); ++k) {
+        tag('a', size_t(a.shape(k)));
+      }
+      bytes(a.data(), size_t(a.nbytes()));
+    } else {
+      throw(std::invalid_argument(
+        "Cannot fingerprint a value of type " +
+        std::string(pybind11::str(builtins.attr("type")(value)))));
+    }
+    return *this;
+  }
+
+  /**
+     @brief Add a command and its arguments
+
+     @param name The name of the command
+     @param args Anything accepted by add()
+  */
+  template<class... Args>
+  Fingerprint& command(const std::string& name, const Args&... args)
+  {
+    tag('c', sizeof...(args));
+    add(name);
+    (add(args), ...);
+    return *this;
+  }
+
+  /// The fingerprint, as 32 hex digits
+  std::string hex() const { return hasher_.hex(); }
+
+private:
+  void tag(char kind, uint64_t size)
+  {
+    hasher_.update(&kind, 1);
+    hasher_.update(&size, sizeof(size));
+  }
+
+  detail::Hasher hasher_;
+};
+
+/**
+   @brief An on-disk, content-addressed store of rendered figures.
+
+   Dashboards are often regenerated from unchanged data.  A RenderCache
+   stores each rendered image in a directory under the name of its
+   Fingerprint, and render() only draws the figure when no image with that
+   fingerprint exists
+   ```
+   mplotpp::RenderCache cache("/var/cache/plots", 512 << 20);
+   mplotpp::Fingerprint fp;
+   fp.command("plot", x, y);
+   cache.render_file(fp, "out.png", [&]() {
+     auto [fig, ax] = mplotpp::tuple<2>(plt.attr("subplots")());
+     ax.attr("plot")(x, y);
+     return fig;
+   });
+   ```
+   When the total size of the store exceeds its bound, the least recently
+   used entries are removed.  Entries are written to a temporary file and
+   renamed into place, so several processes, or threads each with their own
+   RenderCache, may share a store.  Temporary files left behind by a writer
+   that died are removed by evict() once they are `stale_temporary` old.
+*/
+class RenderCache
+{
+public:
+  /**
+     @brief Open or create a store
+
+     @param directory The directory holding the entries
+     @param max_bytes The size bound of the store
+  */
+  explicit RenderCache(std::filesystem::path directory,
+                       uintmax_t max_bytes = uintmax_t(1) << 30)
+    : directory_(std::move(directory))
+    , max_bytes_(max_bytes)
+  {
+    std::filesystem::create_directories(directory_);
+    for (const auto& e : std::filesystem::directory_iterator(directory_)) {
+      if (e.is_regular_file() and not temporary(e.path())) {
+        bytes_ += e.file_size();
+      }
+    }
+  }
+
+  /**
+     @brief Look up an entry, marking it as recently used
+
+     @param key The fingerprint
+     @param format The image format, such as "png" or "svg"
+     @return The image, or nothing if it is not stored
+  */
+  std::optional<std::string> get(const std::string& key,
+                                 const std::string& format)
+  {
+    auto path = entry(key, format);
+    std::ifstream in(path, std::ios::binary);
+    if (not in) {
+      ++misses_;
+      return std::nullopt;
+    }
+    std::ostringstream bytes;
+    bytes << in.rdbuf();
+    std::error_code ec;
+    std::filesystem::last_write_time(
+      path, std::filesystem::file_time_type::clock::now(), ec);
+    ++hits_;
+    return bytes.str();
+  }
+
+  /**
+     @brief Store an entry, evicting old entries if the store is too large
+
+     @param key The fingerprint
+     @param format The image format
+     @param bytes The image
+  */
+  void put(const std::string& key,
+           const std::string& format,
+           const std::string& bytes)
+  {
+    auto path = entry(key, format);
+    // Unique to this process and call, so that concurrent writers of the
+    // same entry never share a temporary file
+    static std::atomic<unsigned long> serial{ 0 };
+    auto tmp = path;
+    tmp += ".tmp" + std::to_string(::getpid()) + "." +
+           std::to_string(serial.fetch_add(1, std::memory_order_relaxed));
+    std::error_code ec;
+    try {
+      {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), std::streamsize(bytes.size()));
+        if (not out) {
+          throw(std::runtime_error("Cannot write " + tmp.string()));
+        }
+      }
+      // An entry being replaced no longer counts towards the size
+      auto old = std::filesystem::file_size(path, ec);
+      if (not ec) {
+        bytes_ -= std::min(bytes_, old);
+      }
+      std::filesystem::rename(tmp, path);
+    } catch (...) {
+      std::filesystem::remove(tmp, ec);
+      throw;
+    }
+    bytes_ += bytes.size();
+    if (bytes_ > max_bytes_) {
+      evict();
+    }
+  }
+
+  /**
+     @brief Return the image of a figure, drawing it only on a cache miss
+
+     @param fp The fingerprint of the figure
+     @param format The image format passed to `savefig`
+     @param draw A function drawing the figure and returning it.  It is
+     closed after saving, or when saving fails.
+     @param kwargs Extra keyword arguments for `savefig`, which are made part
+     of the key, so they must be values accepted by Fingerprint::add()
+     @return The image
+     @throw std::invalid_argument if a value of `kwargs` cannot be
+     fingerprinted
+  */
+  template<class F>
+  std::string render(const Fingerprint& fp,
+                     const std::string& format,
+                     F&& draw,
+                     const pybind11::dict& kwargs = pybind11::dict())
+  {
+    Fingerprint full = fp;
+    full.command("savefig", format, kwargs);
+    auto key = full.hex();
+    if (auto hit = get(key, format)) {
+      return *hit;
+    }
+    auto close = pybind11::module_::import("matplotlib.pyplot").attr("close");
+    pybind11::object fig = draw();
+    std::string bytes;
+    try {
+      auto buffer = pybind11::module_::import("io").attr("BytesIO")();
+      fig.attr("savefig")(buffer, pybind11::arg("format") = format, **kwargs);
+      bytes = buffer.attr("getvalue")().cast<std::string>();
+    } catch (...) {
+      // Close the figure even if saving fails, so that pyplot does not keep
+      // it alive
+      close(fig);
+      throw;
+    }
+    close(fig);
+    put(key, format, bytes);
+    return bytes;
+  }
+
+  /**
+     @brief Write the image of a figure to a file, drawing it only on a
+     cache miss.  The format is given by the extension of the file.
+
+     @param fp The fingerprint of the figure
+     @param path The image file to write
+     @param draw A function drawing the figure and returning it
+     @param kwargs Extra keyword arguments for `savefig`
+  */
+  template<class F>
+  void render_file(const Fingerprint& fp,
+                   const std::filesystem::path& path,
+                   F&& draw,
+                   const pybind11::dict& kwargs = pybind11::dict())
+  {
+    auto format = path.extension().string();
+    if (format.empty()) {
+      throw(std::invalid_argument("No image format for " + path.string()));
+    }
+    auto bytes = render(fp, format.substr(1), std::forward<F>(draw), kwargs);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), std::streamsize(bytes.size()));
+    if (not out) {
+      throw(std::runtime_error("Cannot write " + path.string()));
+    }
+  }
+
+  /// Temporary files older than this were left by writers that died
+  static constexpr std::chrono::minutes stale_temporary{ 10 };
+
+  /**
+     @brief Remove the least recently used entries until the store fits its
+     bound, and any stale temporary files
+  */
+  void evict()
+  {
+    struct Entry
+    {
+      std::filesystem::path path;
+      std::filesystem::file_time_type time;
+      uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+    std::error_code ec;
+    auto stale =
+      std::filesystem::file_time_type::clock::now() - stale_temporary;
+    for (const auto& e : std::filesystem::directory_iterator(directory_, ec)) {
+      if (not e.is_regular_file(ec)) {
+        continue;
+      }
+      // Files being written by put() are not entries, and are only removed
+      // once stale
+      if (temporary(e.path())) {
+        auto time = e.last_write_time(ec);
+        if (not ec and time < stale) {
+          std::filesystem::remove(e.path(), ec);
+        }
+      } else {
+        entries.push_back({ e.path(), e.last_write_time(ec), e.file_size(ec) });
+        total += entries.back().size;
+      }
+    }
+    std::sort(entries.begin(),
+              entries.end(),
+              [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    for (const auto& e : entries) {
+      if (total <= max_bytes_) {
+        break;
+      }
+      if (std::filesystem::remove(e.path, ec)) {
+        total -= e.size;
+      }
+    }
+    bytes_ = total;
+  }
+
+  /// The approximate size of the store in bytes
+  uintmax_t size() const { return bytes_; }
+
+  /// The number of lookups that found an entry
+  size_t hits() const { return hits_; }
+
+  /// The number of lookups that did not
+  size_t misses() const { return misses_; }
+
+private:
+  std::filesystem::path entry(const std::string& key,
+                              const std::string& format) const
+  {
+    return directory_ / (key + "." + format);
+  }
+
+  static bool temporary(const std::filesystem::path& path)
+  {
+    return path.filename().string().find(".tmp") != std::string::npos;
+  }
+
+  std::filesystem::path directory_;
+  uintmax_t max_bytes_;
+  uintmax_t bytes_ = 0;
+  size_t hits_ = 0;
+  size_t misses_ = 0;
+};
+
+}
@@ -0,0 +1,205 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <mplot++/mplot++.h>
+#include <type_traits>
+#include <utility>
+
+namespace mplotpp {
+
+/**
+   @brief A keyword name, interned once.
+
+   Python compares interned strings by address, so using a Keyword avoids
+   creating and hashing a new string on every call.  Like `pybind11::arg`,
+   assigning a value gives a keyword argument for a CallSite.  A Keyword may
+   be static: it does not touch python when destroyed after the interpreter
+   has been finalised
+   ```
+   static mplotpp::Keyword color("color");
+   text(x, y, label, color = "red");
+   ```
+*/
+class Keyword
+{
+public:
+  /// An argument given by a Keyword
+  struct Value
+  {
+    pybind11::handle key;
+    pybind11::object value;
+  };
+
+  /**
+     @brief Intern a keyword name
+
+     @param name The name
+  */
+  explicit Keyword(const char* name)
+    : name_(pybind11::reinterpret_steal<pybind11::str>(
+        PyUnicode_InternFromString(name)))
+  {
+    if (not name_) {
+      throw(pybind11::error_already_set());
+    }
+  }
+
+  Keyword(const Keyword&) = default;
+
+  ~Keyword()
+  {
+    if (not Py_IsInitialized()) {
+      name_.release();
+    }
+  }
+
+  /// A keyword argument with this name
+  template<class T>
+  Value operator=(T&& value) const
+  {
+    return { name_, pybind11::cast(std::forward<T>(value)) };
+  }
+
+  /// The interned name
+  const pybind11::str& str() const { return name_; }
+
+private:
+  pybind11::str name_;
+};
+
+/**
+   @brief A bound method resolved once, with pre-built keyword arguments.
+
+   A call such as
+   ```
+   ax.attr("text")(x, y, label, "transform"_a = ax.attr("transAxes"),
+                   "fontsize"_a = 8);
+   ```
+   looks up `text` and `transAxes` and builds a fresh kwargs dict, including
+   new keyword strings, every time it is made.  When it is made thousands of
+   times that overhead dominates.  A CallSite does the lookups and builds the
+   keyword arguments once, so that each call only converts its positional
+   arguments
+   ```
+   using namespace pybind11::literals;
+   mplotpp::CallSite text(ax, "text",
+                          py::dict("transform"_a = ax.attr("transAxes"),
+                                   "fontsize"_a = 8));
+   static mplotpp::Keyword color("color");
+   for (...) {
+     text(x[i], y[i], labels[i], color = colors[i]);
+   }
+   ```
+   Keyword values given in a call are added to a copy of the template, so they
+   apply to that call only.  Calls without them pass the template itself.
+*/
+class CallSite
+{
+public:
+  CallSite() = default;
+
+  /**
+     @brief Resolve a method
+
+     @param obj The object whose method is called
+     @param name The name of the method
+     @param kwargs Keyword arguments passed on every call
+  */
+  CallSite(pybind11::handle obj,
+           const char* name,
+           const pybind11::dict& kwargs = pybind11::dict())
+    : method_(obj.attr(name))
+    , kwargs_(intern(kwargs))
+  {}
+
+  /**
+     @brief Wrap a callable, such as a function or an already bound method
+
+     @param callable The callable
+     @param kwargs Keyword arguments passed on every call
+  */
+  explicit CallSite(pybind11::object callable,
+                    const pybind11::dict& kwargs = pybind11::dict())
+    : method_(std::move(callable))
+    , kwargs_(intern(kwargs))
+  {}
+
+  /**
+     @brief Call the method
+
+     @param args Positional arguments, which may be followed by Keyword
+     arguments
+     @return The result of the call
+     @throw pybind11::error_already_set on a python exception
+  */
+  template<class... Args>
+  pybind11::object operator()(Args&&... args) const
+  {
+    constexpr size_t nkw =
+      (size_t(std::is_same<std::decay_t<Args>, Keyword::Value>::value) + ... +
+       0);
+    constexpr size_t npos = sizeof...(Args) - nkw;
+
+    pybind11::tuple positional(npos);
+    pybind11::dict kwargs = kwargs_;
+    if (nkw > 0) {
+      kwargs = pybind11::reinterpret_steal<pybind11::dict>(
+        PyDict_Copy(kwargs_.ptr()));
+    }
+    [[maybe_unused]] size_t i = 0;
+    (place(positional, kwargs, i, std::forward<Args>(args)), ...);
+
+    PyObject* result =
+      PyObject_Call(method_.ptr(), positional.ptr(), kwargs.ptr());
+    if (not result) {
+      throw(pybind11::error_already_set());
+    }
+    return pybind11::reinterpret_steal<pybind11::object>(result);
+  }
+
+  /// The resolved callable
+  const pybind11::object& method() const { return method_; }
+
+  /// The keyword template, which may be modified between calls
+  pybind11::dict& kwargs() { return kwargs_; }
+
+private:
+  /// A copy of the keyword arguments with interned keys
+  static pybind11::dict intern(const pybind11::dict& kwargs)
+  {
+    pybind11::dict interned;
+    for (auto item : kwargs) {
+      auto key = item.first.cast<std::string>();
+      interned[pybind11::reinterpret_steal<pybind11::str>(
+        PyUnicode_InternFromString(key.c_str()))] = item.second;
+    }
+    return interned;
+  }
+
+  static void place(pybind11::tuple&,
+                    pybind11::dict& kwargs,
+                    size_t&,
+                    const Keyword::Value& kw)
+  {
+    kwargs[kw.key] = kw.value;
+  }
+
+  template<class T,
+           std::enable_if_t<
+             not std::is_same<std::decay_t<T>, Keyword::Value>::value,
+             bool> = true>
+  static void place(pybind11::tuple& positional,
+                    pybind11::dict&,
+                    size_t& i,
+                    T&& arg)
+  {
+    positional[i++] = pybind11::cast(std::forward<T>(arg));
+  }
+
+  pybind11::object method_;
+  pybind11::dict kwargs_;
+};
+
+}
@@ -0,0 +1,249 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <memory>
+#include <mplot++/mplot++.h>
+#include <stdexcept>
+#include <vector>
+
+namespace mplotpp {
+
+/**
+   @brief Build many polylines or polygons in one contiguous buffer and pass
+   them to matplotlib as a single collection.
+
+   Plotting thousands of series with repeated calls such as
+   `ax.attr("plot")(x_i, y_i)` pays for a python call, an attribute lookup,
+   an array conversion and a new `Line2D` per series.  A SegmentBuilder
+   instead packs the vertices of every segment into one interleaved `(x, y)`
+   buffer with an offset table, and creates one `LineCollection`,
+   `PolyCollection` or scatter `PathCollection` whose data are numpy views of
+   that buffer
+   ```
+   mplotpp::SegmentBuilder<double> paths;
+   for (auto& trajectory : trajectories) {
+     paths.add(trajectory.t, trajectory.position);
+   }
+   ax.attr("add_collection")(paths.line_collection(py::dict("lw"_a = 0.5)));
+   ax.attr("autoscale_view")();
+   ```
+   The buffer is shared with python, which keeps it alive as long as needed.
+   Adding to a builder whose buffer has already been shared first gives the
+   builder a private copy, so existing collections are never modified.
+
+   This is in the spirit of mplotpp::list, which similarly gathers many `c++`
+   objects into one python object.
+
+   @tparam T The coordinate type
+*/
+template<class T = double>
+class SegmentBuilder
+{
+  static_assert(std::is_arithmetic<T>::value,
+                "SegmentBuilder coordinates must be of arithmetic type");
+
+public:
+  SegmentBuilder()
+    : storage_(std::make_shared<Storage>())
+  {}
+
+  /**
+     @brief Reserve space to avoid reallocation
+
+     @param segments The expected number of segments
+     @param points The expected total number of points
+  */
+  void reserve(size_t segments, size_t points)
+  {
+    detach();
+    storage_->offsets.reserve(segments + 1);
+    storage_->xy.reserve(2 * points);
+  }
+
+  /**
+     @brief Add a segment
+
+     @param x The x-coordinates of the segment
+     @param y The y-coordinates of the segment, of the same length as x
+     @throw std::invalid_argument if the lengths differ
+  */
+  template<class Dx, class Dy>
+  void add(const Eigen::DenseBase<Dx>& x, const Eigen::DenseBase<Dy>& y)
+  {
+    if (x.size() != y.size()) {
+      throw(std::invalid_argument("x and y lengths differ in add()"));
+    }
+    begin_segment();
+    auto& xy = storage_->xy;
+    size_t start = xy.size();
+    xy.resize(start + 2 * size_t(x.size()));
+    for (Eigen::Index i = 0; i < x.size(); ++i) {
+      xy[start + 2 * i] = T(x.derived().coeff(i));
+      xy[start + 2 * i + 1] = T(y.derived().coeff(i));
+    }
+    storage_->offsets.back() = xy.size() / 2;
+  }
+
+  /// Start a new, empty segment, to which push() appends
+  void begin_segment()
+  {
+    detach();
+    storage_->offsets.push_back(storage_->xy.size() / 2);
+  }
+
+  /**
+     @brief Append a point to the segment started by the last begin_segment()
+     or add()
+
+     @throw std::logic_error if no segment has been started
+  */
+  void push(T x, T y)
+  {
+    detach();
+    if (storage_->offsets.size() < 2) {
+      throw(std::logic_error("push() called before begin_segment()"));
+    }
+    storage_->xy.push_back(x);
+    storage_->xy.push_back(y);
+    storage_->offsets.back() = storage_->xy.size() / 2;
+  }
+
+  /// Remove all segments
+  void clear()
+  {
+    storage_ = std::make_shared<Storage>();
+  }
+
+  /// The number of segments
+  size_t segments() const { return storage_->offsets.size() - 1; }
+
+  /// The total number of points
+  size_t points() const { return storage_->xy.size() / 2; }
+
+  /**
+     @brief All points as a read-only numpy array of shape `(points(), 2)`
+  */
+  pybind11::array_t<T> vertices() const
+  {
+    return column_view({ ssize_t(points()), 2 }, { 2 * item, item }, 0);
+  }
+
+  /**
+     @brief The start of every segment in vertices(), followed by the total
+     number of points, as a read-only numpy array of length `segments() + 1`
+  */
+  pybind11::array_t<ssize_t> offsets() const
+  {
+    auto offsets = std::shared_ptr<const std::vector<ssize_t>>(
+      storage_, &storage_->offsets);
+    return view(offsets);
+  }
+
+  /**
+     @brief A python list of every segment as a read-only `(n, 2)` numpy view
+     into vertices()
+
+     The views are created directly from `c++` without any python-level
+     slicing.
+  */
+  pybind11::list segment_views() const
+  {
+    pybind11::array_t<T> all = vertices();
+    const T* base = storage_->xy.data();
+    const auto& offsets = storage_->offsets;
+    pybind11::list result(segments());
+    for (size_t k = 0; k + 1 < offsets.size(); ++k) {
+      ssize_t n = offsets[k + 1] - offsets[k];
+      pybind11::array_t<T> segment(
+        { n, ssize_t(2) }, { 2 * item, item }, base + 2 * offsets[k], all);
+      result[k] = segment;
+    }
+    return result;
+  }
+
+  /**
+     @brief Create a `matplotlib.collections.LineCollection` of every segment
+
+     @param kwargs Keyword arguments for the `LineCollection` constructor
+     @return The collection, ready for `ax.add_collection()`
+  */
+  pybind11::object line_collection(
+    pybind11::dict kwargs = pybind11::dict()) const
+  {
+    auto collections = pybind11::module_::import("matplotlib.collections");
+    return collections.attr("LineCollection")(segment_views(), **kwargs);
+  }
+
+  /**
+     @brief Create a `matplotlib.collections.PolyCollection` treating every
+     segment as a closed polygon
+
+     @param kwargs Keyword arguments for the `PolyCollection` constructor
+     @return The collection, ready for `ax.add_collection()`
+  */
+  pybind11::object poly_collection(
+    pybind11::dict kwargs = pybind11::dict()) const
+  {
+    auto collections = pybind11::module_::import("matplotlib.collections");
+    return collections.attr("PolyCollection")(segment_views(), **kwargs);
+  }
+
+  /**
+     @brief Draw every point as a marker with a single `ax.scatter()` call,
+     which creates one `PathCollection`
+
+     @param ax The axes to draw on
+     @param kwargs Keyword arguments for `ax.scatter()`
+     @return The `PathCollection`
+  */
+  pybind11::object scatter(pybind11::object ax,
+                           pybind11::dict kwargs = pybind11::dict()) const
+  {
+    ssize_t n = ssize_t(points());
+    return ax.attr("scatter")(column_view({ n }, { 2 * item }, 0),
+                              column_view({ n }, { 2 * item }, 1),
+                              **kwargs);
+  }
+
+private:
+  struct Storage
+  {
+    std::vector<T> xy;
+    std::vector<ssize_t> offsets = { 0 };
+  };
+
+  static constexpr ssize_t item = sizeof(T);
+
+  // Give the builder its own storage if python shares the current one
+  void detach()
+  {
+    if (storage_.use_count() > 1) {
+      storage_ = std::make_shared<Storage>(*storage_);
+    }
+  }
+
+  // A read-only view of the interleaved buffer that keeps it alive
+  pybind11::array_t<T> column_view(std::vector<ssize_t> shape,
+                                   std::vector<ssize_t> strides,
+                                   size_t first) const
+  {
+    if (storage_->xy.empty()) {
+      return pybind11::array_t<T>(shape);
+    }
+    using Owner = std::shared_ptr<Storage>;
+    std::unique_ptr<Owner> owner(new Owner(storage_));
+    pybind11::capsule base(owner.get(),
+                           [](void* p) { delete static_cast<Owner*>(p); });
+    owner.release();
+    pybind11::array_t<T> result(
+      shape, strides, storage_->xy.data() + first, base);
+    result.attr("setflags")(pybind11::arg("write") = false);
+    return result;
+  }
+
+  std::shared_ptr<Storage> storage_;
+};
+
+}
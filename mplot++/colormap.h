@@ -0,0 +1,441 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <stdexcept>
+#include <vector>
+
+namespace mplotpp {
+
+/// The scale mapping data values onto a colormap
+enum class Scale
+{
+  /// As `matplotlib.colors.Normalize`
+  Linear,
+  /// As `matplotlib.colors.LogNorm`.  Values that are not positive are bad.
+  Log,
+  /// As `matplotlib.colors.SymLogNorm`
+  SymLog
+};
+
+/**
+   @brief Normalization of data values to the interval [0, 1], following
+   matplotlib's norms
+
+   A NaN `vmin` or `vmax` is taken from the finite data by autoscale(), as
+   matplotlib does when they are `None`.
+*/
+struct Normalize
+{
+  Scale scale = Scale::Linear;
+  double vmin = std::numeric_limits<double>::quiet_NaN();
+  double vmax = std::numeric_limits<double>::quiet_NaN();
+  /// The range `(-linthresh, linthresh)` that is linear for SymLog
+  double linthresh = 1;
+  /// The length of the linear range, in decades, for SymLog
+  double linscale = 1;
+  /// The base of the logarithm for SymLog
+  double base = 10;
+
+  /// A linear norm
+  static Normalize linear(
+    double vmin = std::numeric_limits<double>::quiet_NaN(),
+    double vmax = std::numeric_limits<double>::quiet_NaN())
+  {
+    return Normalize{ Scale::Linear, vmin, vmax };
+  }
+
+  /// A logarithmic norm
+  static Normalize log(double vmin = std::numeric_limits<double>::quiet_NaN(),
+                       double vmax = std::numeric_limits<double>::quiet_NaN())
+  {
+    return Normalize{ Scale::Log, vmin, vmax };
+  }
+
+  /// A symmetric logarithmic norm, linear around zero
+  static Normalize symlog(
+    double linthresh,
+    double vmin = std::numeric_limits<double>::quiet_NaN(),
+    double vmax = std::numeric_limits<double>::quiet_NaN(),
+    double linscale = 1,
+    double base = 10)
+  {
+    return Normalize{ Scale::SymLog, vmin, vmax, linthresh, linscale, base };
+  }
+
+  /// Whether vmin and vmax are both set
+  bool scaled() const { return not std::isnan(vmin) and not std::isnan(vmax); }
+
+  /**
+     @brief The equivalent matplotlib norm, for instance for a colorbar
+
+     @throw std::logic_error if the limits are not set
+  */
+  pybind11::object matplotlib() const
+  {
+    if (not scaled()) {
+      throw(std::logic_error("Normalize limits are not set"));
+    }
+    auto colors = pybind11::module_::import("matplotlib.colors");
+    switch (scale) {
+      case Scale::Log:
+        return colors.attr("LogNorm")(vmin, vmax);
+      case Scale::SymLog:
+        return colors.attr("SymLogNorm")(linthresh,
+                                         pybind11::arg("linscale") = linscale,
+                                         pybind11::arg("vmin") = vmin,
+                                         pybind11::arg("vmax") = vmax,
+                                         pybind11::arg("base") = base);
+      default:
+        return colors.attr("Normalize")(vmin, vmax);
+    }
+  }
+};
+
+namespace detail {
+
+/**
+   @private
+   @brief Rows of a column-major array, or columns of a row-major array,
+   mapped together from one column or row
+*/
+constexpr Eigen::Index colormap_span = 256;
+
+/**
+   @private
+   @brief Minimum number of spans given to each thread
+*/
+constexpr Eigen::Index colormap_grain = 64;
+
+/**
+   @private
+   @brief The forward transform of a norm, evaluated on packets by Eigen
+*/
+class NormTransform
+{
+public:
+  explicit NormTransform(const Normalize& norm)
+    : norm_(norm)
+  {
+    if (norm.scale == Scale::Log and norm.scaled() and
+        not(norm.vmin > 0 and norm.vmax > 0)) {
+      throw(std::invalid_argument("Log norm limits must be positive"));
+    }
+    if (norm.scale == Scale::SymLog) {
+      linscale_adj_ = norm.linscale / (1 - 1 / norm.base);
+      log_base_ = std::log(norm.base);
+    }
+    double a = scalar(norm.vmin);
+    double b = scalar(norm.vmax);
+    offset_ = a;
+    factor_ = b > a ? 1 / (b - a) : 0;
+  }
+
+  /// Normalize `v` in place
+  void apply(Eigen::Ref<Eigen::ArrayXd> v) const
+  {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    switch (norm_.scale) {
+      case Scale::Linear:
+        v = (v - offset_) * factor_;
+        break;
+      case Scale::Log:
+        v = (v > 0).select((v.log() - offset_) * factor_, nan);
+        break;
+      case Scale::SymLog: {
+        const double c = norm_.linthresh;
+        v = (v.abs() <= c)
+              .select(v * linscale_adj_,
+                      v.sign() * c *
+                        (linscale_adj_ + (v.abs() / c).log() / log_base_));
+        v = (v - offset_) * factor_;
+        break;
+      }
+    }
+  }
+
+private:
+  double scalar(double x) const
+  {
+    switch (norm_.scale) {
+      case Scale::Log:
+        return std::log(x);
+      case Scale::SymLog: {
+        const double c = norm_.linthresh;
+        if (std::abs(x) <= c) {
+          return x * linscale_adj_;
+        }
+        return std::copysign(
+          c * (linscale_adj_ + std::log(std::abs(x) / c) / log_base_), x);
+      }
+      default:
+        return x;
+    }
+  }
+
+  Normalize norm_;
+  double linscale_adj_ = 1;
+  double log_base_ = 1;
+  double offset_ = 0;
+  double factor_ = 1;
+};
+
+}
+
+/**
+   @brief Fill in the unset limits of a norm from the data
+
+   The limits are the smallest and largest finite values, or for Scale::Log
+   the smallest and largest positive values, found with num_threads() threads.
+
+   @param norm The norm, of which NaN limits are replaced
+   @param z The data
+   @return The norm with its limits set.  If there is no usable data they
+   remain NaN.
+*/
+template<class Derived>
+Normalize
+autoscale(Normalize norm, const Eigen::DenseBase<Derived>& z)
+{
+  if (norm.scaled()) {
+    return norm;
+  }
+  const auto& a = z.derived();
+  const Eigen::Index n = a.outerSize();
+  const double inf = std::numeric_limits<double>::infinity();
+  Eigen::Index parts = std::max<Eigen::Index>(
+    1, std::min<Eigen::Index>(num_threads(), n / 16));
+  std::vector<std::pair<double, double>> ranges(size_t(parts), { inf, -inf });
+  const bool positive = norm.scale == Scale::Log;
+  parallel_for(
+    Eigen::Index(0),
+    parts,
+    Eigen::Index(1),
+    [&](Eigen::Index first, Eigen::Index last) {
+      for (Eigen::Index p = first; p < last; ++p) {
+        auto& [lo, hi] = ranges[size_t(p)];
+        for (Eigen::Index k = n * p / parts; k < n * (p + 1) / parts; ++k) {
+          for (Eigen::Index i = 0; i < a.innerSize(); ++i) {
+            double v = Derived::IsRowMajor ? double(a.coeff(k, i))
+                                           : double(a.coeff(i, k));
+            if (std::isfinite(v) and (v > 0 or not positive)) {
+              lo = std::min(lo, v);
+              hi = std::max(hi, v);
+            }
+          }
+        }
+      }
+    });
+  double lo = inf;
+  double hi = -inf;
+  for (const auto& r : ranges) {
+    lo = std::min(lo, r.first);
+    hi = std::max(hi, r.second);
+  }
+  if (lo <= hi) {
+    if (std::isnan(norm.vmin)) {
+      norm.vmin = lo;
+    }
+    if (std::isnan(norm.vmax)) {
+      norm.vmax = hi;
+    }
+  }
+  return norm;
+}
+
+/**
+   @brief A matplotlib colormap as a lookup table for mapping large arrays to
+   RGBA images in `c++`.
+
+   Passing a large scalar field to `imshow` makes numpy normalize and map it
+   on one core, with several `float64` temporaries the size of the image.
+   Instead the field can be mapped here, in parallel and a span at a time, to
+   the `uint8` RGBA image that matplotlib would produce, which `imshow` draws
+   without further colour mapping
+   ```
+   mplotpp::Colormap cmap("magma");
+   auto norm = mplotpp::autoscale(mplotpp::Normalize::log(), Z);
+   mplotpp::imshow_rgba(ax, Z, cmap, norm);
+   fig.attr("colorbar")(cmap.scalar_mappable(norm), "ax"_a = ax);
+   ```
+   Values below `vmin`, above `vmax` or NaN take the colormap's under, over
+   and bad colours.  The table is copied from matplotlib when constructed, so
+   mapping needs no GIL and may run on any thread.
+*/
+class Colormap
+{
+public:
+  /**
+     @brief Copy the table of a matplotlib colormap
+
+     @param cmap A `Colormap`, the name of a registered colormap, or `None`
+     for the default `image.cmap`
+  */
+  explicit Colormap(pybind11::object cmap = pybind11::none())
+    : cmap_(pybind11::module_::import("matplotlib.pyplot").attr("get_cmap")(
+        cmap))
+  {
+    const auto n = cmap_.attr("N").cast<Eigen::Index>();
+    using Table = pybind11::array_t<std::uint8_t, pybind11::array::c_style |
+                                                    pybind11::array::forcecast>;
+    Eigen::ArrayXi indices = Eigen::ArrayXi::LinSpaced(n, 0, int(n - 1));
+    auto lut = cmap_(adopt(std::move(indices)), pybind11::arg("bytes") = true)
+                 .cast<Table>();
+    // Under, over and bad colours
+    Eigen::ArrayXd outside(3);
+    outside << -1.0, 2.0, std::numeric_limits<double>::quiet_NaN();
+    auto special =
+      cmap_(adopt(std::move(outside)), pybind11::arg("bytes") = true)
+        .cast<Table>();
+    table_.resize(size_t(n) + 3);
+    std::memcpy(table_.data(), lut.data(), size_t(n) * 4);
+    std::memcpy(table_.data() + n, special.data(), 3 * 4);
+  }
+
+  /// Copy the table of the named colormap
+  explicit Colormap(const char* name)
+    : Colormap(pybind11::str(name))
+  {}
+
+  /// The number of colours in the table
+  Eigen::Index size() const { return Eigen::Index(table_.size()) - 3; }
+
+  /// The matplotlib colormap
+  pybind11::object cmap() const { return cmap_; }
+
+  /**
+     @brief A `ScalarMappable` with this colormap and norm, for `colorbar`
+
+     @throw std::logic_error if the limits of the norm are not set
+  */
+  pybind11::object scalar_mappable(const Normalize& norm) const
+  {
+    return pybind11::module_::import("matplotlib.cm")
+      .attr("ScalarMappable")(pybind11::arg("norm") = norm.matplotlib(),
+                              pybind11::arg("cmap") = cmap_);
+  }
+
+  /**
+     @brief Map an array to RGBA with num_threads() threads.  The GIL is not
+     needed.
+
+     @param norm The normalization.  Unset limits are autoscaled.
+     @param z The data, of any arithmetic type and either storage order
+     @param rgba The output, 4 bytes per element in row-major order, as a
+     C-contiguous numpy array of shape `(rows, cols, 4)`
+     @throw std::invalid_argument if a log norm has limits that are not
+     positive
+  */
+  template<class Derived>
+  void map(Normalize norm,
+           const Eigen::DenseBase<Derived>& z,
+           std::uint8_t* rgba) const
+  {
+    norm = autoscale(norm, z);
+    const detail::NormTransform transform(norm);
+    const auto& a = z.derived();
+    const Eigen::Index outer = a.outerSize();
+    const Eigen::Index inner = a.innerSize();
+    const Eigen::Index spans =
+      (inner + detail::colormap_span - 1) / detail::colormap_span;
+    // Output strides along and across the spans
+    const Eigen::Index along = Derived::IsRowMajor ? 4 : 4 * a.cols();
+    const Eigen::Index across = Derived::IsRowMajor ? 4 * a.cols() : 4;
+    parallel_for(
+      Eigen::Index(0),
+      outer * spans,
+      detail::colormap_grain,
+      [&](Eigen::Index first, Eigen::Index last) {
+        Eigen::ArrayXd t(detail::colormap_span);
+        for (Eigen::Index s = first; s < last; ++s) {
+          const Eigen::Index k = s / spans;
+          const Eigen::Index i0 = (s % spans) * detail::colormap_span;
+          const Eigen::Index m =
+            std::min(detail::colormap_span, inner - i0);
+          for (Eigen::Index i = 0; i < m; ++i) {
+            t(i) = Derived::IsRowMajor ? double(a.coeff(k, i0 + i))
+                                       : double(a.coeff(i0 + i, k));
+          }
+          transform.apply(t.head(m));
+          std::uint8_t* out = rgba + k * across + i0 * along;
+          for (Eigen::Index i = 0; i < m; ++i, out += along) {
+            std::memcpy(out, &table_[index(t(i))], 4);
+          }
+        }
+      });
+  }
+
+  /**
+     @brief Map an array to a numpy RGBA image for `imshow`
+
+     The GIL is released while mapping.
+
+     @param norm The normalization.  Unset limits are autoscaled.
+     @param z The data
+     @return A `uint8` array of shape `(rows, cols, 4)`
+  */
+  template<class Derived>
+  pybind11::array_t<std::uint8_t> rgba(const Normalize& norm,
+                                       const Eigen::DenseBase<Derived>& z) const
+  {
+    pybind11::array_t<std::uint8_t> image(
+      { pybind11::ssize_t(z.rows()), pybind11::ssize_t(z.cols()), 4 });
+    std::uint8_t* data = image.mutable_data();
+    {
+      pybind11::gil_scoped_release release;
+      map(norm, z, data);
+    }
+    return image;
+  }
+
+private:
+  size_t index(double t) const
+  {
+    const Eigen::Index n = size();
+    if (std::isnan(t)) {
+      return size_t(n + 2);
+    }
+    if (t < 0) {
+      return size_t(n);
+    }
+    if (t > 1) {
+      return size_t(n + 1);
+    }
+    return size_t(std::min(Eigen::Index(t * double(n)), n - 1));
+  }
+
+  pybind11::object cmap_;
+  std::vector<std::array<std::uint8_t, 4>> table_;
+};
+
+/**
+   @brief Draw a scalar field with `imshow` after mapping it to RGBA in `c++`
+
+   @param ax The Axes
+   @param z The data, with row 0 at the top unless `origin="lower"` is given
+   @param cmap The colormap
+   @param norm The normalization.  Unset limits are autoscaled.
+   @param kwargs Further keyword arguments for `imshow`, such as `extent`
+   @return The `AxesImage`
+*/
+template<class Derived>
+pybind11::object
+imshow_rgba(pybind11::object ax,
+            const Eigen::DenseBase<Derived>& z,
+            const Colormap& cmap,
+            const Normalize& norm = Normalize(),
+            pybind11::dict kwargs = pybind11::dict())
+{
+  return ax.attr("imshow")(cmap.rgba(norm, z), **kwargs);
+}
+
+}
@@ -0,0 +1,362 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <cstdint>
+#include <mplot++/callsite.h>
+#include <mplot++/mplot++.h>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief Whether a type can be passed to numpy with view() or adopt()
+*/
+template<class C, class Enable = void>
+struct is_viewable : std::false_type
+{};
+
+template<class T, class Alloc>
+struct is_viewable<std::vector<T, Alloc>> : std::is_arithmetic<T>
+{};
+
+template<class C>
+struct is_viewable<
+  C,
+  std::enable_if_t<std::is_base_of<Eigen::PlainObjectBase<C>, C>::value>>
+  : std::is_arithmetic<typename C::Scalar>
+{};
+
+/**
+   @private
+   @brief The python module running command buffers, created on first use in
+   each interpreter
+*/
+inline pybind11::object
+command_runner()
+{
+  pybind11::dict modules = pybind11::module_::import("sys").attr("modules");
+  const char* name = "_mplotpp_commands";
+  if (modules.contains(name)) {
+    return modules[name];
+  }
+  auto module = pybind11::module_::import("types").attr("ModuleType")(name);
+  pybind11::exec(R"(
+class Ref:
+    __slots__ = ('index',)
+
+    def __init__(self, index):
+        self.index = index
+
+def run(commands, results):
+    for i, (target, name, args, kwargs, deref) in enumerate(commands):
+        try:
+            if deref:
+                if type(target) is Ref:
+                    target = results[target.index]
+                args = [results[a.index] if type(a) is Ref else a
+                        for a in args]
+                kwargs = {k: results[v.index] if type(v) is Ref else v
+                          for k, v in kwargs.items()}
+            results.append(getattr(target, name)(*args, **kwargs))
+        except Exception as e:
+            return i, '%s: %s' % (type(e).__name__, e)
+    return -1, None
+)",
+                 module.attr("__dict__"));
+  modules[name] = module;
+  return module;
+}
+
+}
+
+/**
+   @brief Records matplotlib calls and runs them in one python call.
+
+   Every `ax.attr("plot")(...)` crosses from `c++` to python on its own, with
+   its own argument conversion and dispatch.  A frame that draws thousands of
+   primitives can instead record them and cross once
+   ```
+   mplotpp::CommandBuffer cmd;
+   for (size_t i = 0; i < boxes.size(); ++i) {
+     cmd.on(ax, "add_patch")(patches[i]);
+     cmd.on(ax, "text")(x[i], y[i], labels[i], "fontsize"_a = 6);
+   }
+   auto line = cmd.on(ax, "plot")(x, y);
+   cmd.on(fig, "colorbar")(cmd.on(ax, "imshow")(image));
+   cmd.execute();
+   ```
+   Each recorded call returns a CommandBuffer::Ref, which may be used as the
+   target or an argument of later calls and gives the python result with
+   result() after execute().  References may be targets or positional
+   arguments.  A reference belongs to the batch it was recorded in: it can
+   be used in other calls of that batch only, and gives a result only until
+   the next execute() or clear().
+
+   Arguments are converted when recorded.  `std::vector` and Eigen lvalues
+   are recorded as views, so they must stay alive and unchanged until
+   execute() returns, and as long as matplotlib refers to them; temporaries
+   are adopted.  Keyword arguments are given with `pybind11::arg` literals
+   or mplotpp::Keyword.
+
+   If a call fails, the calls before it have taken effect and execute()
+   throws with the file and line where the failing call was recorded.
+*/
+class CommandBuffer
+{
+public:
+  /// The result of a recorded call
+  class Ref
+  {
+  public:
+    /// The position of the call in the buffer
+    size_t index() const { return index_; }
+
+  private:
+    friend class CommandBuffer;
+    Ref(size_t index, uint64_t generation)
+      : index_(index)
+      , generation_(generation)
+    {}
+    size_t index_;
+    uint64_t generation_;
+  };
+
+private:
+  struct Site
+  {
+    std::string method;
+    std::string file;
+    int line = 0;
+  };
+
+public:
+  /// A pending call, completed by giving its arguments
+  class Recorder
+  {
+  public:
+    /**
+       @brief Record the call
+
+       @param args Positional arguments followed by keyword arguments
+       @return A reference to the result of the call
+    */
+    template<class... Args>
+    Ref operator()(Args&&... args)
+    {
+      pybind11::list positional;
+      pybind11::dict kwargs;
+      bool deref = deref_;
+      (buffer_.place(positional, kwargs, deref, std::forward<Args>(args)), ...);
+      return buffer_.push(target_,
+                          method_,
+                          std::move(site_),
+                          pybind11::tuple(positional),
+                          kwargs,
+                          deref);
+    }
+
+  private:
+    friend class CommandBuffer;
+    Recorder(CommandBuffer& buffer,
+             pybind11::object target,
+             const char* method,
+             const char* file,
+             int line,
+             bool deref)
+      : buffer_(buffer)
+      , target_(std::move(target))
+      , method_(pybind11::reinterpret_steal<pybind11::str>(
+          PyUnicode_InternFromString(method)))
+      , site_{ method, file, line }
+      , deref_(deref)
+    {}
+    CommandBuffer& buffer_;
+    pybind11::object target_;
+    pybind11::str method_;
+    Site site_;
+    bool deref_;
+  };
+
+  CommandBuffer()
+    : runner_(detail::command_runner())
+    , make_ref_(runner_.attr("Ref"))
+  {}
+
+  /**
+     @brief Start recording a method call
+
+     @param target The object whose method is called
+     @param method The name of the method
+     @return A Recorder taking the arguments of the call
+  */
+  Recorder on(pybind11::handle target,
+              const char* method,
+              const char* file = __builtin_FILE(),
+              int line = __builtin_LINE())
+  {
+    return Recorder(*this,
+                    pybind11::reinterpret_borrow<pybind11::object>(target),
+                    method,
+                    file,
+                    line,
+                    false);
+  }
+
+  /**
+     @brief Start recording a call of a method of an earlier result
+
+     @param target A reference to an earlier call of this batch
+     @param method The name of the method
+     @return A Recorder taking the arguments of the call
+     @throw std::invalid_argument if the reference is from an earlier batch
+  */
+  Recorder on(Ref target,
+              const char* method,
+              const char* file = __builtin_FILE(),
+              int line = __builtin_LINE())
+  {
+    return Recorder(*this, recorded(target), method, file, line, true);
+  }
+
+  /// The number of recorded calls
+  size_t size() const { return sites_.size(); }
+
+  /**
+     @brief Run all recorded calls and clear the buffer
+
+     Results of the calls remain available from result() until the next
+     execute() or clear().
+
+     @throw std::runtime_error if a call fails, with the location where it
+     was recorded and the python error
+  */
+  void execute()
+  {
+    results_ = pybind11::list();
+    auto outcome = runner_.attr("run")(commands_, results_);
+    ++generation_;
+    std::vector<Site> sites;
+    sites.swap(sites_);
+    commands_ = pybind11::list();
+    auto failed = outcome[pybind11::int_(0)].cast<long>();
+    if (failed >= 0) {
+      const Site& site = sites[size_t(failed)];
+      throw(std::runtime_error(
+        site.file + ":" + std::to_string(site.line) + ": " + site.method +
+        ": " + outcome[pybind11::int_(1)].cast<std::string>()));
+    }
+  }
+
+  /**
+     @brief The python result of a call run by the last execute()
+
+     @param ref The reference returned when the call was recorded
+     @throw std::out_of_range if the call has not been run, or its results
+     were discarded by a later execute() or clear()
+  */
+  pybind11::object result(Ref ref) const
+  {
+    // The last execute() ran the batch before the one being recorded
+    if (ref.generation_ + 1 != generation_ or ref.index() >= results_.size()) {
+      throw(std::out_of_range("Command has not been executed"));
+    }
+    return results_[ref.index()];
+  }
+
+  /// Discard recorded calls and results
+  void clear()
+  {
+    ++generation_;
+    sites_.clear();
+    commands_ = pybind11::list();
+    results_ = pybind11::list();
+  }
+
+private:
+  Ref push(const pybind11::object& target,
+           const pybind11::str& method,
+           Site site,
+           pybind11::tuple args,
+           pybind11::dict kwargs,
+           bool deref)
+  {
+    commands_.append(pybind11::make_tuple(
+      target, method, args, kwargs, pybind11::bool_(deref)));
+    sites_.push_back(std::move(site));
+    return Ref(sites_.size() - 1, generation_);
+  }
+
+  // The placeholder resolved to the result of a call of the batch being
+  // recorded
+  pybind11::object recorded(const Ref& ref)
+  {
+    if (ref.generation_ != generation_) {
+      throw(std::invalid_argument(
+        "CommandBuffer::Ref used after its batch was executed or cleared"));
+    }
+    return make_ref_(ref.index());
+  }
+
+  void place(pybind11::list& positional,
+             pybind11::dict&,
+             bool& deref,
+             const Ref& ref)
+  {
+    positional.append(recorded(ref));
+    deref = true;
+  }
+
+  void place(pybind11::list&,
+             pybind11::dict& kwargs,
+             bool&,
+             const Keyword::Value& kw)
+  {
+    kwargs[kw.key] = kw.value;
+  }
+
+  void place(pybind11::list&,
+             pybind11::dict& kwargs,
+             bool&,
+             const pybind11::arg_v& kw)
+  {
+    kwargs[kw.name] = kw.value;
+  }
+
+  template<class T,
+           class C = std::decay_t<T>,
+           std::enable_if_t<not std::is_same<C, Ref>::value and
+                              not std::is_same<C, Keyword::Value>::value and
+                              not std::is_base_of<pybind11::arg, C>::value,
+                            bool> = true>
+  void place(pybind11::list& positional, pybind11::dict&, bool&, T&& arg)
+  {
+    if constexpr (detail::is_viewable<C>::value) {
+      if constexpr (std::is_lvalue_reference<T>::value) {
+        positional.append(view(arg));
+      } else {
+        positional.append(adopt(std::move(arg)));
+      }
+    } else {
+      positional.append(pybind11::cast(std::forward<T>(arg)));
+    }
+  }
+
+  pybind11::object runner_;
+  pybind11::object make_ref_;
+  pybind11::list commands_;
+  pybind11::list results_;
+  std::vector<Site> sites_;
+  /// The number of batches executed or cleared
+  uint64_t generation_ = 0;
+};
+
+}
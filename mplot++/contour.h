@@ -0,0 +1,548 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mplot++/collection.h>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+/**
+   @brief A regular grid, whose node `(i, j)` is at `(x0 + j dx, y0 + i dy)`
+*/
+struct RegularGrid
+{
+  double x0 = 0;
+  double dx = 1;
+  double y0 = 0;
+  double dy = 1;
+};
+
+class ContourLines;
+
+namespace detail {
+
+/**
+   @private
+   @brief Number of cell rows in each tile processed by contour_lines()
+*/
+constexpr Eigen::Index contour_tile_rows = 64;
+
+/**
+   @private
+   @brief Contour lines as the sequences of grid edges they cross, stored
+   one after another.  Edge `2 n` joins node `n` to its right neighbour and
+   edge `2 n + 1` joins it to the node above, where `n = i N + j`.
+*/
+struct EdgePaths
+{
+  /// The edges of all paths
+  std::vector<uint64_t> edges;
+  /// Path `k` is `edges[bounds[k], bounds[k + 1])`
+  std::vector<size_t> bounds{ 0 };
+
+  size_t size() const { return bounds.size() - 1; }
+  const uint64_t* begin(size_t k) const { return edges.data() + bounds[k]; }
+  const uint64_t* end(size_t k) const { return edges.data() + bounds[k + 1]; }
+
+  /// Add the paths of another set
+  void append(const EdgePaths& other)
+  {
+    size_t offset = edges.size();
+    edges.insert(edges.end(), other.edges.begin(), other.edges.end());
+    for (size_t k = 1; k < other.bounds.size(); ++k) {
+      bounds.push_back(offset + other.bounds[k]);
+    }
+  }
+};
+
+/**
+   @private
+   @brief The segments of marching squares as pairs of edges, stored one
+   after another
+*/
+struct EdgeSegments
+{
+  std::vector<uint64_t> edges;
+
+  size_t size() const { return edges.size() / 2; }
+  const uint64_t* begin(size_t k) const { return edges.data() + 2 * k; }
+  const uint64_t* end(size_t k) const { return edges.data() + 2 * k + 2; }
+};
+
+/// @private
+struct RegularCoords
+{
+  RegularGrid g;
+  std::pair<double, double> at(Eigen::Index i, Eigen::Index j) const
+  {
+    return { g.x0 + double(j) * g.dx, g.y0 + double(i) * g.dy };
+  }
+};
+
+/// @private
+struct RectilinearCoords
+{
+  const Eigen::ArrayXd& x;
+  const Eigen::ArrayXd& y;
+  std::pair<double, double> at(Eigen::Index i, Eigen::Index j) const
+  {
+    return { x(j), y(i) };
+  }
+};
+
+/// @private
+struct CurvilinearCoords
+{
+  const Eigen::ArrayXXd& X;
+  const Eigen::ArrayXXd& Y;
+  std::pair<double, double> at(Eigen::Index i, Eigen::Index j) const
+  {
+    return { X(i, j), Y(i, j) };
+  }
+};
+
+/**
+   @private
+   @brief Join paths that end on a common edge into longer paths.
+
+   In marching squares every edge is crossed by at most two path ends, so the
+   partner of an end is its neighbour in the ends sorted by edge.  Closed
+   paths repeat their first edge at the end.
+
+   @param pieces EdgePaths or EdgeSegments
+*/
+template<class Pieces>
+EdgePaths
+chain_paths(const Pieces& pieces)
+{
+  auto closed = [&](size_t k) {
+    return pieces.end(k) - pieces.begin(k) > 2 and
+           *pieces.begin(k) == pieces.end(k)[-1];
+  };
+
+  // End 2 k is the front of piece k and end 2 k + 1 its back
+  struct End
+  {
+    uint64_t edge;
+    size_t end;
+    bool operator<(const End& o) const
+    {
+      return edge < o.edge or (edge == o.edge and end < o.end);
+    }
+  };
+  const size_t n = pieces.size();
+  std::vector<End> ends;
+  ends.reserve(2 * n);
+  for (size_t k = 0; k < n; ++k) {
+    if (not closed(k)) {
+      ends.push_back({ *pieces.begin(k), 2 * k });
+      ends.push_back({ pieces.end(k)[-1], 2 * k + 1 });
+    }
+  }
+  std::sort(ends.begin(), ends.end());
+  std::vector<size_t> position(2 * n);
+  for (size_t p = 0; p < ends.size(); ++p) {
+    position[ends[p].end] = p;
+  }
+  const size_t none = size_t(-1);
+  auto partner = [&](size_t end) {
+    size_t p = position[end];
+    if (p > 0 and ends[p - 1].edge == ends[p].edge) {
+      return ends[p - 1].end;
+    }
+    if (p + 1 < ends.size() and ends[p + 1].edge == ends[p].edge) {
+      return ends[p + 1].end;
+    }
+    return none;
+  };
+
+  EdgePaths result;
+  result.edges.reserve(pieces.edges.size());
+  std::vector<bool> used(n, false);
+  auto path_closed = [&]() {
+    size_t first = result.bounds.back();
+    return result.edges.size() - first > 2 and
+           result.edges[first] == result.edges.back();
+  };
+  // Append the pieces joined at `end`, the free end of the path so far
+  auto extend = [&](size_t end) {
+    while (not path_closed()) {
+      size_t next = partner(end);
+      if (next == none or used[next / 2]) {
+        return;
+      }
+      size_t k = next / 2;
+      used[k] = true;
+      if (next % 2 == 0) {
+        result.edges.insert(
+          result.edges.end(), pieces.begin(k) + 1, pieces.end(k));
+      } else {
+        result.edges.insert(result.edges.end(),
+                            std::make_reverse_iterator(pieces.end(k) - 1),
+                            std::make_reverse_iterator(pieces.begin(k)));
+      }
+      end = next ^ 1;
+    }
+  };
+
+  for (size_t k = 0; k < n; ++k) {
+    if (used[k]) {
+      continue;
+    }
+    used[k] = true;
+    result.edges.insert(result.edges.end(), pieces.begin(k), pieces.end(k));
+    extend(2 * k + 1);
+    if (not path_closed()) {
+      std::reverse(result.edges.begin() + result.bounds.back(),
+                   result.edges.end());
+      extend(2 * k);
+    }
+    result.bounds.push_back(result.edges.size());
+  }
+  return result;
+}
+
+/**
+   @private
+   @brief Marching squares over the cell rows `[first, last)` for every
+   level, giving the paths of each level chained within the tile
+*/
+inline std::vector<EdgePaths>
+contour_tile(const Eigen::ArrayXXd& z,
+             const Eigen::ArrayXd& levels,
+             Eigen::Index first,
+             Eigen::Index last)
+{
+  const uint64_t N = uint64_t(z.cols());
+  auto h = [N](Eigen::Index i, Eigen::Index j) {
+    return 2 * (uint64_t(i) * N + uint64_t(j));
+  };
+  auto v = [N](Eigen::Index i, Eigen::Index j) {
+    return 2 * (uint64_t(i) * N + uint64_t(j)) + 1;
+  };
+
+  std::vector<EdgePaths> tile(size_t(levels.size()));
+  EdgeSegments segments;
+  for (Eigen::Index l = 0; l < levels.size(); ++l) {
+    const double L = levels(l);
+    segments.edges.clear();
+    for (Eigen::Index i = first; i < last; ++i) {
+      for (Eigen::Index j = 0; j + 1 < z.cols(); ++j) {
+        const double a = z(i, j);
+        const double b = z(i, j + 1);
+        const double c = z(i + 1, j + 1);
+        const double d = z(i + 1, j);
+        const int index =
+          (a > L) | (b > L) << 1 | (c > L) << 2 | (d > L) << 3;
+        if (index == 0 or index == 15 or std::isnan(a + b + c + d)) {
+          continue;
+        }
+        // Edges: bottom, right, top, left
+        const uint64_t e[4] = { h(i, j), v(i, j + 1), h(i + 1, j), v(i, j) };
+        auto segment = [&](int p, int q) {
+          segments.edges.push_back(e[p]);
+          segments.edges.push_back(e[q]);
+        };
+        switch (index) {
+          case 1:
+          case 14:
+            segment(3, 0);
+            break;
+          case 2:
+          case 13:
+            segment(0, 1);
+            break;
+          case 3:
+          case 12:
+            segment(3, 1);
+            break;
+          case 4:
+          case 11:
+            segment(1, 2);
+            break;
+          case 6:
+          case 9:
+            segment(0, 2);
+            break;
+          case 7:
+          case 8:
+            segment(2, 3);
+            break;
+          case 5:
+          case 10: {
+            // Saddle: resolved by the value at the centre of the cell
+            bool centre = 0.25 * (a + b + c + d) > L;
+            if ((index == 5) == centre) {
+              segment(0, 1);
+              segment(2, 3);
+            } else {
+              segment(3, 0);
+              segment(1, 2);
+            }
+            break;
+          }
+        }
+      }
+    }
+    tile[size_t(l)] = chain_paths(segments);
+  }
+  return tile;
+}
+
+/**
+   @private
+   @brief Contour every level in parallel tiles, stitch the tiles and convert
+   edge paths to coordinates
+*/
+template<class Coords>
+ContourLines
+contour(const Coords& coords,
+        const Eigen::ArrayXXd& z,
+        const Eigen::ArrayXd& levels);
+
+}
+
+/**
+   @brief Contour lines of several levels, ready to be drawn as one
+   `LineCollection`
+*/
+class ContourLines
+{
+public:
+  /// The lines of all levels
+  const SegmentBuilder<double>& lines() const { return lines_; }
+
+  /// The level of each line, as a read-only numpy array
+  pybind11::array_t<double> levels() const { return view(levels_); }
+
+  /**
+     @brief Create a `LineCollection` of all lines, coloured by level through
+     its colormap
+
+     @param kwargs Keyword arguments for the `LineCollection`, such as `cmap`
+     or `linewidths`
+  */
+  pybind11::object line_collection(
+    pybind11::dict kwargs = pybind11::dict()) const
+  {
+    auto collection = lines_.line_collection(kwargs);
+    collection.attr("set_array")(levels());
+    return collection;
+  }
+
+private:
+  template<class Coords>
+  friend ContourLines detail::contour(const Coords&,
+                                      const Eigen::ArrayXXd&,
+                                      const Eigen::ArrayXd&);
+
+  SegmentBuilder<double> lines_;
+  std::shared_ptr<std::vector<double>> levels_ =
+    std::make_shared<std::vector<double>>();
+};
+
+template<class Coords>
+ContourLines
+detail::contour(const Coords& coords,
+                const Eigen::ArrayXXd& z,
+                const Eigen::ArrayXd& levels)
+{
+  ContourLines result;
+  if (z.rows() < 2 or z.cols() < 2 or levels.size() == 0) {
+    return result;
+  }
+  pybind11::gil_scoped_release release;
+
+  const Eigen::Index cells = z.rows() - 1;
+  const Eigen::Index ntiles =
+    (cells + contour_tile_rows - 1) / contour_tile_rows;
+  std::vector<std::vector<EdgePaths>> tiles(
+    static_cast<size_t>(ntiles));
+  parallel_for(
+    Eigen::Index(0),
+    ntiles,
+    Eigen::Index(1),
+    [&](Eigen::Index first, Eigen::Index last) {
+      for (Eigen::Index t = first; t < last; ++t) {
+        tiles[size_t(t)] =
+          contour_tile(z,
+                       levels,
+                       t * contour_tile_rows,
+                       std::min(cells, (t + 1) * contour_tile_rows));
+      }
+    });
+
+  // Stitch paths ending on tile borders, one level at a time
+  std::vector<EdgePaths> paths(size_t(levels.size()));
+  parallel_for(
+    Eigen::Index(0),
+    levels.size(),
+    Eigen::Index(1),
+    [&](Eigen::Index first, Eigen::Index last) {
+      for (Eigen::Index l = first; l < last; ++l) {
+        EdgePaths pieces;
+        for (auto& tile : tiles) {
+          pieces.append(tile[size_t(l)]);
+          tile[size_t(l)] = EdgePaths();
+        }
+        paths[size_t(l)] = chain_paths(pieces);
+      }
+    });
+
+  const uint64_t N = uint64_t(z.cols());
+  size_t npoints = 0;
+  size_t nlines = 0;
+  for (const auto& level : paths) {
+    nlines += level.size();
+    npoints += level.edges.size();
+  }
+  result.lines_.reserve(nlines, npoints);
+  result.levels_->reserve(nlines);
+  for (Eigen::Index l = 0; l < levels.size(); ++l) {
+    const double L = levels(l);
+    const EdgePaths& level = paths[size_t(l)];
+    for (size_t k = 0; k < level.size(); ++k) {
+      result.lines_.begin_segment();
+      result.levels_->push_back(L);
+      for (const uint64_t* it = level.begin(k); it != level.end(k); ++it) {
+        uint64_t e = *it;
+        auto n = e / 2;
+        auto i = Eigen::Index(n / N);
+        auto j = Eigen::Index(n % N);
+        auto i2 = i + Eigen::Index(e & 1);
+        auto j2 = j + Eigen::Index(1 - (e & 1));
+        double t = (L - z(i, j)) / (z(i2, j2) - z(i, j));
+        auto p = coords.at(i, j);
+        auto q = coords.at(i2, j2);
+        result.lines_.push(p.first + t * (q.first - p.first),
+                           p.second + t * (q.second - p.second));
+      }
+    }
+  }
+  return result;
+}
+
+/**
+   @brief Compute contour lines of a field on a regular grid, without
+   materialising the grid coordinates.
+
+   Marching squares is run in parallel on bands of grid rows, and lines
+   crossing band borders are joined afterwards, so the result is identical
+   to a single-threaded pass.  The GIL is released during the computation.
+   The lines are drawn with
+   ```
+   auto c = mplotpp::contour_lines(mplotpp::RegularGrid{0, 0.01, 0, 0.01}, z,
+                                   levels);
+   mplotpp::plot_contour_lines(ax, c, py::dict("cmap"_a = "viridis"));
+   ```
+   Cells with a NaN corner are skipped.
+
+   @param grid The position of the nodes
+   @param z The field, with `z(i, j)` at node `(i, j)`
+   @param levels The contour levels
+   @return The contour lines of every level
+*/
+inline ContourLines
+contour_lines(const RegularGrid& grid,
+              const Eigen::ArrayXXd& z,
+              const Eigen::ArrayXd& levels)
+{
+  return detail::contour(detail::RegularCoords{ grid }, z, levels);
+}
+
+/**
+   @brief Compute contour lines of a field on a rectilinear grid, as produced
+   by meshgrid() of `x` and `y`
+
+   @param x The abscissas of the grid columns
+   @param y The ordinates of the grid rows
+   @param z The field, with `z(i, j)` at `(x(j), y(i))`
+   @param levels The contour levels
+   @return The contour lines of every level
+   @throw std::invalid_argument if the sizes do not match
+*/
+inline ContourLines
+contour_lines(const Eigen::ArrayXd& x,
+              const Eigen::ArrayXd& y,
+              const Eigen::ArrayXXd& z,
+              const Eigen::ArrayXd& levels)
+{
+  if (x.size() != z.cols() or y.size() != z.rows()) {
+    throw(std::invalid_argument(
+      "Grid and field sizes differ in contour_lines()"));
+  }
+  return detail::contour(detail::RectilinearCoords{ x, y }, z, levels);
+}
+
+/**
+   @brief Compute contour lines of a field on the grid of a GridView
+
+   @param grid The grid
+   @param z The field, with `z(i, j)` at `(grid.x()(j), grid.y()(i))`
+   @param levels The contour levels
+   @return The contour lines of every level
+*/
+inline ContourLines
+contour_lines(const GridView<double>& grid,
+              const Eigen::ArrayXXd& z,
+              const Eigen::ArrayXd& levels)
+{
+  return contour_lines(grid.x(), grid.y(), z, levels);
+}
+
+/**
+   @brief Compute contour lines of a field on a curvilinear grid given by the
+   coordinates of every node
+
+   @param X The abscissas of the nodes
+   @param Y The ordinates of the nodes
+   @param z The field, with `z(i, j)` at `(X(i, j), Y(i, j))`
+   @param levels The contour levels
+   @return The contour lines of every level
+   @throw std::invalid_argument if the sizes do not match
+*/
+inline ContourLines
+contour_lines(const Eigen::ArrayXXd& X,
+              const Eigen::ArrayXXd& Y,
+              const Eigen::ArrayXXd& z,
+              const Eigen::ArrayXd& levels)
+{
+  if (X.rows() != z.rows() or X.cols() != z.cols() or Y.rows() != z.rows() or
+      Y.cols() != z.cols()) {
+    throw(std::invalid_argument(
+      "Grid and field sizes differ in contour_lines()"));
+  }
+  return detail::contour(detail::CurvilinearCoords{ X, Y }, z, levels);
+}
+
+/**
+   @brief Draw contour lines on an Axes as a single `LineCollection`
+
+   @param ax The Axes
+   @param lines The contour lines
+   @param kwargs Keyword arguments for the `LineCollection`
+   @return The `LineCollection`, which may be passed to `colorbar`
+*/
+inline pybind11::object
+plot_contour_lines(pybind11::object ax,
+                   const ContourLines& lines,
+                   pybind11::dict kwargs = pybind11::dict())
+{
+  auto collection = lines.line_collection(kwargs);
+  ax.attr("add_collection")(collection);
+  ax.attr("autoscale_view")();
+  return collection;
+}
+
+}
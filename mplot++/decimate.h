@@ -0,0 +1,544 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <type_traits>
+#include <utility>
+
+namespace mplotpp {
+
+/**
+   @brief Reduction applied by plot_decimated()
+*/
+enum class Decimation
+{
+  /// First, last, minimum and maximum point of every pixel column (M4)
+  MinMax,
+  /// Largest-Triangle-Three-Buckets with two points per pixel column
+  LTTB
+};
+
+/**
+   @brief The points of a decimated series
+*/
+struct Decimated
+{
+  Eigen::ArrayXd x;
+  Eigen::ArrayXd y;
+};
+
+namespace detail {
+
+/**
+   @private
+   @brief Number of buckets processed as one chunk by the parallel kernels.
+   This is fixed, rather than derived from the thread count, so that results
+   do not depend on the number of threads.
+*/
+constexpr Eigen::Index decimate_grain = 512;
+
+/**
+   @private
+   @brief The minimum and maximum of an array, ignoring NaN.  Both are NaN if
+   every element is NaN.
+
+   NaN is masked before Eigen's reductions, whose handling of it is otherwise
+   unspecified.
+*/
+template<class Derived>
+inline std::pair<typename Derived::Scalar, typename Derived::Scalar>
+extrema(const Eigen::ArrayBase<Derived>& a)
+{
+  using T = typename Derived::Scalar;
+  if constexpr (std::is_floating_point<T>::value) {
+    const T inf = std::numeric_limits<T>::infinity();
+    T lo = a.isNaN().select(inf, a).minCoeff();
+    T hi = a.isNaN().select(-inf, a).maxCoeff();
+    if (not(lo <= hi)) {
+      lo = hi = std::numeric_limits<T>::quiet_NaN();
+    }
+    return { lo, hi };
+  } else {
+    return { a.minCoeff(), a.maxCoeff() };
+  }
+}
+
+/**
+   @private
+   @brief The index range of sorted `x` inside `[xmin, xmax]`, widened by one
+   point on either side so that a line leaves the view at the correct slope.
+*/
+inline std::pair<Eigen::Index, Eigen::Index>
+visible_range(const Eigen::ArrayXd& x, double xmin, double xmax)
+{
+  const double* begin = x.data();
+  const double* end = x.data() + x.size();
+  Eigen::Index first = std::lower_bound(begin, end, xmin) - begin;
+  Eigen::Index last = std::upper_bound(begin, end, xmax) - begin;
+  return { std::max<Eigen::Index>(first - 1, 0),
+           std::min<Eigen::Index>(last + 1, x.size()) };
+}
+
+/**
+   @private
+   @brief Copy the points of `[first, last)` without reduction
+*/
+inline Decimated
+copy_range(const Eigen::ArrayXd& x,
+           const Eigen::ArrayXd& y,
+           Eigen::Index first,
+           Eigen::Index last)
+{
+  return { x.segment(first, last - first), y.segment(first, last - first) };
+}
+
+}
+
+/**
+   @brief Reduce a series to at most four points per bucket, plus one for a
+   gap, preserving its visual appearance.
+
+   The x-range `[xmin, xmax]` is divided into `nbuckets` equal buckets, which
+   should correspond to the pixel columns of the axes.  For every bucket the
+   first, last, minimum and maximum points are kept, in their original order.
+   This is the M4 aggregation, which draws the same line as the full series at
+   that resolution.  Points outside `[xmin, xmax]` are dropped, apart from one
+   on either side.
+
+   NaN values are skipped when finding the minimum and maximum of a bucket,
+   but a bucket holding NaN also keeps its first NaN point, in order, so that
+   a gap in the series is still a gap in the reduced line.  Minima and maxima
+   are found using Eigen's reductions over the bucket with NaN masked,
+   followed by a search for their first index, and buckets are processed in
+   parallel using parallel_for().
+
+   @param x The x-coordinates, sorted in ascending order
+   @param y The y-coordinates, of the same length as x
+   @param nbuckets The number of buckets
+   @param xmin The lower limit of the visible range
+   @param xmax The upper limit of the visible range
+   @return The reduced series
+   @throw std::invalid_argument if the lengths of x and y differ or nbuckets
+   is not positive
+*/
+inline Decimated
+decimate_minmax(const Eigen::ArrayXd& x,
+                const Eigen::ArrayXd& y,
+                Eigen::Index nbuckets,
+                double xmin,
+                double xmax)
+{
+  if (x.size() != y.size()) {
+    throw(std::invalid_argument("x and y lengths differ in decimate_minmax()"));
+  }
+  if (nbuckets <= 0) {
+    throw(std::invalid_argument("nbuckets must be positive"));
+  }
+  auto [first, last] = detail::visible_range(x, xmin, xmax);
+  if (last - first <= 4 * nbuckets) {
+    return detail::copy_range(x, y, first, last);
+  }
+
+  // Bucket k holds the indices [bound[k], bound[k + 1])
+  const double* xbegin = x.data();
+  const double* xend = x.data() + last;
+  const double width = (xmax - xmin) / double(nbuckets);
+  std::vector<Eigen::Index> bound(nbuckets + 1);
+  bound[0] = first;
+  bound[nbuckets] = last;
+  std::vector<std::array<Eigen::Index, 5>> keep(nbuckets);
+  std::vector<int> nkeep(nbuckets);
+
+  parallel_for(
+    Eigen::Index(1),
+    nbuckets,
+    detail::decimate_grain,
+    [&](Eigen::Index k0, Eigen::Index k1) {
+      for (Eigen::Index k = k0; k < k1; ++k) {
+        double edge = xmin + double(k) * width;
+        bound[k] = std::lower_bound(xbegin + first, xend, edge) - xbegin;
+      }
+    });
+
+  parallel_for(
+    Eigen::Index(0),
+    nbuckets,
+    detail::decimate_grain,
+    [&](Eigen::Index k0, Eigen::Index k1) {
+      for (Eigen::Index k = k0; k < k1; ++k) {
+        Eigen::Index i0 = bound[k];
+        Eigen::Index n = bound[k + 1] - i0;
+        auto& idx = keep[k];
+        if (n <= 4) {
+          for (Eigen::Index i = 0; i < n; ++i) {
+            idx[i] = i0 + i;
+          }
+          nkeep[k] = int(n);
+          continue;
+        }
+        // The reductions skip NaN, and an all-NaN bucket keeps only its
+        // ends, which still break the line
+        auto segment = y.segment(i0, n);
+        const auto [lo, hi] = detail::extrema(segment);
+        const double* begin = y.data() + i0;
+        const double* end = begin + n;
+        Eigen::Index imin = i0;
+        Eigen::Index imax = i0;
+        Eigen::Index inan = i0;
+        if (not std::isnan(lo)) {
+          imin = std::find(begin, end, lo) - y.data();
+          imax = std::find(begin, end, hi) - y.data();
+          if (segment.isNaN().any()) {
+            inan = std::find_if(begin, end, [](double v) {
+                     return std::isnan(v);
+                   }) -
+                   y.data();
+          }
+        }
+        idx = { i0, imin, imax, inan, i0 + n - 1 };
+        std::sort(idx.begin(), idx.end());
+        auto kept = std::unique(idx.begin(), idx.end());
+        nkeep[k] = int(kept - idx.begin());
+      }
+    });
+
+  Eigen::Index total = 0;
+  for (auto n : nkeep) {
+    total += n;
+  }
+  Decimated result{ Eigen::ArrayXd(total), Eigen::ArrayXd(total) };
+  Eigen::Index j = 0;
+  for (Eigen::Index k = 0; k < nbuckets; ++k) {
+    for (int m = 0; m < nkeep[k]; ++m, ++j) {
+      result.x[j] = x[keep[k][m]];
+      result.y[j] = y[keep[k][m]];
+    }
+  }
+  return result;
+}
+
+/**
+   @brief Reduce a whole series using decimate_minmax()
+
+   @param x The x-coordinates, sorted in ascending order
+   @param y The y-coordinates, of the same length as x
+   @param nbuckets The number of buckets
+   @return The reduced series
+*/
+inline Decimated
+decimate_minmax(const Eigen::ArrayXd& x,
+                const Eigen::ArrayXd& y,
+                Eigen::Index nbuckets)
+{
+  if (x.size() == 0) {
+    return {};
+  }
+  return decimate_minmax(x, y, nbuckets, x[0], x[x.size() - 1]);
+}
+
+/**
+   @brief Reduce a series using the Largest-Triangle-Three-Buckets algorithm
+
+   LTTB keeps the first and last points of `[xmin, xmax]` and, from each of
+   `nout - 2` equal-count buckets in between, the point forming the largest
+   triangle with the point kept from the previous bucket and the average of
+   the next bucket.  It gives a visually faithful series with exactly `nout`
+   points, which suits markers or further processing better than
+   decimate_minmax().
+
+   Buckets are processed in parallel in fixed-size groups.  The first bucket
+   of each group uses the average of the preceding bucket in place of the
+   point kept from it, which differs negligibly from the sequential algorithm
+   and does not depend on the number of threads.
+
+   @param x The x-coordinates, sorted in ascending order
+   @param y The y-coordinates, of the same length as x
+   @param nout The number of points to keep, at least 3.  If the range holds
+   no more points than this, they are returned unchanged.
+   @param xmin The lower limit of the visible range
+   @param xmax The upper limit of the visible range
+   @return The reduced series
+   @throw std::invalid_argument if the lengths of x and y differ or nout is
+   less than 3
+*/
+inline Decimated
+lttb(const Eigen::ArrayXd& x,
+     const Eigen::ArrayXd& y,
+     Eigen::Index nout,
+     double xmin,
+     double xmax)
+{
+  if (x.size() != y.size()) {
+    throw(std::invalid_argument("x and y lengths differ in lttb()"));
+  }
+  if (nout < 3) {
+    throw(std::invalid_argument("lttb() needs nout of at least 3"));
+  }
+  auto [first, last] = detail::visible_range(x, xmin, xmax);
+  const Eigen::Index n = last - first;
+  if (nout >= n) {
+    return detail::copy_range(x, y, first, last);
+  }
+
+  const Eigen::Index nbuckets = nout - 2;
+  const double every = double(n - 2) / double(nbuckets);
+  // Bucket k holds the indices [start(k), start(k + 1))
+  auto start = [&](Eigen::Index k) {
+    return first + 1 + Eigen::Index(std::floor(double(k) * every));
+  };
+  auto average = [&](Eigen::Index k) {
+    if (k == nbuckets) {
+      return std::make_pair(x[last - 1], y[last - 1]);
+    }
+    Eigen::Index i0 = start(k);
+    Eigen::Index len = start(k + 1) - i0;
+    return std::make_pair(x.segment(i0, len).mean(), y.segment(i0, len).mean());
+  };
+
+  Decimated result{ Eigen::ArrayXd(nout), Eigen::ArrayXd(nout) };
+  result.x[0] = x[first];
+  result.y[0] = y[first];
+  result.x[nout - 1] = x[last - 1];
+  result.y[nout - 1] = y[last - 1];
+
+  parallel_for(
+    Eigen::Index(0),
+    nbuckets,
+    detail::decimate_grain,
+    [&](Eigen::Index k0, Eigen::Index k1) {
+      auto [ax, ay] =
+        k0 == 0 ? std::make_pair(x[first], y[first]) : average(k0 - 1);
+      for (Eigen::Index k = k0; k < k1; ++k) {
+        auto [cx, cy] = average(k + 1);
+        Eigen::Index i0 = start(k);
+        Eigen::Index len = start(k + 1) - i0;
+        Eigen::Index best;
+        ((ax - cx) * (y.segment(i0, len) - ay) -
+         (ax - x.segment(i0, len)) * (cy - ay))
+          .abs()
+          .maxCoeff(&best);
+        ax = x[i0 + best];
+        ay = y[i0 + best];
+        result.x[k + 1] = ax;
+        result.y[k + 1] = ay;
+      }
+    });
+  return result;
+}
+
+/**
+   @brief Reduce a whole series using lttb()
+
+   @param x The x-coordinates, sorted in ascending order
+   @param y The y-coordinates, of the same length as x
+   @param nout The number of points to keep, at least 3
+   @return The reduced series
+   @throw std::invalid_argument if the lengths of x and y differ or nout is
+   less than 3
+*/
+inline Decimated
+lttb(const Eigen::ArrayXd& x, const Eigen::ArrayXd& y, Eigen::Index nout)
+{
+  if (nout < 3) {
+    throw(std::invalid_argument("lttb() needs nout of at least 3"));
+  }
+  if (x.size() == 0) {
+    return {};
+  }
+  return lttb(x, y, nout, x[0], x[x.size() - 1]);
+}
+
+namespace detail {
+
+/**
+   @private
+   @brief The width of an axes in pixels, as a number of buckets
+*/
+inline Eigen::Index
+pixel_width(const pybind11::object& ax)
+{
+  double pixels = ax.attr("bbox").attr("width").cast<double>();
+  return std::max<Eigen::Index>(1, std::lround(pixels));
+}
+
+/**
+   @private
+   @brief The height of an axes in pixels
+*/
+inline Eigen::Index
+pixel_height(const pybind11::object& ax)
+{
+  double pixels = ax.attr("bbox").attr("height").cast<double>();
+  return std::max<Eigen::Index>(1, std::lround(pixels));
+}
+
+/**
+   @private
+   @brief The limits returned by `ax.get_xlim` or `ax.get_ylim` in ascending
+   order
+*/
+inline std::pair<double, double>
+limits(const pybind11::object& ax, const char* getter)
+{
+  auto [lim0, lim1] = tuple<2>(ax.attr(getter)());
+  double lo = lim0.cast<double>();
+  double hi = lim1.cast<double>();
+  return { std::min(lo, hi), std::max(lo, hi) };
+}
+
+/**
+   @private
+   @brief The x-limits of an axes in ascending order
+*/
+inline std::pair<double, double>
+xlimits(const pybind11::object& ax)
+{
+  return limits(ax, "get_xlim");
+}
+
+/**
+   @private
+   @brief Call `refresh(ax, artist)` whenever `event`, such as
+   "xlim_changed", is emitted by `ax`
+
+   The callback is owned by the axes and refers to the artist through a
+   python weak reference, so it never keeps the figure alive.  Anything
+   captured by `refresh` lives as long as the axes.
+*/
+template<class F>
+void
+connect_axes_event(pybind11::object ax,
+                   const char* event,
+                   pybind11::object artist,
+                   F refresh)
+{
+  auto weakref = pybind11::module_::import("weakref").attr("ref");
+  pybind11::object artist_ref = weakref(artist);
+  ax.attr("callbacks").attr("connect")(
+    event,
+    pybind11::cpp_function([artist_ref, refresh](pybind11::object ax) {
+      pybind11::object artist = artist_ref();
+      if (not artist.is_none()) {
+        refresh(ax, artist);
+      }
+    }));
+}
+
+/**
+   @private
+   @brief Call `refresh(ax, line)` whenever the x-limits of `ax` change
+*/
+template<class F>
+void
+connect_xlim_changed(pybind11::object ax, pybind11::object line, F refresh)
+{
+  connect_axes_event(ax, "xlim_changed", line, refresh);
+}
+
+/**
+   @private
+   @brief Decimate for the current view of an axes
+*/
+inline Decimated
+decimate_view(const pybind11::object& ax,
+              const Eigen::ArrayXd& x,
+              const Eigen::ArrayXd& y,
+              Decimation method)
+{
+  auto [xmin, xmax] = xlimits(ax);
+  Eigen::Index nbuckets = pixel_width(ax);
+  pybind11::gil_scoped_release release;
+  if (method == Decimation::MinMax) {
+    return decimate_minmax(x, y, nbuckets, xmin, xmax);
+  }
+  // Two points per pixel, but at least the ends and one point between them
+  return lttb(x, y, std::max<Eigen::Index>(3, 2 * nbuckets), xmin, xmax);
+}
+
+}
+
+/**
+   @brief Plot a huge series, decimated to the resolution of the axes.
+
+   Only a few points per pixel column of the axes are passed to matplotlib,
+   so that drawing time no longer depends on the length of the series.  The
+   line is decimated again, from the full data, whenever the x-limits of the
+   axes change, for example when the user zooms or pans
+   ```
+   auto x = std::make_shared<const Eigen::ArrayXd>(load_times());
+   auto y = std::make_shared<const Eigen::ArrayXd>(load_values());
+   auto line = mplotpp::plot_decimated(ax, x, y);
+   ```
+   The data is shared with a callback registered with the axes, so it stays
+   alive for as long as the axes exist.  Neither the callback nor the data
+   hold references to the axes or the line.
+
+   @param ax The axes to plot on
+   @param x The x-coordinates, sorted in ascending order
+   @param y The y-coordinates, of the same length as x
+   @param method The decimation algorithm
+   @param kwargs Keyword arguments for `ax.plot()`
+   @return The matplotlib `Line2D`
+   @throw std::invalid_argument if the lengths of x and y differ
+*/
+inline pybind11::object
+plot_decimated(pybind11::object ax,
+               std::shared_ptr<const Eigen::ArrayXd> x,
+               std::shared_ptr<const Eigen::ArrayXd> y,
+               Decimation method = Decimation::MinMax,
+               pybind11::dict kwargs = pybind11::dict())
+{
+  if (x->size() != y->size()) {
+    throw(std::invalid_argument("x and y lengths differ in plot_decimated()"));
+  }
+  Eigen::Index nbuckets = detail::pixel_width(ax);
+  Decimated d = method == Decimation::MinMax
+                  ? decimate_minmax(*x, *y, nbuckets)
+                  : lttb(*x, *y, std::max<Eigen::Index>(3, 2 * nbuckets));
+  auto [line] = tuple<1>(ax.attr("plot")(
+    adopt(std::move(d.x)), adopt(std::move(d.y)), **kwargs));
+
+  detail::connect_xlim_changed(
+    ax, line, [x, y, method](pybind11::object ax, pybind11::object line) {
+      Decimated d = detail::decimate_view(ax, *x, *y, method);
+      line.attr("set_data")(adopt(std::move(d.x)), adopt(std::move(d.y)));
+    });
+  return line;
+}
+
+/**
+   @brief Plot a huge series, decimated to the resolution of the axes.
+
+   As for the `std::shared_ptr` overload.  Pass the arrays using `std::move`
+   to avoid copying them.
+
+   @param ax The axes to plot on
+   @param x The x-coordinates, sorted in ascending order
+   @param y The y-coordinates, of the same length as x
+   @param method The decimation algorithm
+   @param kwargs Keyword arguments for `ax.plot()`
+   @return The matplotlib `Line2D`
+*/
+inline pybind11::object
+plot_decimated(pybind11::object ax,
+               Eigen::ArrayXd x,
+               Eigen::ArrayXd y,
+               Decimation method = Decimation::MinMax,
+               pybind11::dict kwargs = pybind11::dict())
+{
+  return plot_decimated(ax,
+                        std::make_shared<const Eigen::ArrayXd>(std::move(x)),
+                        std::make_shared<const Eigen::ArrayXd>(std::move(y)),
+                        method,
+                        kwargs);
+}
+
+}
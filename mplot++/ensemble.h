@@ -0,0 +1,463 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+/**
+   @brief Statistics of every column of an ensemble
+
+   Quantiles are those of `numpy.nanpercentile` with linear interpolation:
+   NaN members are ignored, and a column with no other members has NaN
+   statistics.
+*/
+struct EnsembleStats
+{
+  /// The mean of each column
+  Eigen::ArrayXd mean;
+  /// The standard deviation of each column
+  Eigen::ArrayXd std;
+  /// The probabilities of the quantiles, in the order requested
+  std::vector<double> probabilities;
+  /// Column `i` holds quantile `probabilities[i]` of each ensemble column
+  Eigen::ArrayXXd quantiles;
+
+  /**
+     @brief Shade the band between two quantiles with `ax.fill_between`
+
+     @param ax The Axes
+     @param x The abscissa of each column
+     @param lower The index in `probabilities` of the lower quantile
+     @param upper The index of the upper quantile
+     @param kwargs Keyword arguments for `fill_between`, such as `alpha`
+     @throw std::out_of_range if an index is out of range
+  */
+  pybind11::object fill_between(pybind11::object ax,
+                                const Eigen::ArrayXd& x,
+                                size_t lower,
+                                size_t upper,
+                                pybind11::dict kwargs = pybind11::dict()) const
+  {
+    if (lower >= probabilities.size() or upper >= probabilities.size()) {
+      throw(std::out_of_range("No such quantile in fill_between()"));
+    }
+    return ax.attr("fill_between")(
+      adopt(Eigen::ArrayXd(x)),
+      adopt(Eigen::ArrayXd(quantiles.col(Eigen::Index(lower)))),
+      adopt(Eigen::ArrayXd(quantiles.col(Eigen::Index(upper)))),
+      **kwargs);
+  }
+};
+
+namespace detail {
+
+/**
+   @private
+   @brief Roughly the number of members given to each thread
+*/
+constexpr Eigen::Index ensemble_grain = 1 << 15;
+
+/**
+   @private
+   @brief Columns per chunk for parallel_for() over an ensemble
+*/
+inline Eigen::Index
+ensemble_columns(Eigen::Index rows)
+{
+  return std::max<Eigen::Index>(
+    1, ensemble_grain / std::max<Eigen::Index>(1, rows));
+}
+
+/**
+   @private
+   @brief The order in which to find quantiles, by increasing probability
+*/
+inline std::vector<size_t>
+quantile_order(const std::vector<double>& probabilities)
+{
+  for (double p : probabilities) {
+    if (not(p >= 0 and p <= 1)) {
+      throw(std::invalid_argument("Quantile probabilities must be in [0, 1]"));
+    }
+  }
+  std::vector<size_t> order(probabilities.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return probabilities[a] < probabilities[b];
+  });
+  return order;
+}
+
+}
+
+/**
+   @brief The mean, standard deviation and quantiles of each column of an
+   ensemble
+
+   Plotting an uncertainty band with `numpy.percentile` means copying the
+   whole ensemble to python and sorting every column on one thread.  Here
+   the quantiles are found by selection (`std::nth_element`), a column per
+   task on num_threads() threads, and only the bands go to matplotlib
+   ```
+   auto stats = mplotpp::ensemble_stats(runs, { 0.05, 0.25, 0.75, 0.95 });
+   stats.fill_between(ax, t, 0, 3, py::dict("alpha"_a = 0.2));
+   stats.fill_between(ax, t, 1, 2, py::dict("alpha"_a = 0.4));
+   ax.attr("plot")(mplotpp::view(t), mplotpp::view(stats.mean));
+   ```
+   The GIL is released while computing.
+
+   @param members One row per ensemble member and one column per abscissa
+   @param probabilities The quantiles to find, each in [0, 1]
+   @param ddof Delta degrees of freedom of the standard deviation, as for
+   `numpy.std`
+   @throw std::invalid_argument if a probability is outside [0, 1]
+*/
+inline EnsembleStats
+ensemble_stats(const Eigen::Ref<const Eigen::ArrayXXd>& members,
+               const std::vector<double>& probabilities,
+               int ddof = 0)
+{
+  auto order = detail::quantile_order(probabilities);
+  const Eigen::Index rows = members.rows();
+  const Eigen::Index cols = members.cols();
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  EnsembleStats stats;
+  stats.mean.resize(cols);
+  stats.std.resize(cols);
+  stats.probabilities = probabilities;
+  stats.quantiles.resize(cols, Eigen::Index(probabilities.size()));
+
+  pybind11::gil_scoped_release release;
+  parallel_for(
+    Eigen::Index(0),
+    cols,
+    detail::ensemble_columns(rows),
+    [&](Eigen::Index first, Eigen::Index last) {
+      std::vector<double> v(static_cast<size_t>(rows));
+      for (Eigen::Index j = first; j < last; ++j) {
+        auto end = std::remove_copy_if(members.col(j).data(),
+                                       members.col(j).data() + rows,
+                                       v.begin(),
+                                       [](double a) { return std::isnan(a); });
+        const auto m = std::distance(v.begin(), end);
+        if (m == 0) {
+          stats.mean(j) = nan;
+          stats.std(j) = nan;
+          stats.quantiles.row(j).setConstant(nan);
+          continue;
+        }
+        const double mean = std::accumulate(v.begin(), end, 0.0) / double(m);
+        double ss = 0;
+        for (auto it = v.begin(); it != end; ++it) {
+          ss += (*it - mean) * (*it - mean);
+        }
+        stats.mean(j) = mean;
+        stats.std(j) = m > ddof ? std::sqrt(ss / double(m - ddof)) : nan;
+
+        // Each selection leaves larger elements after the one selected, so
+        // increasing quantiles search shrinking ranges
+        auto lo = v.begin();
+        for (size_t q : order) {
+          const double h = probabilities[q] * double(m - 1);
+          const auto k = std::ptrdiff_t(std::floor(h));
+          auto kth = v.begin() + k;
+          std::nth_element(lo, kth, end);
+          lo = kth;
+          double a = *kth;
+          double b = kth + 1 < end ? *std::min_element(kth + 1, end) : a;
+          stats.quantiles(j, Eigen::Index(q)) = a + (h - double(k)) * (b - a);
+        }
+      }
+    });
+  return stats;
+}
+
+/**
+   @brief A t-digest, an approximate summary of a distribution giving
+   accurate quantiles, especially in the tails
+
+   This is the merging t-digest of Dunning and Ertl with the arcsine scale
+   function.  Values are buffered and merged into at most about
+   `compression` centroids, so the size of a digest does not depend on the
+   number of values.
+*/
+class TDigest
+{
+public:
+  /// An empty digest.  Larger compressions are more accurate and larger.
+  explicit TDigest(double compression = 100)
+    : compression_(compression)
+    , buffer_limit_(size_t(5 * compression))
+  {}
+
+  /// Add a value.  NaN is ignored.
+  void add(double x, double weight = 1)
+  {
+    if (std::isnan(x)) {
+      return;
+    }
+    buffer_.push_back({ x, weight });
+    min_ = std::min(min_, x);
+    max_ = std::max(max_, x);
+    if (buffer_.size() >= buffer_limit_) {
+      compress();
+    }
+  }
+
+  /// Add the values summarised by another digest
+  void merge(const TDigest& other)
+  {
+    for (const auto& c : other.centroids_) {
+      add(c.mean, c.weight);
+    }
+    for (const auto& c : other.buffer_) {
+      add(c.mean, c.weight);
+    }
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  /// The total weight of the values
+  double count() const
+  {
+    double n = 0;
+    for (const auto& c : centroids_) {
+      n += c.weight;
+    }
+    for (const auto& c : buffer_) {
+      n += c.weight;
+    }
+    return n;
+  }
+
+  /**
+     @brief An estimate of a quantile, exact while every centroid holds one
+     value
+
+     @param p The probability, in [0, 1]
+     @return The quantile, interpolated as `numpy.percentile`, or NaN if the
+     digest is empty
+  */
+  double quantile(double p) const
+  {
+    compress();
+    if (centroids_.empty()) {
+      return std::numeric_limits<double>::quiet_NaN();
+    }
+    // Each centroid sits at the mean rank of its values, between the
+    // smallest value at rank 0 and the largest at rank n - 1
+    const double n = count();
+    const double h = std::clamp(p, 0.0, 1.0) * (n - 1);
+    double rank = 0;
+    double x0 = min_;
+    double r0 = 0;
+    for (const auto& c : centroids_) {
+      const double r = rank + (c.weight - 1) / 2;
+      if (h <= r) {
+        return r > r0 ? x0 + (h - r0) / (r - r0) * (c.mean - x0) : c.mean;
+      }
+      x0 = c.mean;
+      r0 = r;
+      rank += c.weight;
+    }
+    return n - 1 > r0 ? x0 + (h - r0) / (n - 1 - r0) * (max_ - x0) : max_;
+  }
+
+private:
+  struct Centroid
+  {
+    double mean;
+    double weight;
+  };
+
+  static constexpr double pi = 3.14159265358979323846;
+
+  double q_to_k(double q) const
+  {
+    return compression_ / (2 * pi) * std::asin(2 * q - 1);
+  }
+
+  double k_to_q(double k) const
+  {
+    double x = k * 2 * pi / compression_;
+    return x >= pi / 2 ? 1 : (std::sin(x) + 1) / 2;
+  }
+
+  void compress() const
+  {
+    if (buffer_.empty()) {
+      return;
+    }
+    buffer_.insert(buffer_.end(), centroids_.begin(), centroids_.end());
+    std::sort(buffer_.begin(), buffer_.end(), [](const auto& a, const auto& b) {
+      return a.mean < b.mean;
+    });
+    double total = 0;
+    for (const auto& c : buffer_) {
+      total += c.weight;
+    }
+    centroids_.clear();
+    Centroid current = buffer_.front();
+    double before = 0;
+    double limit = k_to_q(q_to_k(0) + 1) * total;
+    for (size_t i = 1; i < buffer_.size(); ++i) {
+      const Centroid& c = buffer_[i];
+      if (before + current.weight + c.weight <= limit) {
+        current.weight += c.weight;
+        current.mean += (c.mean - current.mean) * c.weight / current.weight;
+      } else {
+        before += current.weight;
+        centroids_.push_back(current);
+        limit = k_to_q(q_to_k(before / total) + 1) * total;
+        current = c;
+      }
+    }
+    centroids_.push_back(current);
+    buffer_.clear();
+  }
+
+  double compression_;
+  size_t buffer_limit_;
+  // Buffered values are merged lazily, including by quantile()
+  mutable std::vector<Centroid> centroids_;
+  mutable std::vector<Centroid> buffer_;
+  double min_ = std::numeric_limits<double>::infinity();
+  double max_ = -std::numeric_limits<double>::infinity();
+};
+
+/**
+   @brief Statistics of an ensemble given a block of members at a time
+
+   For ensembles too large to hold in memory, each column keeps running
+   moments and a TDigest, so the mean and standard deviation are exact and
+   quantiles are approximate, with the largest errors near the median
+   ```
+   mplotpp::StreamingEnsemble ensemble(t.size());
+   while (auto block = next_runs()) {
+     ensemble.add(*block);
+   }
+   auto stats = ensemble.stats({ 0.01, 0.5, 0.99 });
+   ```
+   Columns are updated in parallel and the GIL is released while adding.
+*/
+class StreamingEnsemble
+{
+public:
+  /**
+     @param columns The number of columns of each member
+     @param compression The compression of each TDigest
+  */
+  explicit StreamingEnsemble(Eigen::Index columns, double compression = 100)
+    : digests_(size_t(columns), TDigest(compression))
+    , count_(Eigen::ArrayXd::Zero(columns))
+    , mean_(Eigen::ArrayXd::Zero(columns))
+    , m2_(Eigen::ArrayXd::Zero(columns))
+  {}
+
+  /**
+     @brief Add members
+
+     @param members One row per member and one column per abscissa
+     @throw std::invalid_argument if the number of columns differs
+  */
+  void add(const Eigen::Ref<const Eigen::ArrayXXd>& members)
+  {
+    if (members.cols() != mean_.size()) {
+      throw(std::invalid_argument("Wrong number of columns in ensemble"));
+    }
+    pybind11::gil_scoped_release release;
+    parallel_for(Eigen::Index(0),
+                 members.cols(),
+                 detail::ensemble_columns(members.rows()),
+                 [&](Eigen::Index first, Eigen::Index last) {
+                   for (Eigen::Index j = first; j < last; ++j) {
+                     auto& digest = digests_[size_t(j)];
+                     for (Eigen::Index i = 0; i < members.rows(); ++i) {
+                       const double x = members(i, j);
+                       if (std::isnan(x)) {
+                         continue;
+                       }
+                       // Welford's update of the mean and squared deviations
+                       count_(j) += 1;
+                       const double d = x - mean_(j);
+                       mean_(j) += d / count_(j);
+                       m2_(j) += d * (x - mean_(j));
+                       digest.add(x);
+                     }
+                   }
+                 });
+  }
+
+  /**
+     @brief Add the members summarised by another StreamingEnsemble
+
+     @throw std::invalid_argument if the number of columns differs
+  */
+  void merge(const StreamingEnsemble& other)
+  {
+    if (other.mean_.size() != mean_.size()) {
+      throw(std::invalid_argument("Wrong number of columns in ensemble"));
+    }
+    for (Eigen::Index j = 0; j < mean_.size(); ++j) {
+      const double n = count_(j) + other.count_(j);
+      if (n == 0) {
+        continue;
+      }
+      const double d = other.mean_(j) - mean_(j);
+      m2_(j) += other.m2_(j) + d * d * count_(j) * other.count_(j) / n;
+      mean_(j) += d * other.count_(j) / n;
+      count_(j) = n;
+      digests_[size_t(j)].merge(other.digests_[size_t(j)]);
+    }
+  }
+
+  /// The number of members that are not NaN in each column
+  const Eigen::ArrayXd& count() const { return count_; }
+
+  /**
+     @brief The statistics of the members added so far
+
+     @param probabilities The quantiles to estimate, each in [0, 1]
+     @param ddof Delta degrees of freedom of the standard deviation
+     @throw std::invalid_argument if a probability is outside [0, 1]
+  */
+  EnsembleStats stats(const std::vector<double>& probabilities,
+                      int ddof = 0) const
+  {
+    detail::quantile_order(probabilities);
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const Eigen::Index cols = mean_.size();
+    EnsembleStats stats;
+    stats.mean = (count_ > 0).select(mean_, nan);
+    stats.std = (count_ > ddof).select((m2_ / (count_ - ddof)).sqrt(), nan);
+    stats.probabilities = probabilities;
+    stats.quantiles.resize(cols, Eigen::Index(probabilities.size()));
+    for (Eigen::Index j = 0; j < cols; ++j) {
+      for (size_t q = 0; q < probabilities.size(); ++q) {
+        stats.quantiles(j, Eigen::Index(q)) =
+          digests_[size_t(j)].quantile(probabilities[q]);
+      }
+    }
+    return stats;
+  }
+
+private:
+  std::vector<TDigest> digests_;
+  Eigen::ArrayXd count_;
+  Eigen::ArrayXd mean_;
+  Eigen::ArrayXd m2_;
+};
+
+}
@@ -0,0 +1,128 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <type_traits>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief Tile dimensions used by grid_eval().  A tile row of x-coordinates
+   and results fits comfortably in the L1 cache.
+*/
+constexpr Eigen::Index grid_tile_cols = 1024;
+constexpr Eigen::Index grid_tile_rows = 16;
+
+}
+
+/**
+   @brief Evaluate a function over a tensor-product grid in a single fused
+   pass, writing directly into a numpy array.
+
+   This replaces the pattern
+   ```
+   auto [X, Y] = mplotpp::meshgrid(x, y);
+   auto Z = (X.pow(2) + Y.pow(2)).sqrt().sin();
+   ```
+   which materialises X, Y and any intermediate arrays, and is evaluated on a
+   single thread.  Instead
+   ```
+   auto Z = mplotpp::grid_eval(x, y, [](const auto& X, const auto& Y) {
+     return (X.pow(2) + Y.pow(2)).sqrt().sin();
+   });
+   ```
+   evaluates the expression tile by tile using parallel_for() and returns a
+   numpy array that can be passed straight to `contourf`, `plot_surface` or
+   `imshow`.
+
+   The function is called with two Eigen array expressions of equal length
+   holding a segment of one grid row: the first is a segment of `x` and the
+   second is the corresponding `y` value repeated.  It must return an Eigen
+   array expression of the same length.  Since the arguments are Eigen
+   expressions the evaluation is vectorised by Eigen wherever the operations
+   used support it.  The function is called concurrently from several
+   threads and must not use the python interpreter.
+
+   The GIL is released while the grid is evaluated.
+
+   @tparam T The coordinate data type
+   @tparam F The type of the function
+   @param x A 1-D array representing the x-coordinates of the grid
+   @param y A 1-D array representing the y-coordinates of the grid
+   @param f The function to evaluate
+   @return A C-contiguous numpy array of size MxN where M is the length of y
+   and N is the length of x, with element `[i, j]` holding `f(x[j], y[i])`.
+   The element type is the scalar type of the expression returned by `f`.
+*/
+template<class T, class F>
+auto
+grid_eval(const Eigen::Array<T, Eigen::Dynamic, 1>& x,
+          const Eigen::Array<T, Eigen::Dynamic, 1>& y,
+          F&& f)
+{
+  using Vector = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using XSegment = Eigen::Map<const Vector>;
+  using YSegment = decltype(Vector::Constant(1, T()));
+  using Expr = std::decay_t<decltype(f(std::declval<const XSegment&>(),
+                                       std::declval<const YSegment&>()))>;
+  using R = typename Expr::Scalar;
+
+  const Eigen::Index M = y.size();
+  const Eigen::Index N = x.size();
+  pybind11::array_t<R> result({ ssize_t(M), ssize_t(N) });
+  R* out = result.mutable_data();
+
+  const Eigen::Index row_tiles =
+    (M + detail::grid_tile_rows - 1) / detail::grid_tile_rows;
+  const Eigen::Index col_tiles =
+    (N + detail::grid_tile_cols - 1) / detail::grid_tile_cols;
+
+  pybind11::gil_scoped_release release;
+  parallel_for(
+    Eigen::Index(0),
+    row_tiles * col_tiles,
+    Eigen::Index(1),
+    [&](Eigen::Index first, Eigen::Index last) {
+      for (Eigen::Index tile = first; tile < last; ++tile) {
+        Eigen::Index i0 = (tile / col_tiles) * detail::grid_tile_rows;
+        Eigen::Index j0 = (tile % col_tiles) * detail::grid_tile_cols;
+        Eigen::Index i1 = std::min(M, i0 + detail::grid_tile_rows);
+        Eigen::Index n = std::min(N, j0 + detail::grid_tile_cols) - j0;
+        XSegment xs(x.data() + j0, n);
+        for (Eigen::Index i = i0; i < i1; ++i) {
+          Eigen::Map<Eigen::Array<R, Eigen::Dynamic, 1>> row(
+            out + i * N + j0, n);
+          row = f(xs, Vector::Constant(n, y.coeff(i)));
+        }
+      }
+    });
+
+  return result;
+}
+
+/**
+   @brief Evaluate a function over the grid described by a GridView
+
+   Equivalent to `grid_eval(grid.x(), grid.y(), f)`, so that the returned
+   array can be plotted against `grid.pyX()` and `grid.pyY()`.
+
+   @tparam T The coordinate data type
+   @tparam F The type of the function
+   @param grid The grid
+   @param f The function to evaluate
+   @return A C-contiguous MxN numpy array, as for grid_eval()
+*/
+template<class T, class F>
+auto
+grid_eval(const GridView<T>& grid, F&& f)
+{
+  return grid_eval(grid.x(), grid.y(), std::forward<F>(f));
+}
+
+}
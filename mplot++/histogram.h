@@ -0,0 +1,584 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief Number of values whose bin indices are computed together
+*/
+constexpr Eigen::Index histogram_block = 256;
+
+/**
+   @private
+   @brief Minimum number of values given to each thread
+*/
+constexpr Eigen::Index histogram_grain = 1 << 16;
+
+/**
+   @private
+   @brief Count `n` values in parallel.
+
+   The values are split into one contiguous part per thread.  Each part is
+   counted by `count(counts, first, last)` into its own zeroed copy of
+   `bins` counts, and the copies are added in order, so the result does not
+   depend on timing.  A single part is counted directly into `total`.
+*/
+template<class F>
+void
+count_parallel(Eigen::Index n, double* total, Eigen::Index bins, F&& count)
+{
+  Eigen::Index parts = std::min<Eigen::Index>(
+    num_threads(), (n + histogram_grain - 1) / histogram_grain);
+  if (parts <= 1) {
+    count(total, Eigen::Index(0), n);
+    return;
+  }
+  Eigen::ArrayXXd partial = Eigen::ArrayXXd::Zero(bins, parts);
+  parallel_for(Eigen::Index(0),
+               parts,
+               Eigen::Index(1),
+               [&](Eigen::Index first, Eigen::Index last) {
+                 for (Eigen::Index p = first; p < last; ++p) {
+                   count(partial.col(p).data(),
+                         n * p / parts,
+                         n * (p + 1) / parts);
+                 }
+               });
+  Eigen::Map<Eigen::ArrayXd>(total, bins) += partial.rowwise().sum();
+}
+
+}
+
+/**
+   @brief Equal-width bins on a linear or logarithmic axis
+*/
+class Bins
+{
+public:
+  /**
+     @brief Bins of equal width
+
+     @param lo The lower edge of the first bin
+     @param hi The upper edge of the last bin
+     @param n The number of bins
+     @throw std::invalid_argument unless `lo < hi` and `n > 0`
+  */
+  static Bins linear(double lo, double hi, Eigen::Index n)
+  {
+    return Bins(lo, hi, n, false);
+  }
+
+  /**
+     @brief Bins of equal width in the logarithm of the value
+
+     @param lo The lower edge of the first bin, which is positive
+     @param hi The upper edge of the last bin
+     @param n The number of bins
+     @throw std::invalid_argument unless `0 < lo < hi` and `n > 0`
+  */
+  static Bins log(double lo, double hi, Eigen::Index n)
+  {
+    if (not(lo > 0)) {
+      throw(std::invalid_argument("Logarithmic bins must be positive"));
+    }
+    return Bins(lo, hi, n, true);
+  }
+
+  /// The number of bins
+  Eigen::Index size() const { return n_; }
+
+  /// Whether the bins are logarithmic
+  bool logarithmic() const { return log_; }
+
+  /// The lower edge of the first bin
+  double lo() const { return lo_; }
+
+  /// The upper edge of the last bin
+  double hi() const { return hi_; }
+
+  /**
+     @brief The `size() + 1` bin edges, as given by `numpy.linspace` or
+     `numpy.geomspace`
+  */
+  Eigen::ArrayXd edges() const { return edges_; }
+
+  /**
+     @brief Compute the bin of every value of a block.  Values outside the
+     bins, and NaN, give -1.  The upper edge belongs to the last bin.
+
+     The bin is first computed arithmetically, which is vectorised, and then
+     moved by one if rounding put it on the wrong side of an edge, as
+     `numpy.histogram` does, so a value on an edge is in the bin above it.
+
+     @param v The values
+     @param index The bin indices, of the same size
+  */
+  template<class Dv>
+  void index(const Eigen::ArrayBase<Dv>& v, Eigen::ArrayXi& index) const
+  {
+    Eigen::ArrayXd t = log_ ? Eigen::ArrayXd(v.log10()) : Eigen::ArrayXd(v);
+    t = ((t - a_) * scale_).floor().max(0.0).min(double(n_ - 1));
+    index = (v >= lo_ and v <= hi_).select(t, -1.0).template cast<int>();
+    for (Eigen::Index k = 0; k < index.size(); ++k) {
+      int& i = index(k);
+      if (i < 0) {
+        continue;
+      }
+      if (v(k) < edges_(i)) {
+        --i;
+      } else if (v(k) >= edges_(i + 1) and i != n_ - 1) {
+        ++i;
+      }
+    }
+  }
+
+private:
+  Bins(double lo, double hi, Eigen::Index n, bool log)
+    : lo_(lo)
+    , hi_(hi)
+    , n_(n)
+    , log_(log)
+  {
+    if (not(lo < hi) or n <= 0) {
+      throw(std::invalid_argument("Bins need lo < hi and at least one bin"));
+    }
+    a_ = log ? std::log10(lo) : lo;
+    const double b = log ? std::log10(hi) : hi;
+    scale_ = double(n) / (b - a_);
+    // As numpy computes them, with the outer edges exact
+    const double step = (b - a_) / double(n);
+    edges_.resize(n + 1);
+    for (Eigen::Index i = 0; i <= n; ++i) {
+      edges_(i) = double(i) * step + a_;
+    }
+    if (log) {
+      edges_ = Eigen::pow(10.0, edges_);
+    }
+    edges_(0) = lo;
+    edges_(n) = hi;
+  }
+
+  double lo_;
+  double hi_;
+  Eigen::Index n_;
+  bool log_;
+  double a_;
+  double scale_;
+  Eigen::ArrayXd edges_;
+};
+
+/**
+   @brief A 1-D histogram filled in parallel, possibly in several batches.
+
+   Telemetry too large to pass to `hist` is counted in `c++` and only the
+   counts are handed to matplotlib
+   ```
+   mplotpp::Histogram hist(mplotpp::Bins::log(1e-6, 1e3, 200));
+   while (auto batch = next_batch()) {
+     hist.add(*batch);
+   }
+   hist.stairs(ax);
+   ax.attr("set_xscale")("log");
+   ```
+   Bin indices are computed a block at a time with Eigen, so the arithmetic
+   is vectorised, and every thread counts into its own partial histogram.
+   The GIL is released while counting.
+*/
+class Histogram
+{
+public:
+  /// An empty histogram with the given bins
+  explicit Histogram(Bins bins)
+    : bins_(bins)
+    , counts_(Eigen::ArrayXd::Zero(bins.size()))
+  {}
+
+  /**
+     @brief Count values.  Values outside the bins are ignored.
+
+     @param x The values
+  */
+  void add(const Eigen::Ref<const Eigen::ArrayXd>& x)
+  {
+    pybind11::gil_scoped_release release;
+    detail::count_parallel(
+      x.size(),
+      counts_.data(),
+      bins_.size(),
+      [&](double* counts, Eigen::Index first, Eigen::Index last) {
+        Eigen::ArrayXi index;
+        for (Eigen::Index i = first; i < last; i += detail::histogram_block) {
+          auto n = std::min(detail::histogram_block, last - i);
+          bins_.index(x.segment(i, n), index);
+          for (Eigen::Index k = 0; k < n; ++k) {
+            if (index(k) >= 0) {
+              counts[index(k)] += 1;
+            }
+          }
+        }
+      });
+  }
+
+  /**
+     @brief Add the counts of a histogram with the same bins
+
+     @throw std::invalid_argument if the number of bins differs
+  */
+  void merge(const Histogram& other)
+  {
+    if (other.counts_.size() != counts_.size()) {
+      throw(std::invalid_argument("Histograms have different bins"));
+    }
+    counts_ += other.counts_;
+  }
+
+  /// Reset all counts to zero
+  void clear() { counts_.setZero(); }
+
+  /// The bins
+  const Bins& bins() const { return bins_; }
+
+  /// The count of every bin
+  const Eigen::ArrayXd& counts() const { return counts_; }
+
+  /**
+     @brief Draw the histogram as a step line with `ax.stairs`
+
+     @param ax The Axes
+     @param kwargs Keyword arguments for `stairs`
+  */
+  pybind11::object stairs(pybind11::object ax,
+                          pybind11::dict kwargs = pybind11::dict()) const
+  {
+    return ax.attr("stairs")(
+      adopt(Eigen::ArrayXd(counts_)), adopt(bins_.edges()), **kwargs);
+  }
+
+  /**
+     @brief Draw the histogram as bars with `ax.bar`
+
+     @param ax The Axes
+     @param kwargs Keyword arguments for `bar`
+  */
+  pybind11::object bar(pybind11::object ax,
+                       pybind11::dict kwargs = pybind11::dict()) const
+  {
+    Eigen::ArrayXd edges = bins_.edges();
+    Eigen::ArrayXd width = edges.tail(bins_.size()) - edges.head(bins_.size());
+    return ax.attr("bar")(adopt(Eigen::ArrayXd(edges.head(bins_.size()))),
+                          adopt(Eigen::ArrayXd(counts_)),
+                          pybind11::arg("width") = adopt(std::move(width)),
+                          pybind11::arg("align") = "edge",
+                          **kwargs);
+  }
+
+private:
+  Bins bins_;
+  Eigen::ArrayXd counts_;
+};
+
+/**
+   @brief A 2-D histogram filled in parallel, possibly in several batches.
+
+   The counts form an image with one row per y bin, drawn with imshow() for
+   linear bins or pcolormesh() for any bins
+   ```
+   mplotpp::Histogram2D density(mplotpp::Bins::linear(0, 1, 1000),
+                                mplotpp::Bins::linear(-5, 5, 800));
+   density.add(x, y);
+   density.imshow(ax, py::dict("norm"_a = "log"));
+   ```
+   The GIL is released while counting.
+*/
+class Histogram2D
+{
+public:
+  /// An empty histogram with the given bins
+  Histogram2D(Bins xbins, Bins ybins)
+    : xbins_(xbins)
+    , ybins_(ybins)
+    , counts_(Eigen::ArrayXXd::Zero(ybins.size(), xbins.size()))
+  {}
+
+  /**
+     @brief Count points.  Points outside the bins are ignored.
+
+     @param x The abscissas of the points
+     @param y The ordinates, of the same size
+     @throw std::invalid_argument if the sizes differ
+  */
+  void add(const Eigen::Ref<const Eigen::ArrayXd>& x,
+           const Eigen::Ref<const Eigen::ArrayXd>& y)
+  {
+    if (x.size() != y.size()) {
+      throw(std::invalid_argument("x and y sizes differ in add()"));
+    }
+    pybind11::gil_scoped_release release;
+    const Eigen::Index ny = ybins_.size();
+    detail::count_parallel(
+      x.size(),
+      counts_.data(),
+      counts_.size(),
+      [&](double* counts, Eigen::Index first, Eigen::Index last) {
+        Eigen::ArrayXi ix;
+        Eigen::ArrayXi iy;
+        for (Eigen::Index i = first; i < last; i += detail::histogram_block) {
+          auto n = std::min(detail::histogram_block, last - i);
+          xbins_.index(x.segment(i, n), ix);
+          ybins_.index(y.segment(i, n), iy);
+          for (Eigen::Index k = 0; k < n; ++k) {
+            if (ix(k) >= 0 and iy(k) >= 0) {
+              counts[iy(k) + ny * ix(k)] += 1;
+            }
+          }
+        }
+      });
+  }
+
+  /**
+     @brief Add the counts of a histogram with the same bins
+
+     @throw std::invalid_argument if the number of bins differs
+  */
+  void merge(const Histogram2D& other)
+  {
+    if (other.counts_.rows() != counts_.rows() or
+        other.counts_.cols() != counts_.cols()) {
+      throw(std::invalid_argument("Histograms have different bins"));
+    }
+    counts_ += other.counts_;
+  }
+
+  /// Reset all counts to zero
+  void clear() { counts_.setZero(); }
+
+  /// The bins along x
+  const Bins& xbins() const { return xbins_; }
+
+  /// The bins along y
+  const Bins& ybins() const { return ybins_; }
+
+  /// The counts, with one row per y bin and one column per x bin
+  const Eigen::ArrayXXd& counts() const { return counts_; }
+
+  /**
+     @brief Draw the counts with `ax.imshow`, which needs linear bins
+
+     @param ax The Axes
+     @param kwargs Keyword arguments for `imshow`
+     @throw std::logic_error if either bins are logarithmic
+  */
+  pybind11::object imshow(pybind11::object ax,
+                          pybind11::dict kwargs = pybind11::dict()) const
+  {
+    if (xbins_.logarithmic() or ybins_.logarithmic()) {
+      throw(std::logic_error("imshow() needs linear bins, use pcolormesh()"));
+    }
+    return ax.attr("imshow")(
+      adopt(Eigen::ArrayXXd(counts_)),
+      pybind11::arg("origin") = "lower",
+      pybind11::arg("aspect") = "auto",
+      pybind11::arg("extent") = pybind11::make_tuple(
+        xbins_.lo(), xbins_.hi(), ybins_.lo(), ybins_.hi()),
+      **kwargs);
+  }
+
+  /**
+     @brief Draw the counts with `ax.pcolormesh`
+
+     @param ax The Axes
+     @param kwargs Keyword arguments for `pcolormesh`
+  */
+  pybind11::object pcolormesh(pybind11::object ax,
+                              pybind11::dict kwargs = pybind11::dict()) const
+  {
+    return ax.attr("pcolormesh")(adopt(xbins_.edges()),
+                                 adopt(ybins_.edges()),
+                                 adopt(Eigen::ArrayXXd(counts_)),
+                                 **kwargs);
+  }
+
+private:
+  Bins xbins_;
+  Bins ybins_;
+  Eigen::ArrayXXd counts_;
+};
+
+/**
+   @brief Hexagonal binning, matching the layout of matplotlib's `hexbin`
+
+   The hexagons lie on two interleaved rectangular lattices, as in `hexbin`,
+   and each point is counted in the hexagon with the nearest centre.  Only
+   the centres of occupied hexagons and their counts are handed to
+   matplotlib
+   ```
+   mplotpp::Hexbin hex(xmin, xmax, ymin, ymax, 100);
+   hex.add(x, y);
+   hex.plot(ax, py::dict("cmap"_a = "inferno", "bins"_a = "log"));
+   ```
+   The GIL is released while counting.
+*/
+class Hexbin
+{
+public:
+  /**
+     @brief An empty hexagonal histogram
+
+     @param xmin The lower x limit
+     @param xmax The upper x limit
+     @param ymin The lower y limit
+     @param ymax The upper y limit
+     @param gridsize The number of hexagons along x
+     @throw std::invalid_argument if the limits are empty or gridsize is not
+     positive
+  */
+  Hexbin(double xmin, double xmax, double ymin, double ymax, int gridsize = 100)
+    : xmin_(xmin)
+    , xmax_(xmax)
+    , ymin_(ymin)
+    , ymax_(ymax)
+    , nx_(gridsize)
+    , ny_(int(gridsize / std::sqrt(3.0)))
+  {
+    if (not(xmin < xmax and ymin < ymax) or gridsize <= 0) {
+      throw(std::invalid_argument("Hexbin needs non-empty limits"));
+    }
+    ny_ = std::max(ny_, 1);
+    sx_ = (xmax - xmin) / nx_;
+    sy_ = (ymax - ymin) / ny_;
+    counts_ = Eigen::ArrayXd::Zero((nx_ + 1) * (ny_ + 1) + nx_ * ny_);
+  }
+
+  /**
+     @brief Count points.  Points outside the limits are ignored.
+
+     @param x The abscissas of the points
+     @param y The ordinates, of the same size
+     @throw std::invalid_argument if the sizes differ
+  */
+  void add(const Eigen::Ref<const Eigen::ArrayXd>& x,
+           const Eigen::Ref<const Eigen::ArrayXd>& y)
+  {
+    if (x.size() != y.size()) {
+      throw(std::invalid_argument("x and y sizes differ in add()"));
+    }
+    pybind11::gil_scoped_release release;
+    const int n1 = (nx_ + 1) * (ny_ + 1);
+    detail::count_parallel(
+      x.size(),
+      counts_.data(),
+      counts_.size(),
+      [&](double* counts, Eigen::Index first, Eigen::Index last) {
+        Eigen::ArrayXd u;
+        Eigen::ArrayXd v;
+        Eigen::ArrayXd d1;
+        Eigen::ArrayXd d2;
+        for (Eigen::Index i = first; i < last; i += detail::histogram_block) {
+          auto n = std::min(detail::histogram_block, last - i);
+          auto xs = x.segment(i, n);
+          auto ys = y.segment(i, n);
+          u = (xs - xmin_) / sx_;
+          v = (ys - ymin_) / sy_;
+          d1 = (u - u.round()).square() + 3 * (v - v.round()).square();
+          d2 = (u - u.floor() - 0.5).square() +
+               3 * (v - v.floor() - 0.5).square();
+          for (Eigen::Index k = 0; k < n; ++k) {
+            if (not(xs(k) >= xmin_ and xs(k) <= xmax_ and ys(k) >= ymin_ and
+                    ys(k) <= ymax_)) {
+              continue;
+            }
+            if (d1(k) < d2(k)) {
+              int ix = int(std::round(u(k)));
+              int iy = int(std::round(v(k)));
+              counts[ix * (ny_ + 1) + iy] += 1;
+            } else {
+              int ix = std::min(int(u(k)), nx_ - 1);
+              int iy = std::min(int(v(k)), ny_ - 1);
+              counts[n1 + ix * ny_ + iy] += 1;
+            }
+          }
+        }
+      });
+  }
+
+  /// Reset all counts to zero
+  void clear() { counts_.setZero(); }
+
+  /// The number of hexagons along x and y
+  std::pair<int, int> gridsize() const { return { nx_, ny_ }; }
+
+  /**
+     @brief The centres and counts of the occupied hexagons
+
+     @return The abscissas, ordinates and counts
+  */
+  std::tuple<Eigen::ArrayXd, Eigen::ArrayXd, Eigen::ArrayXd> occupied() const
+  {
+    const int n1 = (nx_ + 1) * (ny_ + 1);
+    Eigen::Index n = (counts_ > 0).count();
+    Eigen::ArrayXd cx(n);
+    Eigen::ArrayXd cy(n);
+    Eigen::ArrayXd c(n);
+    Eigen::Index k = 0;
+    for (int h = 0; h < counts_.size(); ++h) {
+      if (counts_(h) > 0) {
+        bool second = h >= n1;
+        int r = second ? h - n1 : h;
+        int rows = second ? ny_ : ny_ + 1;
+        double offset = second ? 0.5 : 0.0;
+        cx(k) = xmin_ + (r / rows + offset) * sx_;
+        cy(k) = ymin_ + (r % rows + offset) * sy_;
+        c(k++) = counts_(h);
+      }
+    }
+    return { cx, cy, c };
+  }
+
+  /**
+     @brief Draw the occupied hexagons with `ax.hexbin`
+
+     @param ax The Axes
+     @param kwargs Keyword arguments for `hexbin`, such as `cmap` or `bins`
+  */
+  pybind11::object plot(pybind11::object ax,
+                        pybind11::dict kwargs = pybind11::dict()) const
+  {
+    auto [cx, cy, c] = occupied();
+    auto np = pybind11::module_::import("numpy");
+    return ax.attr("hexbin")(
+      adopt(std::move(cx)),
+      adopt(std::move(cy)),
+      pybind11::arg("C") = adopt(std::move(c)),
+      pybind11::arg("gridsize") = pybind11::make_tuple(nx_, ny_),
+      pybind11::arg("extent") =
+        pybind11::make_tuple(xmin_, xmax_, ymin_, ymax_),
+      pybind11::arg("reduce_C_function") = np.attr("sum"),
+      **kwargs);
+  }
+
+private:
+  double xmin_;
+  double xmax_;
+  double ymin_;
+  double ymax_;
+  int nx_;
+  int ny_;
+  double sx_;
+  double sy_;
+  Eigen::ArrayXd counts_;
+};
+
+}
@@ -0,0 +1,538 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <memory>
+#include <mplot++/mplot++.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief Throw std::runtime_error describing the current value of errno
+*/
+[[noreturn]] inline void
+throw_errno(const std::string& what, const std::string& path)
+{
+  throw(std::runtime_error(what + " " + path + ": " + std::strerror(errno)));
+}
+
+/**
+   @private
+   @brief RAII wrapper around a POSIX memory mapping of a whole file
+
+   Mappings are `MAP_SHARED`, so every process and every mapping of the same
+   file sees the same pages, and writes to a writable mapping go to the file.
+*/
+class MappedFile
+{
+public:
+  MappedFile() = default;
+
+  /**
+     @brief Map an existing file
+
+     @param path The file name
+     @param writable If true the mapping may be written to
+     @throw std::runtime_error if the file cannot be opened or mapped
+  */
+  static MappedFile open(const std::string& path, bool writable = false)
+  {
+    int fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+      throw_errno("Cannot open", path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw_errno("Cannot stat", path);
+    }
+    return MappedFile(fd, size_t(st.st_size), writable, path);
+  }
+
+  /**
+     @brief Create, or truncate, a file of the given size and map it writable
+
+     @param path The file name
+     @param size The size of the file in bytes
+     @throw std::runtime_error if the file cannot be created or mapped
+  */
+  static MappedFile create(const std::string& path, size_t size)
+  {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      throw_errno("Cannot create", path);
+    }
+    if (::ftruncate(fd, off_t(size)) != 0) {
+      ::close(fd);
+      throw_errno("Cannot resize", path);
+    }
+    return MappedFile(fd, size, true, path);
+  }
+
+  MappedFile(MappedFile&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr))
+    , size_(std::exchange(other.size_, 0))
+    , writable_(other.writable_)
+  {}
+
+  MappedFile& operator=(MappedFile&& other) noexcept
+  {
+    if (this != &other) {
+      unmap();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+      writable_ = other.writable_;
+    }
+    return *this;
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() { unmap(); }
+
+  /// Start of the mapping, or nullptr for an empty file
+  const char* data() const { return static_cast<const char*>(data_); }
+
+  /// Start of a writable mapping, or nullptr for an empty file
+  char* data() { return static_cast<char*>(data_); }
+
+  /// Size of the mapping in bytes
+  size_t size() const { return size_; }
+
+  /// Whether the mapping may be written to
+  bool writable() const { return writable_; }
+
+  /// Advise the kernel of the expected access pattern, e.g. `MADV_SEQUENTIAL`
+  void advise(int advice) const
+  {
+    if (data_ != nullptr) {
+      ::madvise(data_, size_, advice);
+    }
+  }
+
+  /// Write modified pages of a writable mapping back to the file
+  void sync() const
+  {
+    if (data_ != nullptr and writable_) {
+      ::msync(data_, size_, MS_SYNC);
+    }
+  }
+
+private:
+  MappedFile(int fd, size_t size, bool writable, const std::string& path)
+    : size_(size)
+    , writable_(writable)
+  {
+    if (size > 0) {
+      int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+      void* p = ::mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw_errno("Cannot map", path);
+      }
+      data_ = p;
+    }
+    // The mapping remains valid after the descriptor is closed
+    ::close(fd);
+  }
+
+  void unmap()
+  {
+    if (data_ != nullptr) {
+      ::munmap(data_, size_);
+      data_ = nullptr;
+    }
+  }
+
+  void* data_ = nullptr;
+  size_t size_ = 0;
+  bool writable_ = false;
+};
+
+/**
+   @private
+   @brief numpy-style kind character of an arithmetic type
+*/
+template<class T>
+constexpr char
+kind_of()
+{
+  return std::is_same<T, bool>::value       ? 'b'
+         : std::is_floating_point<T>::value ? 'f'
+         : std::is_signed<T>::value         ? 'i'
+                                            : 'u';
+}
+
+/**
+   @private
+   @brief Whether the host is little-endian
+*/
+inline bool
+little_endian()
+{
+  const uint16_t one = 1;
+  unsigned char first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+/**
+   @private
+   @brief The parts of a `.npy` header needed to map its data
+*/
+struct NpyHeader
+{
+  char byteorder = '|';
+  char kind = 0;
+  size_t itemsize = 0;
+  bool fortran_order = false;
+  std::vector<ssize_t> shape;
+  size_t data_offset = 0;
+};
+
+/**
+   @private
+   @brief Parse the header of a `.npy` file (format versions 1 to 3)
+
+   @throw std::runtime_error if the header is not understood
+*/
+inline NpyHeader
+parse_npy_header(const char* data, size_t size, const std::string& path)
+{
+  auto fail = [&](const std::string& why) {
+    throw(std::runtime_error(path + ": " + why));
+  };
+  if (size < 10 or std::memcmp(data, "\x93NUMPY", 6) != 0) {
+    fail("not a .npy file");
+  }
+  unsigned major = static_cast<unsigned char>(data[6]);
+  size_t length = 0;
+  size_t start = 0;
+  if (major == 1) {
+    length = size_t(static_cast<unsigned char>(data[8])) |
+             size_t(static_cast<unsigned char>(data[9])) << 8;
+    start = 10;
+  } else if (major == 2 or major == 3) {
+    if (size < 12) {
+      fail("truncated .npy header");
+    }
+    for (int i = 3; i >= 0; --i) {
+      length = length << 8 | static_cast<unsigned char>(data[8 + i]);
+    }
+    start = 12;
+  } else {
+    fail("unsupported .npy format version " + std::to_string(major));
+  }
+  if (start + length > size) {
+    fail("truncated .npy header");
+  }
+
+  NpyHeader header;
+  header.data_offset = start + length;
+  std::string dict(data + start, length);
+  auto value_of = [&](const std::string& key) {
+    auto pos = dict.find("'" + key + "'");
+    if (pos == std::string::npos) {
+      fail("missing '" + key + "' in .npy header");
+    }
+    pos = dict.find(':', pos);
+    if (pos != std::string::npos) {
+      pos = dict.find_first_not_of(' ', pos + 1);
+    }
+    if (pos == std::string::npos) {
+      fail("malformed .npy header");
+    }
+    return dict.substr(pos);
+  };
+  // The leading integer of `s`, setting `used` to the characters read
+  auto integer = [&](const std::string& s, size_t& used) {
+    long long n = 0;
+    try {
+      n = std::stoll(s, &used);
+    } catch (std::logic_error&) {
+      fail("malformed number in .npy header");
+    }
+    if (n < 0) {
+      fail("negative number in .npy header");
+    }
+    return n;
+  };
+
+  std::string descr = value_of("descr");
+  if (descr.size() < 4 or descr[0] != '\'') {
+    fail("unsupported dtype in .npy header");
+  }
+  header.byteorder = descr[1];
+  header.kind = descr[2];
+  size_t used = 0;
+  header.itemsize = size_t(integer(descr.substr(3), used));
+
+  header.fortran_order = value_of("fortran_order").compare(0, 4, "True") == 0;
+
+  std::string shape = value_of("shape");
+  if (shape.empty() or shape[0] != '(') {
+    fail("malformed shape in .npy header");
+  }
+  size_t pos = 1;
+  while (true) {
+    pos = shape.find_first_not_of(" ,", pos);
+    if (pos == std::string::npos) {
+      fail("malformed shape in .npy header");
+    }
+    if (shape[pos] == ')') {
+      break;
+    }
+    header.shape.push_back(ssize_t(integer(shape.substr(pos), used)));
+    pos += used;
+  }
+  return header;
+}
+
+}
+
+/**
+   @brief A numeric array backed by a memory-mapped file
+
+   A mapped_array maps a raw binary file, or the data of a `.npy` file, with
+   `MAP_SHARED` semantics instead of reading it.  Opening even a very large
+   file is therefore immediate, and only the pages that are actually touched
+   are read from disk.  The same pages can be used from `c++` through
+   `Eigen::Map` and from python through a numpy array that does not copy
+   them, so plotting a slice of a huge capture costs only the slice
+   ```
+   auto capture = mplotpp::mapped_array<float>::npy("capture.npy");
+   auto samples = capture.numpy();
+   ax.attr("plot")(samples[py::slice(1000000, 1100000, 1)]);
+   double peak = capture.vector().segment(1000000, 100000).maxCoeff();
+   ```
+   Copies of a mapped_array share the mapping, and numpy arrays returned by
+   numpy() keep it alive after the last copy has gone.  Mappings are
+   read-only unless opened as writable, in which case writes from either
+   language go straight to the file.
+
+   @tparam T The arithmetic element type
+*/
+template<class T>
+class mapped_array
+{
+  static_assert(std::is_arithmetic<T>::value,
+                "mapped_array elements must be of arithmetic type");
+
+public:
+  using Vector = Eigen::Array<T, Eigen::Dynamic, 1>;
+  using Matrix =
+    Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  using MatrixStride = Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>;
+
+  /**
+     @brief Map a raw binary file of native-endian values
+
+     @param path The file name
+     @param shape The array shape in C (row-major) order.  If empty, the
+     array is 1-D and holds every whole element after `offset`.
+     @param offset Bytes to skip at the start of the file, which must keep
+     the elements aligned
+     @param writable If true, the array may be modified, changing the file
+     @return The mapped array
+     @throw std::runtime_error if the file cannot be mapped or is too small
+     for the shape
+  */
+  static mapped_array raw(const std::string& path,
+                          std::vector<ssize_t> shape = {},
+                          size_t offset = 0,
+                          bool writable = false)
+  {
+    auto file = std::make_shared<detail::MappedFile>(
+      detail::MappedFile::open(path, writable));
+    if (offset > file->size() or offset % alignof(T) != 0) {
+      throw(std::runtime_error(path + ": invalid offset"));
+    }
+    if (shape.empty()) {
+      shape.push_back(ssize_t((file->size() - offset) / sizeof(T)));
+    }
+    return mapped_array(std::move(file), path, shape, offset, false);
+  }
+
+  /**
+     @brief Map the data of a `.npy` file
+
+     @param path The file name
+     @param writable If true, the array may be modified, changing the file
+     @return The mapped array
+     @throw std::runtime_error if the file cannot be mapped, is not a valid
+     `.npy` file, or does not hold native-endian elements of type `T`
+  */
+  static mapped_array npy(const std::string& path, bool writable = false)
+  {
+    auto file = std::make_shared<detail::MappedFile>(
+      detail::MappedFile::open(path, writable));
+    auto header = detail::parse_npy_header(file->data(), file->size(), path);
+    const char native = detail::little_endian() ? '<' : '>';
+    if (header.kind != detail::kind_of<T>() or header.itemsize != sizeof(T) or
+        (header.byteorder != '|' and header.byteorder != '=' and
+         header.byteorder != native)) {
+      throw(std::runtime_error(path + " does not hold elements of the " +
+                               "requested native type"));
+    }
+    return mapped_array(std::move(file),
+                        path,
+                        header.shape,
+                        header.data_offset,
+                        header.fortran_order);
+  }
+
+  /// The array shape
+  const std::vector<ssize_t>& shape() const { return shape_; }
+
+  /// The number of dimensions
+  size_t ndim() const { return shape_.size(); }
+
+  /// The total number of elements
+  Eigen::Index size() const { return size_; }
+
+  /// Whether elements are stored in Fortran (column-major) order
+  bool fortran_order() const { return fortran_; }
+
+  /// Whether the mapping may be written to
+  bool writable() const { return file_->writable(); }
+
+  /// Pointer to the first element
+  const T* data() const { return data_; }
+
+  /**
+     @brief Pointer to the first element of a writable mapping
+     @throw std::logic_error if the mapping is read-only
+  */
+  T* mutable_data()
+  {
+    if (not writable()) {
+      throw(std::logic_error("mapped_array is read-only"));
+    }
+    return data_;
+  }
+
+  /// All elements, in storage order, as a 1-D Eigen array
+  Eigen::Map<const Vector> vector() const
+  {
+    return Eigen::Map<const Vector>(data_, size_);
+  }
+
+  /**
+     @brief A 2-D array as an Eigen array indexed `(row, column)`
+
+     @throw std::logic_error if the array is not 2-D
+  */
+  Eigen::Map<const Matrix, 0, MatrixStride> matrix() const
+  {
+    if (ndim() != 2) {
+      throw(std::logic_error("mapped_array is not 2-D"));
+    }
+    Eigen::Index rows = shape_[0];
+    Eigen::Index cols = shape_[1];
+    MatrixStride stride =
+      fortran_ ? MatrixStride(1, rows) : MatrixStride(cols, 1);
+    return Eigen::Map<const Matrix, 0, MatrixStride>(data_, rows, cols, stride);
+  }
+
+  /**
+     @brief The array as numpy sees it, sharing the mapped pages
+
+     @return A numpy array of the same shape over the mapping, which is
+     read-only unless the mapping is writable.  It keeps the mapping alive.
+  */
+  pybind11::array_t<T> numpy() const
+  {
+    if (size_ == 0) {
+      return pybind11::array_t<T>(shape_);
+    }
+    using Owner = std::shared_ptr<detail::MappedFile>;
+    std::unique_ptr<Owner> owner(new Owner(file_));
+    pybind11::capsule base(owner.get(),
+                           [](void* p) { delete static_cast<Owner*>(p); });
+    owner.release();
+    pybind11::array_t<T> result(shape_, strides(), data_, base);
+    if (not writable()) {
+      result.attr("setflags")(pybind11::arg("write") = false);
+    }
+    return result;
+  }
+
+private:
+  mapped_array(std::shared_ptr<detail::MappedFile> file,
+               const std::string& path,
+               std::vector<ssize_t> shape,
+               size_t offset,
+               bool fortran)
+    : file_(std::move(file))
+    , shape_(std::move(shape))
+    , fortran_(fortran)
+  {
+    // The strides multiply the non-zero dimensions, so these must not
+    // overflow even when the array is empty
+    const auto max = std::numeric_limits<Eigen::Index>::max();
+    Eigen::Index extent = sizeof(T);
+    size_ = 1;
+    for (auto n : shape_) {
+      if (n < 0) {
+        throw(std::runtime_error(path + ": negative dimension"));
+      }
+      if (n != 0 and extent > max / n) {
+        throw(std::runtime_error(path + ": array shape overflows"));
+      }
+      extent *= std::max<Eigen::Index>(n, 1);
+      size_ *= n;
+    }
+    // Checked before multiplying, as a shape from a malformed header could
+    // otherwise wrap around to a size that fits
+    if (offset > file_->size() or
+        size_t(size_) > (file_->size() - offset) / sizeof(T)) {
+      throw(std::runtime_error(path + " is too small for the array shape"));
+    }
+    data_ = reinterpret_cast<T*>(file_->data() + offset);
+  }
+
+  std::vector<ssize_t> strides() const
+  {
+    std::vector<ssize_t> result(shape_.size());
+    ssize_t stride = sizeof(T);
+    if (fortran_) {
+      for (size_t i = 0; i < shape_.size(); ++i) {
+        result[i] = stride;
+        stride *= shape_[i];
+      }
+    } else {
+      for (size_t i = shape_.size(); i-- > 0;) {
+        result[i] = stride;
+        stride *= shape_[i];
+      }
+    }
+    return result;
+  }
+
+  std::shared_ptr<detail::MappedFile> file_;
+  std::vector<ssize_t> shape_;
+  Eigen::Index size_ = 0;
+  bool fortran_ = false;
+  T* data_ = nullptr;
+};
+
+}
@@ -4,11 +4,14 @@
 #pragma once
 
 #include <limits>
+#include <memory>
 #include <pybind11/embed.h>
 #include <pybind11/numpy.h>
 #include <Eigen/Dense>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 namespace mplotpp {
 
@@ -171,4 +174,331 @@ meshgrid(const Eigen::Array<T, Eigen::Dynamic, 1>& x,
   return std::make_tuple(X, Y);
 }
 
-}
\ No newline at end of file
+/**
+   @brief Coordinate arrays of a tensor-product grid that are never
+   materialised.
+
+   This is the result of meshgrid_view().  It holds shared copies of the 1-D
+   coordinate vectors only, so its memory use is proportional to M + N rather
+   than M x N.  The coordinate arrays are available both as lazy Eigen
+   expressions, for evaluating functions of the grid in `c++`, and as
+   read-only numpy arrays with zero strides, for passing to python.
+
+   @tparam T The data type
+*/
+template<class T>
+class GridView
+{
+public:
+  using Vector = Eigen::Array<T, Eigen::Dynamic, 1>;
+
+  /**
+     @brief Construct from 1-D coordinate vectors
+
+     @param x A 1-D array representing the x-coordinates of the grid
+     @param y A 1-D array representing the y-coordinates of the grid
+  */
+  GridView(const Vector& x, const Vector& y)
+    : x_(std::make_shared<const Vector>(x))
+    , y_(std::make_shared<const Vector>(y))
+  {}
+
+  /// The x-coordinate vector
+  const Vector& x() const { return *x_; }
+
+  /// The y-coordinate vector
+  const Vector& y() const { return *y_; }
+
+  /// Number of rows of the grid, which is the length of y
+  Eigen::Index rows() const { return y_->size(); }
+
+  /// Number of columns of the grid, which is the length of x
+  Eigen::Index cols() const { return x_->size(); }
+
+  /**
+     @brief The x-coordinate array as a lazy Eigen expression
+
+     The expression behaves like the MxN array X returned by meshgrid() but
+     refers to the storage of this object, so it must not outlive it.
+  */
+  auto X() const { return x_->transpose().replicate(rows(), 1); }
+
+  /**
+     @brief The y-coordinate array as a lazy Eigen expression
+
+     The expression behaves like the MxN array Y returned by meshgrid() but
+     refers to the storage of this object, so it must not outlive it.
+  */
+  auto Y() const { return y_->replicate(1, cols()); }
+
+  /**
+     @brief The x-coordinate array as a read-only MxN numpy array
+
+     Every row is a view of the same x vector (the row stride is zero), as
+     produced by `numpy.meshgrid(x, y, copy=False)`.  The array keeps the
+     coordinates alive independently of this object.
+  */
+  pybind11::array_t<T> pyX() const { return broadcast(x_, 0, sizeof(T)); }
+
+  /**
+     @brief The y-coordinate array as a read-only MxN numpy array
+
+     Every column is a view of the same y vector (the column stride is zero),
+     as produced by `numpy.meshgrid(x, y, copy=False)`.  The array keeps the
+     coordinates alive independently of this object.
+  */
+  pybind11::array_t<T> pyY() const { return broadcast(y_, sizeof(T), 0); }
+
+private:
+  pybind11::array_t<T> broadcast(const std::shared_ptr<const Vector>& v,
+                                 ssize_t row_stride,
+                                 ssize_t col_stride) const
+  {
+    std::vector<ssize_t> shape = { ssize_t(rows()), ssize_t(cols()) };
+    if (v->size() == 0) {
+      return pybind11::array_t<T>(shape);
+    }
+    using Owner = std::shared_ptr<const Vector>;
+    std::unique_ptr<Owner> owner(new Owner(v));
+    pybind11::capsule base(owner.get(),
+                           [](void* p) { delete static_cast<Owner*>(p); });
+    owner.release();
+    pybind11::array_t<T> result(
+      shape, { row_stride, col_stride }, v->data(), base);
+    result.attr("setflags")(pybind11::arg("write") = false);
+    return result;
+  }
+
+  std::shared_ptr<const Vector> x_;
+  std::shared_ptr<const Vector> y_;
+};
+
+/**
+   @brief Get coordinate arrays from coordinate vectors without materialising
+   them.
+
+   This is the broadcasting alternative to meshgrid(), comparable to
+   `numpy.meshgrid(x, y, copy=False)`.  Functions of the grid can still be
+   written in `c++` using the lazy expressions, while the numpy arrays passed
+   to python use zero strides
+   ```
+   auto grid = mplotpp::meshgrid_view(x, y);
+   auto X = grid.X();
+   auto Y = grid.Y();
+   Eigen::ArrayXXd Z = (X.pow(2) + Y.pow(2)).sqrt().sin();
+   ax.attr("contourf")(grid.pyX(), grid.pyY(), Z);
+   ```
+   Note that numpy operations that write to their input, or that require
+   contiguous input, will still make their own copy.
+
+   @tparam T The data type
+   @param x A 1-D array representing the x-coordinates of a grid
+   @param y A 1-D array representing the y-coordinates of a grid
+   @return A GridView describing the MxN grid, where M is the length of y and
+   N is the length of x.
+*/
+template<class T>
+GridView<T>
+meshgrid_view(const Eigen::Array<T, Eigen::Dynamic, 1>& x,
+              const Eigen::Array<T, Eigen::Dynamic, 1>& y)
+{
+  return GridView<T>(x, y);
+}
+
+namespace detail {
+
+/**
+   @private
+   @brief Shape, strides and data pointer of a contiguous container in the form
+   expected by the `pybind11::array_t` constructor
+
+   Specialisations exist for `std::vector` and dense Eigen objects that own
+   their storage (`Eigen::Array` and `Eigen::Matrix` of any storage order).
+   Eigen vectors map to 1-D numpy arrays and everything else to 2-D arrays,
+   matching the behaviour of `pybind11/eigen.h`.
+*/
+template<class C, class Enable = void>
+struct ArrayLayout;
+
+template<class T, class Alloc>
+struct ArrayLayout<std::vector<T, Alloc>>
+{
+  static_assert(std::is_arithmetic<T>::value,
+                "Only std::vector of arithmetic types can be viewed by numpy");
+  using Scalar = T;
+
+  static std::vector<ssize_t> shape(const std::vector<T, Alloc>& c)
+  {
+    return { ssize_t(c.size()) };
+  }
+  static std::vector<ssize_t> strides(const std::vector<T, Alloc>&)
+  {
+    return { ssize_t(sizeof(T)) };
+  }
+  static const T* data(const std::vector<T, Alloc>& c) { return c.data(); }
+};
+
+template<class C>
+struct ArrayLayout<
+  C,
+  std::enable_if_t<std::is_base_of<Eigen::PlainObjectBase<C>, C>::value>>
+{
+  using Scalar = typename C::Scalar;
+  static_assert(std::is_arithmetic<Scalar>::value,
+                "Only Eigen objects of arithmetic type can be viewed by numpy");
+  static constexpr bool is_vector = C::IsVectorAtCompileTime;
+
+  static std::vector<ssize_t> shape(const C& c)
+  {
+    if (is_vector) {
+      return { ssize_t(c.size()) };
+    }
+    return { ssize_t(c.rows()), ssize_t(c.cols()) };
+  }
+  static std::vector<ssize_t> strides(const C& c)
+  {
+    constexpr ssize_t s = sizeof(Scalar);
+    if (is_vector) {
+      return { s };
+    }
+    if (C::IsRowMajor) {
+      return { ssize_t(c.cols()) * s, s };
+    }
+    return { s, ssize_t(c.rows()) * s };
+  }
+  static const Scalar* data(const C& c) { return c.data(); }
+};
+
+/**
+   @private
+   @brief Construct a numpy array over the storage of `c` whose lifetime is
+   tied to the python object `base`.
+
+   @param c The container providing the storage
+   @param base A python object that keeps the storage of `c` alive.  numpy
+   only avoids copying when a base object is supplied.
+   @param writeable If false, the resulting numpy array is flagged read-only
+*/
+template<class C>
+pybind11::array_t<typename ArrayLayout<C>::Scalar>
+make_view(const C& c, pybind11::handle base, bool writeable)
+{
+  using Layout = ArrayLayout<C>;
+  pybind11::array_t<typename Layout::Scalar> result(
+    Layout::shape(c), Layout::strides(c), Layout::data(c), base);
+  if (not writeable) {
+    result.attr("setflags")(pybind11::arg("write") = false);
+  }
+  return result;
+}
+
+}
+
+/**
+   @brief Wrap a `std::vector` or Eigen array as a read-only numpy array
+   without copying.
+
+   Passing an `Eigen::ArrayXd` directly to a python function using
+   `pybind11/eigen.h` copies the entire buffer into a new numpy array.  For
+   large data it is cheaper to let numpy look at the `c++` storage directly
+   ```
+   Eigen::ArrayXd x = mplotpp::arange(0.0, 1.0, 1e-7);
+   Eigen::ArrayXd y = x.sin();
+   ax.attr("plot")(mplotpp::view(x), mplotpp::view(y));
+   ```
+   The caller must guarantee that `c` is neither destroyed nor resized while
+   python holds a reference to the returned array.  matplotlib keeps
+   references to plotted data, so `c` should normally outlive the figure.  If
+   that cannot be guaranteed, use the `std::shared_ptr` overload or adopt().
+
+   @tparam C `std::vector<T>`, `Eigen::Array` or `Eigen::Matrix` where `T` is
+   an arithmetic type
+   @param c The container to view
+   @return A read-only numpy array sharing storage with `c`.  Eigen vectors
+   give 1-D arrays and other Eigen objects give 2-D arrays with strides
+   matching the storage order of `c`.
+*/
+template<class C>
+pybind11::array_t<typename detail::ArrayLayout<C>::Scalar>
+view(const C& c)
+{
+  using Layout = detail::ArrayLayout<C>;
+  if (c.size() == 0) {
+    return pybind11::array_t<typename Layout::Scalar>(Layout::shape(c));
+  }
+  // numpy copies unless a base object is given, so use an inert capsule
+  pybind11::capsule base(Layout::data(c), [](void*) {});
+  return detail::make_view(c, base, false);
+}
+
+/**
+   @brief Viewing a temporary would leave a dangling numpy array, so it is
+   forbidden.  Use adopt() instead.
+*/
+template<class C>
+void
+view(const C&& c) = delete;
+
+/**
+   @brief Wrap a shared container as a numpy array without copying.
+
+   The returned array holds a copy of `c`, so the storage remains valid for as
+   long as either `c++` or python refers to it.  As with view(const C&), the
+   container must not be resized while shared with python.
+
+   @tparam C `std::vector<T>`, `Eigen::Array` or `Eigen::Matrix` where `T` is
+   an arithmetic type
+   @param c Shared pointer to the container to view
+   @param writeable If true, python is allowed to modify the shared storage
+   @return A numpy array sharing storage with `*c`.
+*/
+template<class C>
+pybind11::array_t<typename detail::ArrayLayout<std::remove_const_t<C>>::Scalar>
+view(std::shared_ptr<C> c, bool writeable = false)
+{
+  using Layout = detail::ArrayLayout<std::remove_const_t<C>>;
+  if (c->size() == 0) {
+    return pybind11::array_t<typename Layout::Scalar>(Layout::shape(*c));
+  }
+  std::unique_ptr<std::shared_ptr<C>> owner(new std::shared_ptr<C>(c));
+  pybind11::capsule base(owner.get(), [](void* p) {
+    delete static_cast<std::shared_ptr<C>*>(p);
+  });
+  owner.release();
+  return detail::make_view(*c, base, writeable and not std::is_const<C>::value);
+}
+
+/**
+   @brief Transfer ownership of a `std::vector` or Eigen array to numpy without
+   copying its elements.
+
+   The container is moved into heap storage owned by a python capsule, which
+   is released when numpy drops its last reference.  This is the cheapest way
+   to hand over data that `c++` no longer needs
+   ```
+   Eigen::ArrayXd y = compute_trace();
+   ax.attr("plot")(mplotpp::adopt(std::move(y)));
+   ```
+
+   @tparam C `std::vector<T>`, `Eigen::Array` or `Eigen::Matrix` where `T` is
+   an arithmetic type
+   @param c The container to move from.  It is left in a valid but unspecified
+   (normally empty) state.
+   @return A writeable numpy array that owns the storage of `c`.
+*/
+template<class C,
+         class = std::enable_if_t<not std::is_lvalue_reference<C>::value>>
+pybind11::array_t<typename detail::ArrayLayout<C>::Scalar>
+adopt(C&& c)
+{
+  using Layout = detail::ArrayLayout<C>;
+  if (c.size() == 0) {
+    return pybind11::array_t<typename Layout::Scalar>(Layout::shape(c));
+  }
+  std::unique_ptr<C> owner(new C(std::move(c)));
+  pybind11::capsule base(owner.get(),
+                         [](void* p) { delete static_cast<C*>(p); });
+  return detail::make_view(*owner.release(), base, true);
+}
+
+}
@@ -0,0 +1,128 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief Storage for the thread count used by parallel_for()
+*/
+inline std::atomic<unsigned>&
+thread_count()
+{
+  static std::atomic<unsigned> count{ 0 };
+  return count;
+}
+
+}
+
+/**
+   @brief The number of threads used by the parallel kernels of mplot++
+
+   @return The value last passed to set_num_threads() or, by default, the
+   number of hardware threads.
+*/
+inline unsigned
+num_threads()
+{
+  unsigned n = detail::thread_count();
+  if (n == 0) {
+    n = std::max(1u, std::thread::hardware_concurrency());
+  }
+  return n;
+}
+
+/**
+   @brief Set the number of threads used by the parallel kernels of mplot++
+
+   @param n The number of threads.  Zero restores the default of one thread
+   per hardware thread.
+*/
+inline void
+set_num_threads(unsigned n)
+{
+  detail::thread_count() = n;
+}
+
+/**
+   @brief Apply a function to consecutive chunks of an index range using
+   multiple threads.
+
+   The range `[begin, end)` is divided into chunks of `grain` indices which are
+   handed out dynamically to up to num_threads() threads, the calling thread
+   being one of them.  Each chunk results in one call `f(first, last)`.  Ranges
+   that fit in a single chunk are processed on the calling thread without
+   starting any threads.
+
+   The function is called concurrently, so it must only write to disjoint
+   data.  It must not use the python interpreter.
+
+   @tparam Index An integral type
+   @tparam F A callable with signature `void(Index, Index)`
+   @param begin The first index
+   @param end One past the last index
+   @param grain The number of indices per chunk, which is at least one
+   @param f The function to apply
+   @throw Rethrows the first exception thrown by `f`, after all threads have
+   finished.
+*/
+template<class Index, class F>
+void
+parallel_for(Index begin, Index end, Index grain, F&& f)
+{
+  if (end <= begin) {
+    return;
+  }
+  grain = std::max(grain, Index(1));
+  Index nchunks = (end - begin + grain - 1) / grain;
+  unsigned nthreads = unsigned(std::min<Index>(num_threads(), nchunks));
+  if (nthreads <= 1) {
+    f(begin, end);
+    return;
+  }
+
+  std::atomic<Index> next{ 0 };
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&]() {
+    try {
+      for (Index chunk = next++; chunk < nchunks; chunk = next++) {
+        Index first = begin + chunk * grain;
+        f(first, std::min(end, first + grain));
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (not error) {
+        error = std::current_exception();
+      }
+      next = nchunks;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(nthreads - 1);
+  for (unsigned i = 1; i < nthreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}
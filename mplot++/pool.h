@@ -0,0 +1,395 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mplot++/mplot++.h>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief Alignment of pooled buffers, a cache line
+*/
+constexpr size_t pool_alignment = 64;
+
+/**
+   @private
+   @brief The type and dimensions identifying interchangeable buffers
+*/
+struct PoolKey
+{
+  std::type_index type;
+  Eigen::Index rows;
+  Eigen::Index cols;
+
+  bool operator<(const PoolKey& other) const
+  {
+    return std::tie(type, rows, cols) <
+           std::tie(other.type, other.rows, other.cols);
+  }
+};
+
+struct PoolState;
+
+/**
+   @private
+   @brief A header followed, at the next multiple of pool_alignment, by the
+   elements of a buffer
+*/
+struct PoolBlock
+{
+  PoolBlock(const PoolKey& key, size_t bytes)
+    : key(key)
+    , bytes(bytes)
+  {}
+
+  /// The size of the header, rounded up to pool_alignment
+  static constexpr size_t header()
+  {
+    return (sizeof(PoolBlock) + pool_alignment - 1) / pool_alignment *
+           pool_alignment;
+  }
+
+  static PoolBlock* create(const PoolKey& key, size_t bytes)
+  {
+    void* p =
+      ::operator new(header() + bytes, std::align_val_t(pool_alignment));
+    return new (p) PoolBlock(key, bytes);
+  }
+
+  static void destroy(PoolBlock* block)
+  {
+    block->~PoolBlock();
+    ::operator delete(block, std::align_val_t(pool_alignment));
+  }
+
+  void* data() { return reinterpret_cast<char*>(this) + header(); }
+
+  const PoolKey key;
+  const size_t bytes;
+  std::atomic<long> refs{ 0 };
+  /// The pool the block returns to, while it is handed out
+  std::shared_ptr<PoolState> pool;
+};
+
+/**
+   @private
+   @brief The free lists of a BufferPool, shared with the buffers it handed
+   out so that they can return after the pool is destroyed
+*/
+struct PoolState
+{
+  explicit PoolState(size_t max_idle)
+    : max_idle(max_idle)
+  {}
+
+  ~PoolState() { trim(); }
+
+  PoolBlock* take(const PoolKey& key, size_t bytes)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = idle.find(key);
+      if (it != idle.end() and not it->second.empty()) {
+        PoolBlock* block = it->second.back();
+        it->second.pop_back();
+        idle_bytes -= block->bytes;
+        ++reuses;
+        return block;
+      }
+      ++allocations;
+    }
+    return PoolBlock::create(key, bytes);
+  }
+
+  void put(PoolBlock* block)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (open and idle_bytes + block->bytes <= max_idle) {
+        // Reserved capacity is kept when a list empties, so this only
+        // allocates the first time a list grows
+        idle[block->key].push_back(block);
+        idle_bytes += block->bytes;
+        return;
+      }
+    }
+    PoolBlock::destroy(block);
+  }
+
+  void trim()
+  {
+    std::map<PoolKey, std::vector<PoolBlock*>> blocks;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      blocks.swap(idle);
+      idle_bytes = 0;
+    }
+    for (auto& [key, list] : blocks) {
+      for (PoolBlock* block : list) {
+        PoolBlock::destroy(block);
+      }
+    }
+  }
+
+  std::mutex mutex;
+  std::map<PoolKey, std::vector<PoolBlock*>> idle;
+  size_t max_idle;
+  size_t idle_bytes = 0;
+  size_t allocations = 0;
+  size_t reuses = 0;
+  bool open = true;
+};
+
+/**
+   @private
+   @brief Drop a reference to a block, returning it to its pool with the last
+*/
+inline void
+release(PoolBlock* block)
+{
+  if (block and block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    // The block may hold the last reference to the pool
+    auto pool = std::move(block->pool);
+    pool->put(block);
+  }
+}
+
+}
+
+/**
+   @brief A buffer from a BufferPool, seen by `c++` as an `Eigen::Map` and by
+   python as a numpy array
+
+   Copies of a Pooled and the numpy arrays made by numpy() share the buffer,
+   which returns to the pool when the last of them is destroyed.
+
+   @tparam C A dynamic-size `Eigen::Array` or `Eigen::Matrix` of arithmetic
+   type, giving the element type, shape and storage order
+*/
+template<class C>
+class Pooled
+{
+public:
+  using Scalar = typename C::Scalar;
+
+  Pooled(const Pooled& other)
+    : block_(other.block_)
+    , rows_(other.rows_)
+    , cols_(other.cols_)
+  {
+    block_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Pooled(Pooled&& other) noexcept
+    : block_(std::exchange(other.block_, nullptr))
+    , rows_(other.rows_)
+    , cols_(other.cols_)
+  {}
+
+  Pooled& operator=(Pooled other) noexcept
+  {
+    std::swap(block_, other.block_);
+    std::swap(rows_, other.rows_);
+    std::swap(cols_, other.cols_);
+    return *this;
+  }
+
+  ~Pooled() { detail::release(block_); }
+
+  Eigen::Index rows() const { return rows_; }
+  Eigen::Index cols() const { return cols_; }
+  Eigen::Index size() const { return rows_ * cols_; }
+
+  Scalar* data() { return static_cast<Scalar*>(block_->data()); }
+  const Scalar* data() const { return static_cast<Scalar*>(block_->data()); }
+
+  /// The elements, which are uninitialised when the buffer is handed out
+  Eigen::Map<C> map() { return Eigen::Map<C>(data(), rows_, cols_); }
+  Eigen::Map<const C> map() const
+  {
+    return Eigen::Map<const C>(data(), rows_, cols_);
+  }
+
+  /**
+     @brief A numpy array over the buffer, which keeps it out of the pool
+     until python drops the array
+
+     @param writeable If false, the array is flagged read-only
+     @return A 1-D array for Eigen vectors and a 2-D array with strides
+     matching the storage order otherwise, as view() gives
+  */
+  pybind11::array_t<Scalar> numpy(bool writeable = true) const
+  {
+    constexpr ssize_t s = sizeof(Scalar);
+    std::vector<ssize_t> shape;
+    std::vector<ssize_t> strides;
+    if (C::IsVectorAtCompileTime) {
+      shape = { ssize_t(size()) };
+      strides = { s };
+    } else if (C::IsRowMajor) {
+      shape = { ssize_t(rows_), ssize_t(cols_) };
+      strides = { ssize_t(cols_) * s, s };
+    } else {
+      shape = { ssize_t(rows_), ssize_t(cols_) };
+      strides = { s, ssize_t(rows_) * s };
+    }
+    block_->refs.fetch_add(1, std::memory_order_relaxed);
+    pybind11::capsule base(block_, [](void* p) {
+      detail::release(static_cast<detail::PoolBlock*>(p));
+    });
+    pybind11::array_t<Scalar> result(shape, strides, data(), base);
+    if (not writeable) {
+      result.attr("setflags")(pybind11::arg("write") = false);
+    }
+    return result;
+  }
+
+private:
+  friend class BufferPool;
+  Pooled(detail::PoolBlock* block, Eigen::Index rows, Eigen::Index cols)
+    : block_(block)
+    , rows_(rows)
+    , cols_(cols)
+  {}
+
+  detail::PoolBlock* block_;
+  Eigen::Index rows_;
+  Eigen::Index cols_;
+};
+
+/**
+   @brief A pool of reusable buffers shared between Eigen and numpy
+
+   A loop that plots arrays of the same shape every cycle allocates and frees
+   the same large buffers each time, both for the Eigen results and for the
+   numpy arrays passed to matplotlib.  A BufferPool keeps the buffers, keyed
+   by element type and shape, so that once the loop reaches a steady state
+   it reuses them instead
+   ```
+   mplotpp::BufferPool pool;
+   for (;;) {
+     auto x = pool.get<Eigen::ArrayXd>(n);
+     auto y = pool.get<Eigen::ArrayXd>(n);
+     x.map() = Eigen::ArrayXd::LinSpaced(n, 0, 1);
+     y.map() = measure(x.map());
+     line.attr("set_data")(x.numpy(), y.numpy());
+     fig.attr("canvas").attr("draw")();
+   }
+   ```
+   Each buffer goes back to the pool when the last Pooled and numpy array
+   referring to it is gone, which for numpy is detected by the destructor of
+   the capsule owning it.  Above, the buffers of one cycle are reused two
+   cycles later, once `set_data` has released them.  Each cycle then only
+   allocates the python array and capsule objects and their shape and
+   strides, a few dozen bytes, rather than the data.
+
+   Buffers are aligned to 64 bytes and are not initialised.  A pool may be
+   used from any thread, and may be destroyed while buffers are in use;
+   these are then freed when released.
+*/
+class BufferPool
+{
+public:
+  /**
+     @param max_idle_bytes The most memory kept in idle buffers.  Released
+     buffers that would exceed it are freed.
+  */
+  explicit BufferPool(
+    size_t max_idle_bytes = std::numeric_limits<size_t>::max())
+    : state_(std::make_shared<detail::PoolState>(max_idle_bytes))
+  {}
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  ~BufferPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      state_->open = false;
+    }
+    state_->trim();
+  }
+
+  /**
+     @brief Get a vector of `n` elements
+
+     @throw std::invalid_argument if `n` is negative
+  */
+  template<class C>
+  Pooled<C> get(Eigen::Index n)
+  {
+    static_assert(C::IsVectorAtCompileTime,
+                  "Give the rows and columns of a pooled 2-D array");
+    return C::ColsAtCompileTime == 1 ? get<C>(n, 1) : get<C>(1, n);
+  }
+
+  /**
+     @brief Get an array of `rows` by `cols` elements
+
+     @throw std::invalid_argument if a dimension is negative
+  */
+  template<class C>
+  Pooled<C> get(Eigen::Index rows, Eigen::Index cols)
+  {
+    using Scalar = typename C::Scalar;
+    static_assert(std::is_arithmetic<Scalar>::value,
+                  "Pooled buffers must have arithmetic elements");
+    static_assert(alignof(Scalar) <= detail::pool_alignment,
+                  "Pooled elements are over-aligned");
+    if (rows < 0 or cols < 0) {
+      throw(std::invalid_argument("Negative size in BufferPool::get()"));
+    }
+    detail::PoolBlock* block =
+      state_->take(detail::PoolKey{ typeid(C), rows, cols },
+                   size_t(rows * cols) * sizeof(Scalar));
+    block->pool = state_;
+    block->refs.store(1, std::memory_order_relaxed);
+    return Pooled<C>(block, rows, cols);
+  }
+
+  /// The memory held in buffers waiting to be reused
+  size_t idle_bytes() const
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->idle_bytes;
+  }
+
+  /// The number of buffers allocated rather than reused
+  size_t allocations() const
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->allocations;
+  }
+
+  /// The number of buffers reused
+  size_t reuses() const
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->reuses;
+  }
+
+  /// Free all idle buffers
+  void trim() { state_->trim(); }
+
+private:
+  std::shared_ptr<detail::PoolState> state_;
+};
+
+}
@@ -0,0 +1,452 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mplot++/decimate.h>
+#include <mplot++/mapped.h>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+namespace mplotpp {
+
+namespace detail {
+
+/**
+   @private
+   @brief Fixed-size header at the start of a pyramid index file.  It is
+   followed by `nlevels` PyramidLevel entries and then the data of each level.
+*/
+struct PyramidHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t itemsize;
+  char kind;
+  char pad[7];
+  uint64_t nsamples;
+  uint64_t base;
+  uint64_t factor;
+  uint64_t nlevels;
+  double x0;
+  double dx;
+};
+
+/**
+   @private
+   @brief Location of one pyramid level in the index file.  The level holds
+   `count` (minimum, maximum) pairs.
+*/
+struct PyramidLevel
+{
+  uint64_t offset;
+  uint64_t count;
+  uint64_t bucket;
+};
+
+constexpr char pyramid_magic[8] = { 'M', 'P', 'L', 'T', 'P', 'Y', 'R', 'M' };
+constexpr uint32_t pyramid_version = 1;
+
+/**
+   @private
+   @brief Number of buckets processed as one chunk when building a pyramid
+*/
+constexpr uint64_t pyramid_grain = 4096;
+
+/**
+   @private
+   @brief The smaller of two extrema, ignoring NaN unless both are NaN
+*/
+template<class T>
+inline T
+min_number(T a, T b)
+{
+  return a != a or b < a ? b : a;
+}
+
+/**
+   @private
+   @brief The larger of two extrema, ignoring NaN unless both are NaN
+*/
+template<class T>
+inline T
+max_number(T a, T b)
+{
+  return a != a or b > a ? b : a;
+}
+
+}
+
+/**
+   @brief Multi-resolution min/max index of a huge series stored on disk.
+
+   The series is a raw binary file of native-endian values of type `T`,
+   sampled at the uniform coordinates `x0 + i * dx`.  build() scans it once,
+   in parallel, and writes an index file holding the minimum and maximum of
+   every bucket of `base` samples, then of every `factor` such buckets, and so
+   on up to a single bucket.  With the default parameters the index is about
+   3% of the size of the data.
+
+   NaN samples are ignored when finding the extrema, as in decimate_minmax(),
+   so a bucket is NaN only if all its samples are.  Such a bucket breaks the
+   plotted line.
+
+   Both files are memory-mapped rather than read, so opening a Pyramid is
+   immediate, and query() touches only the level whose resolution matches the
+   request.  The cost of a query is therefore proportional to the number of
+   pixels and independent of the length of the series, which makes zooming
+   and panning over files much larger than memory interactive.  Use
+   plot_pyramid() to display a Pyramid with automatic refinement on zoom.
+   ```
+   mplotpp::Pyramid<float>::build("trace.f32", "trace.idx", 0.0, 1e-6);
+   auto pyramid = std::make_shared<mplotpp::Pyramid<float>>("trace.f32",
+                                                            "trace.idx");
+   mplotpp::plot_pyramid(ax, pyramid);
+   ```
+
+   @tparam T The arithmetic type of the samples
+*/
+template<class T>
+class Pyramid
+{
+  static_assert(std::is_arithmetic<T>::value,
+                "Pyramid samples must be of arithmetic type");
+
+public:
+  /**
+     @brief Build the index of a data file
+
+     @param data_path The raw data file
+     @param index_path The index file to create, replacing any existing file
+     @param x0 The x-coordinate of the first sample
+     @param dx The x-spacing of the samples
+     @param base The number of samples in each bucket of the finest level
+     @param factor The number of buckets of one level in each bucket of the
+     next, at least 2
+     @throw std::runtime_error if a file cannot be accessed
+     @throw std::invalid_argument if the data file size is not a multiple of
+     `sizeof(T)` or the parameters are invalid
+  */
+  static void build(const std::string& data_path,
+                    const std::string& index_path,
+                    double x0 = 0,
+                    double dx = 1,
+                    uint64_t base = 64,
+                    uint64_t factor = 4)
+  {
+    if (base < 1 or factor < 2 or not(dx > 0)) {
+      throw(std::invalid_argument("Invalid Pyramid parameters"));
+    }
+    auto data = detail::MappedFile::open(data_path);
+    if (data.size() % sizeof(T) != 0) {
+      throw(std::invalid_argument(data_path + " does not hold a whole " +
+                                  "number of samples"));
+    }
+    const uint64_t n = data.size() / sizeof(T);
+    const T* samples = reinterpret_cast<const T*>(data.data());
+
+    std::vector<detail::PyramidLevel> levels;
+    uint64_t bucket = base;
+    uint64_t offset = 0;
+    do {
+      uint64_t count = (n + bucket - 1) / bucket;
+      levels.push_back({ offset, count, bucket });
+      offset += 2 * count * sizeof(T);
+      bucket *= factor;
+    } while (levels.back().count > 1);
+
+    const uint64_t start = sizeof(detail::PyramidHeader) +
+                           levels.size() * sizeof(detail::PyramidLevel);
+    for (auto& level : levels) {
+      level.offset += start;
+    }
+    auto index = detail::MappedFile::create(index_path, start + offset);
+
+    detail::PyramidHeader header{};
+    std::memcpy(header.magic, detail::pyramid_magic, sizeof(header.magic));
+    header.version = detail::pyramid_version;
+    header.itemsize = sizeof(T);
+    header.kind = detail::kind_of<T>();
+    header.nsamples = n;
+    header.base = base;
+    header.factor = factor;
+    header.nlevels = levels.size();
+    header.x0 = x0;
+    header.dx = dx;
+    std::memcpy(index.data(), &header, sizeof(header));
+    std::memcpy(index.data() + sizeof(header),
+                levels.data(),
+                levels.size() * sizeof(detail::PyramidLevel));
+
+    // The finest level from the samples, which are only read once
+    data.advise(MADV_SEQUENTIAL);
+    using Vector = Eigen::Array<T, Eigen::Dynamic, 1>;
+    T* out = reinterpret_cast<T*>(index.data() + levels[0].offset);
+    parallel_for(
+      uint64_t(0),
+      levels[0].count,
+      detail::pyramid_grain,
+      [&](uint64_t b0, uint64_t b1) {
+        for (uint64_t b = b0; b < b1; ++b) {
+          uint64_t i0 = b * base;
+          Eigen::Map<const Vector> segment(
+            samples + i0, Eigen::Index(std::min(base, n - i0)));
+          std::tie(out[2 * b], out[2 * b + 1]) = detail::extrema(segment);
+        }
+      });
+
+    // Each coarser level from the previous one
+    for (size_t l = 1; l < levels.size(); ++l) {
+      const T* in = reinterpret_cast<const T*>(index.data() +
+                                               levels[l - 1].offset);
+      const uint64_t nin = levels[l - 1].count;
+      T* out = reinterpret_cast<T*>(index.data() + levels[l].offset);
+      parallel_for(
+        uint64_t(0),
+        levels[l].count,
+        detail::pyramid_grain,
+        [&](uint64_t b0, uint64_t b1) {
+          for (uint64_t b = b0; b < b1; ++b) {
+            uint64_t j0 = b * factor;
+            uint64_t j1 = std::min(j0 + factor, nin);
+            T lo = in[2 * j0];
+            T hi = in[2 * j0 + 1];
+            for (uint64_t j = j0 + 1; j < j1; ++j) {
+              lo = detail::min_number(lo, in[2 * j]);
+              hi = detail::max_number(hi, in[2 * j + 1]);
+            }
+            out[2 * b] = lo;
+            out[2 * b + 1] = hi;
+          }
+        });
+    }
+    index.sync();
+  }
+
+  /**
+     @brief Open a data file and its index
+
+     @param data_path The raw data file
+     @param index_path The index file created by build()
+     @throw std::runtime_error if a file cannot be accessed, the index is not
+     valid for samples of type `T`, or it does not match the data file
+  */
+  Pyramid(const std::string& data_path, const std::string& index_path)
+    : data_(detail::MappedFile::open(data_path))
+    , index_(detail::MappedFile::open(index_path))
+  {
+    detail::PyramidHeader header;
+    if (index_.size() < sizeof(header)) {
+      throw(std::runtime_error(index_path + " is not a pyramid index"));
+    }
+    std::memcpy(&header, index_.data(), sizeof(header));
+    if (std::memcmp(header.magic, detail::pyramid_magic, 8) != 0 or
+        header.version != detail::pyramid_version or not(header.dx > 0)) {
+      throw(std::runtime_error(index_path + " is not a pyramid index"));
+    }
+    if (header.itemsize != sizeof(T) or header.kind != detail::kind_of<T>()) {
+      throw(std::runtime_error(index_path + " indexes a different data type"));
+    }
+    if (data_.size() % sizeof(T) != 0 or
+        header.nsamples != data_.size() / sizeof(T)) {
+      throw(std::runtime_error(index_path + " does not match " + data_path));
+    }
+    // Sizes are compared by division, as a corrupt file can hold values
+    // whose products overflow
+    const uint64_t size = index_.size();
+    if (header.nlevels >
+        (size - sizeof(header)) / sizeof(detail::PyramidLevel)) {
+      throw(std::runtime_error(index_path + " is truncated"));
+    }
+    levels_.resize(header.nlevels);
+    std::memcpy(levels_.data(),
+                index_.data() + sizeof(header),
+                levels_.size() * sizeof(detail::PyramidLevel));
+    for (auto& level : levels_) {
+      if (level.offset > size or
+          level.count > (size - level.offset) / (2 * sizeof(T))) {
+        throw(std::runtime_error(index_path + " is truncated"));
+      }
+      if (level.bucket == 0 or level.offset % alignof(T) != 0 or
+          level.count != header.nsamples / level.bucket +
+                           (header.nsamples % level.bucket != 0)) {
+        throw(std::runtime_error(index_path + " is not a pyramid index"));
+      }
+    }
+    n_ = header.nsamples;
+    x0_ = header.x0;
+    dx_ = header.dx;
+  }
+
+  /// The number of samples
+  uint64_t size() const { return n_; }
+
+  /// The number of levels in the index
+  size_t levels() const { return levels_.size(); }
+
+  /// The x-coordinate of the first sample
+  double x0() const { return x0_; }
+
+  /// The x-spacing of the samples
+  double dx() const { return dx_; }
+
+  /// The x-coordinate of the last sample
+  double xlast() const { return x0_ + double(n_ == 0 ? 0 : n_ - 1) * dx_; }
+
+  /**
+     @brief The series between two x-coordinates at a given resolution
+
+     If the range holds few enough samples they are returned unchanged.
+     Otherwise the coarsest level that still has at least `nbuckets` buckets
+     in the range is read, and each of its buckets contributes its minimum and
+     maximum at the bucket centre, which draws the envelope of the series as a
+     line.  When even the finest level is too coarse the raw samples are
+     reduced in the same way.
+
+     @param xmin The lower limit of the range
+     @param xmax The upper limit of the range
+     @param nbuckets The resolution, normally the axes width in pixels
+     @return The points to plot
+  */
+  Decimated query(double xmin, double xmax, Eigen::Index nbuckets) const
+  {
+    nbuckets = std::max<Eigen::Index>(nbuckets, 1);
+    const T* samples = reinterpret_cast<const T*>(data_.data());
+    const int64_t last = int64_t(n_);
+    // Positions are clamped while still doubles, as converting an infinite
+    // or NaN one is undefined; a NaN limit leaves that end of the range open
+    auto position = [last](double i, double open) {
+      return int64_t(std::isnan(i) ? open
+                                   : std::clamp(i, -1.0, double(last) + 2));
+    };
+    int64_t i0 = std::clamp<int64_t>(
+      position(std::floor((xmin - x0_) / dx_), -1) - 1, 0, last);
+    int64_t i1 = std::clamp<int64_t>(
+      position(std::ceil((xmax - x0_) / dx_), double(last)) + 2, i0, last);
+    const int64_t span = i1 - i0;
+
+    if (span <= 4 * nbuckets) {
+      Decimated result{ Eigen::ArrayXd(span), Eigen::ArrayXd(span) };
+      for (int64_t i = 0; i < span; ++i) {
+        result.x[i] = x0_ + double(i0 + i) * dx_;
+        result.y[i] = double(samples[i0 + i]);
+      }
+      return result;
+    }
+
+    const uint64_t wanted = uint64_t(span / nbuckets);
+    const detail::PyramidLevel* level = nullptr;
+    for (auto& l : levels_) {
+      if (l.bucket <= wanted) {
+        level = &l;
+      }
+    }
+
+    if (level == nullptr) {
+      // Reduce the raw samples, of which there are fewer than base * nbuckets
+      using Vector = Eigen::Array<T, Eigen::Dynamic, 1>;
+      const int64_t bucket = (span + nbuckets - 1) / nbuckets;
+      const int64_t count = (span + bucket - 1) / bucket;
+      Decimated result{ Eigen::ArrayXd(2 * count), Eigen::ArrayXd(2 * count) };
+      for (int64_t b = 0; b < count; ++b) {
+        int64_t j0 = i0 + b * bucket;
+        int64_t len = std::min(bucket, i1 - j0);
+        Eigen::Map<const Vector> segment(samples + j0, len);
+        double xc = x0_ + (double(j0) + 0.5 * double(len - 1)) * dx_;
+        result.x[2 * b] = result.x[2 * b + 1] = xc;
+        auto [lo, hi] = detail::extrema(segment);
+        result.y[2 * b] = double(lo);
+        result.y[2 * b + 1] = double(hi);
+      }
+      return result;
+    }
+
+    const T* pairs = reinterpret_cast<const T*>(index_.data() + level->offset);
+    const uint64_t bucket = level->bucket;
+    const uint64_t b0 = uint64_t(i0) / bucket;
+    const uint64_t b1 =
+      std::min(level->count, (uint64_t(i1) + bucket - 1) / bucket);
+    const Eigen::Index count = Eigen::Index(b1 - b0);
+    Decimated result{ Eigen::ArrayXd(2 * count), Eigen::ArrayXd(2 * count) };
+    for (Eigen::Index k = 0; k < count; ++k) {
+      uint64_t b = b0 + uint64_t(k);
+      uint64_t len = std::min(bucket, n_ - b * bucket);
+      double xc = x0_ + (double(b * bucket) + 0.5 * double(len - 1)) * dx_;
+      result.x[2 * k] = result.x[2 * k + 1] = xc;
+      result.y[2 * k] = double(pairs[2 * b]);
+      result.y[2 * k + 1] = double(pairs[2 * b + 1]);
+    }
+    return result;
+  }
+
+private:
+  detail::MappedFile data_;
+  detail::MappedFile index_;
+  std::vector<detail::PyramidLevel> levels_;
+  uint64_t n_ = 0;
+  double x0_ = 0;
+  double dx_ = 1;
+};
+
+/**
+   @brief Plot a series from a Pyramid, refining it whenever the x-limits of
+   the axes change.
+
+   Like plot_decimated(), but only the part of the index matching the view
+   and the axes width is read, so the series never needs to fit in memory.
+   The Pyramid is shared with a callback owned by the axes.
+
+   @tparam T The arithmetic type of the samples
+   @param ax The axes to plot on
+   @param pyramid The indexed series
+   @param kwargs Keyword arguments for `ax.plot()`
+   @return The matplotlib `Line2D`
+*/
+template<class T>
+pybind11::object
+plot_pyramid(pybind11::object ax,
+             std::shared_ptr<const Pyramid<T>> pyramid,
+             pybind11::dict kwargs = pybind11::dict())
+{
+  Decimated d =
+    pyramid->query(pyramid->x0(), pyramid->xlast(), detail::pixel_width(ax));
+  auto [line] = tuple<1>(ax.attr("plot")(
+    adopt(std::move(d.x)), adopt(std::move(d.y)), **kwargs));
+
+  detail::connect_xlim_changed(
+    ax, line, [pyramid](pybind11::object ax, pybind11::object line) {
+      auto [xmin, xmax] = detail::xlimits(ax);
+      Eigen::Index nbuckets = detail::pixel_width(ax);
+      Decimated d;
+      {
+        pybind11::gil_scoped_release release;
+        d = pyramid->query(xmin, xmax, nbuckets);
+      }
+      line.attr("set_data")(adopt(std::move(d.x)), adopt(std::move(d.y)));
+    });
+  return line;
+}
+
+/// @copydoc plot_pyramid()
+template<class T>
+pybind11::object
+plot_pyramid(pybind11::object ax,
+             std::shared_ptr<Pyramid<T>> pyramid,
+             pybind11::dict kwargs = pybind11::dict())
+{
+  return plot_pyramid(
+    std::move(ax),
+    std::shared_ptr<const Pyramid<T>>(std::move(pyramid)),
+    std::move(kwargs));
+}
+
+}
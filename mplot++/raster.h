@@ -0,0 +1,501 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mplot++/decimate.h>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+/// How the points or lines falling in a pixel are combined
+enum class Reduction
+{
+  /// The number of points, or the total line coverage
+  Count,
+  /// The sum of the values
+  Sum,
+  /// The mean of the values, weighted by line coverage
+  Mean,
+  /// The largest value
+  Max
+};
+
+/**
+   @brief The region of the data plane covered by a raster and its size in
+   pixels
+*/
+struct RasterView
+{
+  double xmin = 0;
+  double xmax = 1;
+  double ymin = 0;
+  double ymax = 1;
+  Eigen::Index width = 1;
+  Eigen::Index height = 1;
+};
+
+namespace detail {
+
+/**
+   @private
+   @brief Minimum number of points or segments given to each thread
+*/
+constexpr Eigen::Index raster_grain = 1 << 15;
+
+/**
+   @private
+   @brief Accumulation canvas of one thread
+*/
+class Canvas
+{
+public:
+  Canvas(Eigen::Index width, Eigen::Index height, Reduction r)
+    : width_(width)
+    , height_(height)
+    , reduction_(r)
+  {
+    if (r == Reduction::Max) {
+      max_ = Eigen::ArrayXXd::Constant(
+        height, width, -std::numeric_limits<double>::infinity());
+    } else {
+      sum_ = Eigen::ArrayXXd::Zero(height, width);
+    }
+    if (r == Reduction::Mean) {
+      weight_ = Eigen::ArrayXXd::Zero(height, width);
+    }
+  }
+
+  /// Add value `v` with weight `w` to pixel `(i, j)`, if it exists
+  void plot(Eigen::Index i, Eigen::Index j, double w, double v)
+  {
+    if (i < 0 or j < 0 or i >= height_ or j >= width_ or w <= 0) {
+      return;
+    }
+    switch (reduction_) {
+      case Reduction::Count:
+        sum_(i, j) += w;
+        break;
+      case Reduction::Sum:
+        sum_(i, j) += w * v;
+        break;
+      case Reduction::Mean:
+        sum_(i, j) += w * v;
+        weight_(i, j) += w;
+        break;
+      case Reduction::Max:
+        max_(i, j) = std::max(max_(i, j), v);
+        break;
+    }
+  }
+
+  void merge(const Canvas& other)
+  {
+    if (reduction_ == Reduction::Max) {
+      max_ = max_.max(other.max_);
+    } else {
+      sum_ += other.sum_;
+    }
+    if (reduction_ == Reduction::Mean) {
+      weight_ += other.weight_;
+    }
+  }
+
+  /// The reduced image.  Pixels without data are NaN for Mean and Max.
+  Eigen::ArrayXXd image() &&
+  {
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    switch (reduction_) {
+      case Reduction::Mean:
+        return (weight_ > 0).select(sum_ / weight_, nan);
+      case Reduction::Max:
+        return max_.isFinite().select(max_, nan);
+      default:
+        return std::move(sum_);
+    }
+  }
+
+private:
+  Eigen::Index width_;
+  Eigen::Index height_;
+  Reduction reduction_;
+  Eigen::ArrayXXd sum_;
+  Eigen::ArrayXXd weight_;
+  Eigen::ArrayXXd max_;
+};
+
+/**
+   @private
+   @brief Draw `n` items into per-thread canvases and merge them in order
+*/
+template<class F>
+Eigen::ArrayXXd
+rasterize(const RasterView& view, Reduction r, Eigen::Index n, F&& draw)
+{
+  Eigen::Index parts = std::max<Eigen::Index>(
+    1,
+    std::min<Eigen::Index>(num_threads(),
+                           (n + raster_grain - 1) / raster_grain));
+  std::vector<Canvas> canvases(size_t(parts),
+                               Canvas(view.width, view.height, r));
+  parallel_for(Eigen::Index(0),
+               parts,
+               Eigen::Index(1),
+               [&](Eigen::Index first, Eigen::Index last) {
+                 for (Eigen::Index p = first; p < last; ++p) {
+                   draw(canvases[size_t(p)],
+                        n * p / parts,
+                        n * (p + 1) / parts);
+                 }
+               });
+  for (size_t p = 1; p < canvases.size(); ++p) {
+    canvases[0].merge(canvases[p]);
+  }
+  return std::move(canvases[0]).image();
+}
+
+/**
+   @private
+   @brief Clip the segment to the box `[x0, x1] x [y0, y1]` (Liang-Barsky).
+   Returns false if it lies entirely outside.
+*/
+inline bool
+clip_segment(double& ax,
+             double& ay,
+             double& bx,
+             double& by,
+             double x0,
+             double x1,
+             double y0,
+             double y1)
+{
+  double t0 = 0;
+  double t1 = 1;
+  const double dx = bx - ax;
+  const double dy = by - ay;
+  const double p[4] = { -dx, dx, -dy, dy };
+  const double q[4] = { ax - x0, x1 - ax, ay - y0, y1 - ay };
+  for (int k = 0; k < 4; ++k) {
+    if (p[k] == 0) {
+      if (q[k] < 0) {
+        return false;
+      }
+    } else {
+      double t = q[k] / p[k];
+      if (p[k] < 0) {
+        t0 = std::max(t0, t);
+      } else {
+        t1 = std::min(t1, t);
+      }
+    }
+  }
+  if (t0 > t1) {
+    return false;
+  }
+  bx = ax + t1 * dx;
+  by = ay + t1 * dy;
+  ax = ax + t0 * dx;
+  ay = ay + t0 * dy;
+  return true;
+}
+
+/**
+   @private
+   @brief Draw an anti-aliased segment between pixel coordinates with Xiaolin
+   Wu's algorithm, pixel centres being at integer coordinates
+*/
+inline void
+wu_line(Canvas& canvas, double x0, double y0, double x1, double y1, double v)
+{
+  auto fpart = [](double a) { return a - std::floor(a); };
+  auto rfpart = [&](double a) { return 1 - fpart(a); };
+
+  const bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+  if (steep) {
+    std::swap(x0, y0);
+    std::swap(x1, y1);
+  }
+  if (x0 > x1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+  auto plot = [&](double x, double y, double w) {
+    auto i = Eigen::Index(steep ? x : y);
+    auto j = Eigen::Index(steep ? y : x);
+    canvas.plot(i, j, w, v);
+  };
+
+  const double dx = x1 - x0;
+  const double gradient = dx == 0 ? 1.0 : (y1 - y0) / dx;
+
+  // Columns are centred on integers, so column c spans [c - 0.5, c + 0.5)
+  const double xpxl1 = std::floor(x0 + 0.5);
+  const double xpxl2 = std::floor(x1 + 0.5);
+  if (xpxl1 == xpxl2) {
+    // A segment within one column covers only its own length of it
+    double ymid = 0.5 * (y0 + y1);
+    plot(xpxl1, std::floor(ymid), rfpart(ymid) * dx);
+    plot(xpxl1, std::floor(ymid) + 1, fpart(ymid) * dx);
+    return;
+  }
+
+  double yend = y0 + gradient * (xpxl1 - x0);
+  double xgap = std::min(rfpart(x0 + 0.5), dx);
+  plot(xpxl1, std::floor(yend), rfpart(yend) * xgap);
+  plot(xpxl1, std::floor(yend) + 1, fpart(yend) * xgap);
+  double intery = yend + gradient;
+
+  yend = y1 + gradient * (xpxl2 - x1);
+  xgap = std::min(fpart(x1 + 0.5), dx);
+  plot(xpxl2, std::floor(yend), rfpart(yend) * xgap);
+  plot(xpxl2, std::floor(yend) + 1, fpart(yend) * xgap);
+
+  for (double x = xpxl1 + 1; x < xpxl2; x += 1) {
+    plot(x, std::floor(intery), rfpart(intery));
+    plot(x, std::floor(intery) + 1, fpart(intery));
+    intery += gradient;
+  }
+}
+
+}
+
+/**
+   @brief Aggregate points into an image, one pixel per bin
+
+   @param view The region and size of the image
+   @param x The abscissas of the points
+   @param y The ordinates, of the same size
+   @param r How the points in a pixel are combined
+   @param values The value of each point, required unless `r` is Count
+   @return The image, with row 0 at `ymin`, for `imshow` with
+   `origin="lower"`.  Pixels without points are NaN for Mean and Max.
+   @throw std::invalid_argument if the sizes differ or values are missing
+*/
+inline Eigen::ArrayXXd
+rasterize_points(const RasterView& view,
+                 const Eigen::ArrayXd& x,
+                 const Eigen::ArrayXd& y,
+                 Reduction r = Reduction::Count,
+                 const Eigen::ArrayXd* values = nullptr)
+{
+  if (x.size() != y.size() or
+      (r != Reduction::Count and (not values or values->size() != x.size()))) {
+    throw(std::invalid_argument("Sizes differ in rasterize_points()"));
+  }
+  const double sx = double(view.width) / (view.xmax - view.xmin);
+  const double sy = double(view.height) / (view.ymax - view.ymin);
+  return detail::rasterize(
+    view,
+    r,
+    x.size(),
+    [&](detail::Canvas& canvas, Eigen::Index first, Eigen::Index last) {
+      for (Eigen::Index k = first; k < last; ++k) {
+        double u = (x(k) - view.xmin) * sx;
+        double v = (y(k) - view.ymin) * sy;
+        if (not(u >= 0 and u <= double(view.width) and v >= 0 and
+                v <= double(view.height))) {
+          continue;
+        }
+        auto j = std::min(Eigen::Index(u), view.width - 1);
+        auto i = std::min(Eigen::Index(v), view.height - 1);
+        canvas.plot(i, j, 1.0, values ? (*values)(k) : 1.0);
+      }
+    });
+}
+
+/**
+   @brief Aggregate polylines into an image with anti-aliasing
+
+   Consecutive points are joined by segments, and a NaN in either coordinate
+   breaks the line, as in matplotlib, so many lines can be given at once.
+   Each pixel receives the fraction of it covered by each segment.
+
+   @param view The region and size of the image
+   @param x The abscissas of the vertices
+   @param y The ordinates, of the same size
+   @param r How the segments crossing a pixel are combined
+   @param values The value at each vertex, required unless `r` is Count.
+   A segment has the mean of its end values.
+   @return The image, with row 0 at `ymin`.  Pixels not crossed are NaN for
+   Mean and Max.
+   @throw std::invalid_argument if the sizes differ or values are missing
+*/
+inline Eigen::ArrayXXd
+rasterize_lines(const RasterView& view,
+                const Eigen::ArrayXd& x,
+                const Eigen::ArrayXd& y,
+                Reduction r = Reduction::Count,
+                const Eigen::ArrayXd* values = nullptr)
+{
+  if (x.size() != y.size() or
+      (r != Reduction::Count and (not values or values->size() != x.size()))) {
+    throw(std::invalid_argument("Sizes differ in rasterize_lines()"));
+  }
+  const double sx = double(view.width) / (view.xmax - view.xmin);
+  const double sy = double(view.height) / (view.ymax - view.ymin);
+  const double w = double(view.width);
+  const double h = double(view.height);
+  return detail::rasterize(
+    view,
+    r,
+    std::max<Eigen::Index>(0, x.size() - 1),
+    [&](detail::Canvas& canvas, Eigen::Index first, Eigen::Index last) {
+      for (Eigen::Index k = first; k < last; ++k) {
+        double ax = (x(k) - view.xmin) * sx - 0.5;
+        double ay = (y(k) - view.ymin) * sy - 0.5;
+        double bx = (x(k + 1) - view.xmin) * sx - 0.5;
+        double by = (y(k + 1) - view.ymin) * sy - 0.5;
+        if (not(std::isfinite(ax) and std::isfinite(ay) and
+                std::isfinite(bx) and std::isfinite(by)) or
+            not detail::clip_segment(ax, ay, bx, by, -1, w, -1, h)) {
+          continue;
+        }
+        double v = values ? 0.5 * ((*values)(k) + (*values)(k + 1)) : 1.0;
+        detail::wu_line(canvas, ax, ay, bx, by, v);
+      }
+    });
+}
+
+namespace detail {
+
+/**
+   @private
+   @brief Call `refresh(artist)` each time `artist` is about to be drawn
+
+   The `draw` method of the instance is replaced by one that refreshes it and
+   then calls the method of its class, so the artist is updated once per
+   frame, after all limits have settled, for both the screen and savefig.
+*/
+template<class F>
+void
+refresh_before_draw(pybind11::object artist, F refresh)
+{
+  auto weakref = pybind11::module_::import("weakref").attr("ref");
+  pybind11::object artist_ref = weakref(artist);
+  pybind11::object draw = artist.attr("__class__").attr("draw");
+  artist.attr("draw") = pybind11::cpp_function(
+    [artist_ref, draw, refresh](pybind11::object renderer) {
+      pybind11::object artist = artist_ref();
+      if (not artist.is_none()) {
+        refresh(artist);
+        draw(artist, renderer);
+      }
+    });
+}
+
+}
+
+/// What plot_raster() draws
+enum class RasterMode
+{
+  Points,
+  Lines
+};
+
+/**
+   @brief Draw a very large scatter or line plot as an image that is
+   re-rasterised whenever the view changes.
+
+   Hundreds of millions of points are too many for a `PathCollection`, and
+   their structure is lost when they overplot.  Instead the points or line
+   segments are aggregated into one value per screen pixel with
+   rasterize_points() or rasterize_lines() and shown with `imshow`
+   ```
+   auto x = std::make_shared<const Eigen::ArrayXd>(std::move(xs));
+   auto y = std::make_shared<const Eigen::ArrayXd>(std::move(ys));
+   mplotpp::plot_raster(ax, x, y, mplotpp::RasterMode::Points,
+                        mplotpp::Reduction::Count, nullptr,
+                        py::dict("norm"_a = "log", "cmap"_a = "inferno"));
+   ```
+   The image has one pixel per screen pixel of the axes.  When the image is
+   drawn after the limits or the size of the axes changed, for instance by
+   zooming, the view is rasterised again at full resolution, once for the
+   new x- and y-limits together.  If the axes hold no other data the limits
+   are first set to the extent of the data.  The GIL is released while
+   rasterising.
+
+   @param ax The Axes
+   @param x The abscissas, shared with the refresh callback
+   @param y The ordinates, of the same size
+   @param mode Whether to draw points or lines
+   @param r How the points or lines in a pixel are combined
+   @param values The values, required unless `r` is Count
+   @param kwargs Keyword arguments for `imshow`, such as `cmap` or `norm`
+   @return The `AxesImage`
+*/
+inline pybind11::object
+plot_raster(pybind11::object ax,
+            std::shared_ptr<const Eigen::ArrayXd> x,
+            std::shared_ptr<const Eigen::ArrayXd> y,
+            RasterMode mode = RasterMode::Points,
+            Reduction r = Reduction::Count,
+            std::shared_ptr<const Eigen::ArrayXd> values = nullptr,
+            pybind11::dict kwargs = pybind11::dict())
+{
+  auto last = std::make_shared<RasterView>();
+  auto render = [x, y, values, mode, r, last](
+                  const pybind11::object& ax) -> pybind11::object {
+    RasterView view;
+    std::tie(view.xmin, view.xmax) = detail::limits(ax, "get_xlim");
+    std::tie(view.ymin, view.ymax) = detail::limits(ax, "get_ylim");
+    view.width = detail::pixel_width(ax);
+    view.height = detail::pixel_height(ax);
+    if (view.xmin == last->xmin and view.xmax == last->xmax and
+        view.ymin == last->ymin and view.ymax == last->ymax and
+        view.width == last->width and view.height == last->height) {
+      return pybind11::none();
+    }
+    *last = view;
+    Eigen::ArrayXXd image;
+    {
+      pybind11::gil_scoped_release release;
+      image = mode == RasterMode::Points
+                ? rasterize_points(view, *x, *y, r, values.get())
+                : rasterize_lines(view, *x, *y, r, values.get());
+    }
+    return adopt(std::move(image));
+  };
+
+  if (not ax.attr("has_data")().cast<bool>()) {
+    auto finite = x->isFinite() && y->isFinite();
+    if (finite.any()) {
+      const double inf = std::numeric_limits<double>::infinity();
+      ax.attr("set_xlim")(finite.select(*x, inf).minCoeff(),
+                          finite.select(*x, -inf).maxCoeff());
+      ax.attr("set_ylim")(finite.select(*y, inf).minCoeff(),
+                          finite.select(*y, -inf).maxCoeff());
+    }
+  }
+  auto extent = [](const pybind11::object& ax) {
+    auto [x0, x1] = detail::limits(ax, "get_xlim");
+    auto [y0, y1] = detail::limits(ax, "get_ylim");
+    return pybind11::make_tuple(x0, x1, y0, y1);
+  };
+  auto image = ax.attr("imshow")(render(ax),
+                                 pybind11::arg("origin") = "lower",
+                                 pybind11::arg("aspect") = "auto",
+                                 pybind11::arg("extent") = extent(ax),
+                                 **kwargs);
+
+  // Rasterising on xlim_changed and ylim_changed would do it twice per zoom,
+  // the first time with stale y-limits
+  detail::refresh_before_draw(image, [render, extent](pybind11::object image) {
+    pybind11::object ax = image.attr("axes");
+    auto data = render(ax);
+    if (not data.is_none()) {
+      image.attr("set_data")(data);
+      image.attr("set_extent")(extent(ax));
+    }
+  });
+  return image;
+}
+
+}
@@ -0,0 +1,539 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <memory>
+#include <mplot++/mplot++.h>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+/**
+   @brief Base of the artists of a retained scene.
+
+   A node creates its matplotlib artist on the first sync and afterwards only
+   pushes the properties changed since the previous sync.  Arbitrary artist
+   properties can be changed with set(), which is applied with a single
+   `Artist.set` call.
+*/
+class SceneNode
+{
+public:
+  virtual ~SceneNode() = default;
+
+  /**
+     @brief Change an artist property, such as "color" or "linewidth"
+
+     @param property The property name accepted by `Artist.set`
+     @param value The new value
+  */
+  template<class T>
+  SceneNode& set(const char* property, T&& value)
+  {
+    properties_[property] = pybind11::cast(std::forward<T>(value));
+    touch();
+    return *this;
+  }
+
+  /// Show or hide the artist
+  SceneNode& set_visible(bool visible) { return set("visible", visible); }
+
+  /// Whether the node has changes not yet pushed to matplotlib
+  bool dirty() const { return dirty_; }
+
+  /// The matplotlib artist, which is None until the first sync
+  const pybind11::object& artist() const { return artist_; }
+
+protected:
+  /// Mark the node as changed
+  void touch() { dirty_ = true; }
+
+  /// Create the artist on the given axes
+  virtual pybind11::object create(pybind11::handle ax) = 0;
+
+  /// Push changed data to the existing artist
+  virtual void update() = 0;
+
+  /// Whether the pending changes move the data limits of the axes
+  virtual bool moves_limits() const { return false; }
+
+private:
+  friend class SceneAxes;
+
+  /// Create or update the artist.  Returns true if anything was pushed.
+  bool sync(pybind11::handle ax)
+  {
+    if (not dirty_) {
+      return false;
+    }
+    if (not artist_) {
+      artist_ = create(ax);
+    } else {
+      update();
+    }
+    if (properties_.size() > 0) {
+      artist_.attr("set")(**properties_);
+      properties_ = pybind11::dict();
+    }
+    dirty_ = false;
+    return true;
+  }
+
+  pybind11::object artist_;
+  pybind11::dict properties_;
+  bool dirty_ = true;
+};
+
+/**
+   @brief A line whose data is handed to matplotlib as views of shared storage
+*/
+class SceneLine : public SceneNode
+{
+public:
+  /**
+     @brief Replace both coordinates
+
+     @param x The abscissas
+     @param y The ordinates, of the same size
+     @throw std::invalid_argument if the sizes differ
+  */
+  SceneLine& set_data(Eigen::ArrayXd x, Eigen::ArrayXd y)
+  {
+    if (x.size() != y.size()) {
+      throw(std::invalid_argument("x and y sizes differ in set_data()"));
+    }
+    auto_x_ = false;
+    x_ = std::make_shared<const Eigen::ArrayXd>(std::move(x));
+    y_ = std::make_shared<const Eigen::ArrayXd>(std::move(y));
+    changed_x_ = changed_y_ = true;
+    touch();
+    return *this;
+  }
+
+  /**
+     @brief Replace the ordinates, keeping the abscissas
+
+     If set_data() has not been called, the abscissas are the indices
+     `0, 1, ...` of the ordinates, as for `ax.plot(y)`.
+
+     @param y The ordinates, of the same size as the abscissas
+     @throw std::invalid_argument if the abscissas were given by set_data()
+     and the size differs
+  */
+  SceneLine& set_ydata(Eigen::ArrayXd y)
+  {
+    if (y.size() != x_->size()) {
+      if (not auto_x_) {
+        throw(std::invalid_argument("y size differs from x in set_ydata()"));
+      }
+      x_ = std::make_shared<const Eigen::ArrayXd>(
+        Eigen::ArrayXd::LinSpaced(y.size(), 0, double(y.size() - 1)));
+      changed_x_ = true;
+    }
+    y_ = std::make_shared<const Eigen::ArrayXd>(std::move(y));
+    changed_y_ = true;
+    touch();
+    return *this;
+  }
+
+  /// The abscissas
+  const Eigen::ArrayXd& x() const { return *x_; }
+
+  /// The ordinates
+  const Eigen::ArrayXd& y() const { return *y_; }
+
+private:
+  friend class SceneAxes;
+
+  explicit SceneLine(pybind11::dict kwargs)
+    : x_(std::make_shared<const Eigen::ArrayXd>())
+    , y_(std::make_shared<const Eigen::ArrayXd>())
+    , kwargs_(std::move(kwargs))
+  {}
+
+  pybind11::object create(pybind11::handle ax) override
+  {
+    changed_x_ = changed_y_ = false;
+    auto lines = ax.attr("plot")(view(x_), view(y_), **kwargs_);
+    return lines[pybind11::int_(0)];
+  }
+
+  bool moves_limits() const override { return changed_x_ or changed_y_; }
+
+  void update() override
+  {
+    if (changed_x_) {
+      artist().attr("set_data")(view(x_), view(y_));
+    } else if (changed_y_) {
+      artist().attr("set_ydata")(view(y_));
+    }
+    changed_x_ = changed_y_ = false;
+  }
+
+  std::shared_ptr<const Eigen::ArrayXd> x_;
+  std::shared_ptr<const Eigen::ArrayXd> y_;
+  /// Whether x_ holds indices rather than abscissas given by set_data()
+  bool auto_x_ = true;
+  pybind11::dict kwargs_;
+  bool changed_x_ = false;
+  bool changed_y_ = false;
+};
+
+/**
+   @brief An image shown with `imshow`
+*/
+class SceneImage : public SceneNode
+{
+public:
+  /**
+     @brief Replace the pixel values
+
+     @param data The values, one row per image row
+  */
+  SceneImage& set_array(Eigen::ArrayXXd data)
+  {
+    data_ = std::make_shared<const Eigen::ArrayXXd>(std::move(data));
+    changed_data_ = true;
+    touch();
+    return *this;
+  }
+
+  /// Set the range of values mapped to the colormap
+  SceneImage& set_clim(double vmin, double vmax)
+  {
+    if (not clim_set_ or vmin != vmin_ or vmax != vmax_) {
+      vmin_ = vmin;
+      vmax_ = vmax;
+      clim_set_ = changed_clim_ = true;
+      touch();
+    }
+    return *this;
+  }
+
+  /// The pixel values
+  const Eigen::ArrayXXd& data() const { return *data_; }
+
+private:
+  friend class SceneAxes;
+
+  explicit SceneImage(pybind11::dict kwargs)
+    : data_(
+        std::make_shared<const Eigen::ArrayXXd>(Eigen::ArrayXXd::Zero(1, 1)))
+    , kwargs_(std::move(kwargs))
+  {}
+
+  pybind11::object create(pybind11::handle ax) override
+  {
+    changed_data_ = false;
+    auto image = ax.attr("imshow")(view(data_), **kwargs_);
+    if (changed_clim_) {
+      image.attr("set_clim")(vmin_, vmax_);
+      changed_clim_ = false;
+    }
+    return image;
+  }
+
+  void update() override
+  {
+    if (changed_data_) {
+      artist().attr("set_data")(view(data_));
+    }
+    if (changed_clim_) {
+      artist().attr("set_clim")(vmin_, vmax_);
+    }
+    changed_data_ = changed_clim_ = false;
+  }
+
+  std::shared_ptr<const Eigen::ArrayXXd> data_;
+  pybind11::dict kwargs_;
+  double vmin_ = 0;
+  double vmax_ = 1;
+  bool clim_set_ = false;
+  bool changed_data_ = false;
+  bool changed_clim_ = false;
+};
+
+/**
+   @brief A text label.  Setting an unchanged string or position is free.
+*/
+class SceneText : public SceneNode
+{
+public:
+  /// Replace the text
+  SceneText& set_text(const std::string& text)
+  {
+    if (text != text_) {
+      text_ = text;
+      changed_text_ = true;
+      touch();
+    }
+    return *this;
+  }
+
+  /// Move the text
+  SceneText& set_position(double x, double y)
+  {
+    if (x != x_ or y != y_) {
+      x_ = x;
+      y_ = y;
+      changed_position_ = true;
+      touch();
+    }
+    return *this;
+  }
+
+  /// The text
+  const std::string& text() const { return text_; }
+
+private:
+  friend class SceneAxes;
+
+  SceneText(double x, double y, std::string text, pybind11::dict kwargs)
+    : text_(std::move(text))
+    , x_(x)
+    , y_(y)
+    , kwargs_(std::move(kwargs))
+  {}
+
+  pybind11::object create(pybind11::handle ax) override
+  {
+    changed_text_ = changed_position_ = false;
+    return ax.attr("text")(x_, y_, text_, **kwargs_);
+  }
+
+  void update() override
+  {
+    if (changed_text_) {
+      artist().attr("set_text")(text_);
+    }
+    if (changed_position_) {
+      artist().attr("set_position")(pybind11::make_tuple(x_, y_));
+    }
+    changed_text_ = changed_position_ = false;
+  }
+
+  std::string text_;
+  double x_;
+  double y_;
+  pybind11::dict kwargs_;
+  bool changed_text_ = false;
+  bool changed_position_ = false;
+};
+
+/**
+   @brief The retained content of one matplotlib Axes
+*/
+class SceneAxes
+{
+public:
+  /**
+     @brief Add a line, drawn with `plot` on the next sync
+
+     @param kwargs Keyword arguments for `plot`
+  */
+  SceneLine& line(pybind11::dict kwargs = pybind11::dict())
+  {
+    return add(new SceneLine(std::move(kwargs)));
+  }
+
+  /**
+     @brief Add an image, drawn with `imshow` on the next sync
+
+     @param kwargs Keyword arguments for `imshow`
+  */
+  SceneImage& image(pybind11::dict kwargs = pybind11::dict())
+  {
+    return add(new SceneImage(std::move(kwargs)));
+  }
+
+  /**
+     @brief Add a text, drawn with `text` on the next sync
+
+     @param x The abscissa of the text
+     @param y The ordinate of the text
+     @param text The initial text
+     @param kwargs Keyword arguments for `text`
+  */
+  SceneText& text(double x,
+                  double y,
+                  std::string text = "",
+                  pybind11::dict kwargs = pybind11::dict())
+  {
+    return add(new SceneText(x, y, std::move(text), std::move(kwargs)));
+  }
+
+  /// Set the x limits
+  SceneAxes& set_xlim(double lo, double hi)
+  {
+    return limit(xlim_, lo, hi, changed_xlim_);
+  }
+
+  /// Set the y limits
+  SceneAxes& set_ylim(double lo, double hi)
+  {
+    return limit(ylim_, lo, hi, changed_ylim_);
+  }
+
+  /**
+     @brief Rescale the view whenever line data changes.  This is on by
+     default, and turned off by setting limits.
+  */
+  SceneAxes& set_autoscale(bool on)
+  {
+    autoscale_ = on;
+    return *this;
+  }
+
+  /// The matplotlib Axes
+  const pybind11::object& axes() const { return ax_; }
+
+private:
+  friend class SceneFigure;
+
+  explicit SceneAxes(pybind11::object ax)
+    : ax_(std::move(ax))
+  {}
+
+  template<class Node>
+  Node& add(Node* node)
+  {
+    nodes_.emplace_back(node);
+    return *node;
+  }
+
+  SceneAxes& limit(std::pair<double, double>& lim,
+                   double lo,
+                   double hi,
+                   bool& changed)
+  {
+    if (lim != std::make_pair(lo, hi)) {
+      lim = { lo, hi };
+      changed = true;
+    }
+    autoscale_ = false;
+    return *this;
+  }
+
+  /// Push changes, returning the number of artists changed
+  size_t sync()
+  {
+    size_t changed = 0;
+    bool rescale = false;
+    for (auto& node : nodes_) {
+      bool data = node->moves_limits();
+      if (node->sync(ax_)) {
+        ++changed;
+        rescale = rescale or data;
+      }
+    }
+    if (rescale and autoscale_) {
+      ax_.attr("relim")();
+      ax_.attr("autoscale_view")();
+    }
+    if (changed_xlim_) {
+      ax_.attr("set_xlim")(xlim_.first, xlim_.second);
+      ++changed;
+    }
+    if (changed_ylim_) {
+      ax_.attr("set_ylim")(ylim_.first, ylim_.second);
+      ++changed;
+    }
+    changed_xlim_ = changed_ylim_ = false;
+    return changed;
+  }
+
+  pybind11::object ax_;
+  std::vector<std::unique_ptr<SceneNode>> nodes_;
+  std::pair<double, double> xlim_;
+  std::pair<double, double> ylim_;
+  bool changed_xlim_ = false;
+  bool changed_ylim_ = false;
+  bool autoscale_ = true;
+};
+
+/**
+   @brief A retained description of a figure that updates matplotlib
+   incrementally.
+
+   Rebuilding a figure with fresh `plot` and `imshow` calls on every update
+   costs time proportional to the whole figure.  A SceneFigure instead keeps
+   `c++` objects for its lines, images and texts, each tracking what changed,
+   and sync() pushes only those changes to the existing artists with
+   `set_ydata`, `set_data`, `set_text` and the like before requesting a
+   redraw
+   ```
+   auto [fig, ax] = mplotpp::tuple<2>(plt.attr("subplots")());
+   mplotpp::SceneFigure scene(fig);
+   auto& axes = scene.axes(ax);
+   auto& trace = axes.line(py::dict("color"_a = "C1"));
+   auto& label = axes.text(0.05, 0.9, "",
+                           py::dict("transform"_a = ax.attr("transAxes")));
+   while (running) {
+     trace.set_ydata(next_frame());
+     label.set_text(status());
+     scene.sync();
+     plt.attr("pause")(0.01);
+   }
+   ```
+   Line and image data is handed to matplotlib as views of shared storage, so
+   pushing new data makes no copy and rebuilds nothing on the `c++` side.
+   Note that matplotlib's `Line2D.set_data`, `Line2D.set_ydata` and
+   `AxesImage.set_data` copy the arrays they are given, so each changed
+   array is still copied once per sync().  Nothing is sent to matplotlib,
+   and no redraw is requested, when nothing changed.
+*/
+class SceneFigure
+{
+public:
+  /**
+     @brief Attach to a figure
+
+     @param fig The matplotlib Figure
+  */
+  explicit SceneFigure(pybind11::object fig)
+    : fig_(std::move(fig))
+  {}
+
+  /**
+     @brief Add retained content for axes of the figure
+
+     @param ax The matplotlib Axes
+     @return The retained axes, valid for the lifetime of the SceneFigure
+  */
+  SceneAxes& axes(pybind11::object ax)
+  {
+    axes_.emplace_back(new SceneAxes(std::move(ax)));
+    return *axes_.back();
+  }
+
+  /**
+     @brief Push all changes to matplotlib and request a redraw if anything
+     changed
+
+     @return The number of artists and limits changed
+  */
+  size_t sync()
+  {
+    size_t changed = 0;
+    for (auto& ax : axes_) {
+      changed += ax->sync();
+    }
+    if (changed > 0) {
+      fig_.attr("canvas").attr("draw_idle")();
+    }
+    return changed;
+  }
+
+  /// The matplotlib Figure
+  const pybind11::object& figure() const { return fig_; }
+
+private:
+  pybind11::object fig_;
+  std::vector<std::unique_ptr<SceneAxes>> axes_;
+};
+
+}
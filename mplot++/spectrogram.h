@@ -0,0 +1,395 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <mplot++/mplot++.h>
+#include <mplot++/parallel.h>
+#include <stdexcept>
+#include <vector>
+
+namespace mplotpp {
+
+/// Window functions applied to each segment, as in numpy
+enum class Window
+{
+  Hann,
+  Hamming,
+  Blackman,
+  Rectangular
+};
+
+/// What a spectrogram measures
+enum class SpectrumMode
+{
+  /// Power spectral density, as `specgram(mode="psd")`
+  PSD,
+  /// Magnitude, as `specgram(mode="magnitude")`
+  Magnitude
+};
+
+/**
+   @brief Parameters of spectrogram(), named and defaulted as for
+   `matplotlib.axes.Axes.specgram`
+*/
+struct STFTOptions
+{
+  /// The length of each segment, a power of two
+  Eigen::Index nfft = 256;
+  /// The number of samples shared by consecutive segments
+  Eigen::Index noverlap = 128;
+  /// The sampling frequency
+  double fs = 2;
+  Window window = Window::Hann;
+  SpectrumMode mode = SpectrumMode::PSD;
+  /// Whether to give decibels, `10 log10` of PSD or `20 log10` of magnitude
+  bool db = true;
+  /// Whether to subtract the mean of each segment before windowing
+  bool detrend_mean = false;
+  /// If positive, the most time columns, averaging groups of segments
+  Eigen::Index max_columns = 0;
+  /// If positive, the most frequency rows, averaging groups of bins
+  Eigen::Index max_rows = 0;
+};
+
+namespace detail {
+
+/**
+   @private
+   @brief Minimum number of segments given to each thread
+*/
+constexpr Eigen::Index stft_grain = 16;
+
+/**
+   @private
+   @brief The symmetric window of length `n`, as numpy.hanning() etc.
+*/
+inline Eigen::ArrayXd
+window(Window w, Eigen::Index n)
+{
+  if (w == Window::Rectangular or n == 1) {
+    return Eigen::ArrayXd::Ones(n);
+  }
+  const double pi = 3.14159265358979323846;
+  Eigen::ArrayXd phase =
+    Eigen::ArrayXd::LinSpaced(n, 0, double(n - 1)) * (2 * pi / double(n - 1));
+  switch (w) {
+    case Window::Hann:
+      return 0.5 - 0.5 * phase.cos();
+    case Window::Hamming:
+      return 0.54 - 0.46 * phase.cos();
+    default:
+      return 0.42 - 0.5 * phase.cos() + 0.08 * (2 * phase).cos();
+  }
+}
+
+/**
+   @private
+   @brief The squared magnitudes of the discrete Fourier transform of real
+   data of a power of two length
+
+   The `n` real values are transformed as `n / 2` complex values by an
+   iterative radix-2 FFT and then separated.  Real and imaginary parts are
+   held in separate arrays and the twiddle factors of each stage are
+   contiguous, so that the butterflies vectorise without `std::complex`.
+   A plan is read-only and may be shared between threads, each with its own
+   Scratch.
+*/
+class RealFFT
+{
+public:
+  struct Scratch
+  {
+    explicit Scratch(const RealFFT& fft)
+      : re(size_t(fft.m_))
+      , im(size_t(fft.m_))
+    {}
+    std::vector<double> re;
+    std::vector<double> im;
+  };
+
+  /// @throw std::invalid_argument if `n` is not a power of two of at least 2
+  explicit RealFFT(Eigen::Index n)
+    : n_(n)
+    , m_(n / 2)
+  {
+    if (n < 2 or (n & (n - 1)) != 0) {
+      throw(std::invalid_argument("FFT length must be a power of two"));
+    }
+    const double pi = 3.14159265358979323846;
+    reverse_.resize(size_t(m_));
+    int bits = 0;
+    while ((Eigen::Index(1) << bits) < m_) {
+      ++bits;
+    }
+    for (Eigen::Index i = 0; i < m_; ++i) {
+      Eigen::Index r = 0;
+      for (int b = 0; b < bits; ++b) {
+        r |= ((i >> b) & 1) << (bits - 1 - b);
+      }
+      reverse_[size_t(i)] = r;
+    }
+    // Stage with butterflies of span `half` uses exp(-2 pi i j / (2 half))
+    for (Eigen::Index half = 1; half < m_; half *= 2) {
+      for (Eigen::Index j = 0; j < half; ++j) {
+        double a = -pi * double(j) / double(half);
+        twiddle_re_.push_back(std::cos(a));
+        twiddle_im_.push_back(std::sin(a));
+      }
+    }
+    for (Eigen::Index k = 0; k <= m_; ++k) {
+      double a = -2 * pi * double(k) / double(n_);
+      rotate_re_.push_back(std::cos(a));
+      rotate_im_.push_back(std::sin(a));
+    }
+  }
+
+  Eigen::Index size() const { return n_; }
+
+  /**
+     @brief Transform `n` real values
+
+     @param x The values
+     @param out Set to the `n / 2 + 1` values of `|X_k|^2`
+     @param s Workspace
+  */
+  void power(const double* x, double* out, Scratch& s) const
+  {
+    double* re = s.re.data();
+    double* im = s.im.data();
+    for (Eigen::Index i = 0; i < m_; ++i) {
+      const Eigen::Index r = reverse_[size_t(i)];
+      re[r] = x[2 * i];
+      im[r] = x[2 * i + 1];
+    }
+    const double* wr = twiddle_re_.data();
+    const double* wi = twiddle_im_.data();
+    for (Eigen::Index half = 1; half < m_; half *= 2) {
+      for (Eigen::Index i = 0; i < m_; i += 2 * half) {
+        double* ar = re + i;
+        double* ai = im + i;
+        double* br = ar + half;
+        double* bi = ai + half;
+        for (Eigen::Index j = 0; j < half; ++j) {
+          const double tr = br[j] * wr[j] - bi[j] * wi[j];
+          const double ti = br[j] * wi[j] + bi[j] * wr[j];
+          br[j] = ar[j] - tr;
+          bi[j] = ai[j] - ti;
+          ar[j] += tr;
+          ai[j] += ti;
+        }
+      }
+      wr += half;
+      wi += half;
+    }
+    // Separate the transforms of the even and odd samples:
+    // X_k = E_k + exp(-2 pi i k / n) O_k
+    for (Eigen::Index k = 0; k <= m_; ++k) {
+      const Eigen::Index a = k % m_;
+      const Eigen::Index b = (m_ - k) % m_;
+      const double er = 0.5 * (re[a] + re[b]);
+      const double ei = 0.5 * (im[a] - im[b]);
+      const double or_ = 0.5 * (im[a] + im[b]);
+      const double oi = -0.5 * (re[a] - re[b]);
+      const double xr = er + rotate_re_[size_t(k)] * or_ -
+                        rotate_im_[size_t(k)] * oi;
+      const double xi = ei + rotate_re_[size_t(k)] * oi +
+                        rotate_im_[size_t(k)] * or_;
+      out[k] = xr * xr + xi * xi;
+    }
+  }
+
+private:
+  Eigen::Index n_;
+  Eigen::Index m_;
+  std::vector<Eigen::Index> reverse_;
+  std::vector<double> twiddle_re_;
+  std::vector<double> twiddle_im_;
+  std::vector<double> rotate_re_;
+  std::vector<double> rotate_im_;
+};
+
+}
+
+/**
+   @brief A time-frequency matrix and its axes
+*/
+struct Spectrogram
+{
+  /// One row per frequency and one column per time
+  Eigen::ArrayXXd values;
+  /// The frequency of each row, the mean of the bins it combines
+  Eigen::ArrayXd freqs;
+  /// The time of each column, the mean of the centres of its segments
+  Eigen::ArrayXd times;
+
+  /**
+     @brief Draw the spectrogram with `ax.imshow`, as `specgram` does
+
+     As in `specgram`, the time extent is padded by half the spacing of the
+     columns, and the frequency extent runs from the first to the last
+     frequency.
+
+     @param ax The Axes
+     @param kwargs Keyword arguments for `imshow`, such as `cmap`
+  */
+  pybind11::object imshow(pybind11::object ax,
+                          pybind11::dict kwargs = pybind11::dict()) const
+  {
+    // Half the spacing of the columns, or 0.5 for a single column
+    Eigen::Index nt = times.size();
+    double half = nt > 1 ? (times(nt - 1) - times(0)) / double(nt - 1) / 2
+                         : 0.5;
+    auto extent = pybind11::make_tuple(times(0) - half,
+                                       times(nt - 1) + half,
+                                       freqs(0),
+                                       freqs(freqs.size() - 1));
+    return ax.attr("imshow")(adopt(Eigen::ArrayXXd(values)),
+                             pybind11::arg("origin") = "lower",
+                             pybind11::arg("aspect") = "auto",
+                             pybind11::arg("extent") = extent,
+                             **kwargs);
+  }
+
+  /**
+     @brief Draw the spectrogram with `ax.pcolormesh`, centred on its times
+     and frequencies
+
+     @param ax The Axes
+     @param kwargs Keyword arguments for `pcolormesh`
+  */
+  pybind11::object pcolormesh(pybind11::object ax,
+                              pybind11::dict kwargs = pybind11::dict()) const
+  {
+    return ax.attr("pcolormesh")(adopt(Eigen::ArrayXd(times)),
+                                 adopt(Eigen::ArrayXd(freqs)),
+                                 adopt(Eigen::ArrayXXd(values)),
+                                 pybind11::arg("shading") = "nearest",
+                                 **kwargs);
+  }
+};
+
+/**
+   @brief Short-time Fourier transform of a long real signal, reduced to the
+   resolution of a plot
+
+   `ax.specgram` copies the signal to python and computes every segment on
+   one thread, keeping all of them.  Here segments are transformed in
+   parallel, and with `max_columns` and `max_rows` consecutive segments and
+   frequency bins are averaged as they are computed, so a recording of
+   billions of samples gives a matrix no larger than the plot
+   ```
+   auto x = mplotpp::mapped_array<float>::raw("recording.f32");
+   mplotpp::STFTOptions options;
+   options.nfft = 4096;
+   options.noverlap = 2048;
+   options.fs = 48000;
+   options.max_columns = 2000;
+   auto spec = mplotpp::spectrogram(x.vector(), options);
+   spec.imshow(ax, py::dict("cmap"_a = "magma"));
+   ```
+   The one-sided spectrum, scaling, segment times and frequencies follow
+   `specgram`.  Averaging is of power or magnitude, before conversion to
+   decibels.  The GIL is released while computing.
+
+   @param x The signal, an Eigen vector of any arithmetic type
+   @param options The segments, window, scaling and output size
+   @return The spectrogram
+   @throw std::invalid_argument if `nfft` is not a power of two, `noverlap`
+   is not less than `nfft`, or the signal is shorter than `nfft`
+*/
+template<class Derived>
+Spectrogram
+spectrogram(const Eigen::DenseBase<Derived>& x,
+            const STFTOptions& options = STFTOptions())
+{
+  const Eigen::Index nfft = options.nfft;
+  const Eigen::Index step = nfft - options.noverlap;
+  if (options.noverlap < 0 or step <= 0) {
+    throw(std::invalid_argument("noverlap must be in [0, nfft)"));
+  }
+  if (x.size() < nfft) {
+    throw(std::invalid_argument("Signal is shorter than nfft"));
+  }
+  const detail::RealFFT fft(nfft);
+  const Eigen::ArrayXd window = detail::window(options.window, nfft);
+  const Eigen::Index frames = (x.size() - options.noverlap) / step;
+  const Eigen::Index bins = nfft / 2 + 1;
+  const Eigen::Index cols = options.max_columns > 0
+                              ? std::min(options.max_columns, frames)
+                              : frames;
+  const Eigen::Index rows =
+    options.max_rows > 0 ? std::min(options.max_rows, bins) : bins;
+  const bool psd = options.mode == SpectrumMode::PSD;
+
+  // Scaling of |X_k|^2 to the one-sided density, or of |X_k| to magnitude
+  Eigen::ArrayXd scale;
+  if (psd) {
+    scale = Eigen::ArrayXd::Constant(
+      bins, 2 / (options.fs * window.square().sum()));
+    scale(0) /= 2;
+    scale(bins - 1) /= 2;
+  } else {
+    scale = Eigen::ArrayXd::Constant(bins, 1 / window.sum());
+  }
+
+  Spectrogram result;
+  result.values.resize(rows, cols);
+  result.times.resize(cols);
+  result.freqs.resize(rows);
+  for (Eigen::Index r = 0; r < rows; ++r) {
+    const Eigen::Index b0 = bins * r / rows;
+    const Eigen::Index b1 = bins * (r + 1) / rows;
+    result.freqs(r) = 0.5 * double(b0 + b1 - 1) * options.fs / double(nfft);
+  }
+
+  pybind11::gil_scoped_release release;
+  parallel_for(
+    Eigen::Index(0),
+    cols,
+    std::max<Eigen::Index>(1, detail::stft_grain * cols / frames),
+    [&](Eigen::Index first, Eigen::Index last) {
+      detail::RealFFT::Scratch scratch(fft);
+      Eigen::ArrayXd segment(nfft);
+      Eigen::ArrayXd power(bins);
+      Eigen::ArrayXd sum(bins);
+      for (Eigen::Index c = first; c < last; ++c) {
+        const Eigen::Index f0 = frames * c / cols;
+        const Eigen::Index f1 = frames * (c + 1) / cols;
+        sum.setZero();
+        for (Eigen::Index f = f0; f < f1; ++f) {
+          for (Eigen::Index i = 0; i < nfft; ++i) {
+            segment(i) = double(x.derived().coeff(f * step + i));
+          }
+          if (options.detrend_mean) {
+            segment -= segment.mean();
+          }
+          segment *= window;
+          fft.power(segment.data(), power.data(), scratch);
+          if (psd) {
+            sum += power;
+          } else {
+            sum += power.sqrt();
+          }
+        }
+        sum *= scale / double(f1 - f0);
+        for (Eigen::Index r = 0; r < rows; ++r) {
+          const Eigen::Index b0 = bins * r / rows;
+          const Eigen::Index b1 = bins * (r + 1) / rows;
+          double v = sum.segment(b0, b1 - b0).mean();
+          if (options.db) {
+            v = (psd ? 10 : 20) * std::log10(v);
+          }
+          result.values(r, c) = v;
+        }
+        result.times(c) =
+          (double(nfft) / 2 + double(step) * 0.5 * double(f0 + f1 - 1)) /
+          options.fs;
+      }
+    });
+  return result;
+}
+
+}
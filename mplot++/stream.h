@@ -0,0 +1,448 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mplot++/mplot++.h>
+#include <utility>
+#include <vector>
+
+namespace mplotpp {
+
+/**
+   @brief Fixed capacity ring buffer whose contents are always contiguous
+
+   Every value is stored twice, at positions `i` and `i + capacity()` of a
+   buffer of twice the capacity.  The most recent size() values therefore
+   always occupy a single contiguous range, so they can be handed to numpy as
+   a slice of one array without rearranging the buffer.
+
+   @tparam T The data type
+*/
+template<class T>
+class RingBuffer
+{
+public:
+  /**
+     @brief Construct an empty ring buffer
+
+     @param capacity The maximum number of values held
+     @throw std::invalid_argument if capacity is zero
+  */
+  explicit RingBuffer(size_t capacity)
+    : capacity_(capacity)
+    , storage_(std::make_shared<std::vector<T>>(2 * capacity))
+  {
+    if (capacity == 0) {
+      throw(std::invalid_argument("RingBuffer capacity is zero"));
+    }
+  }
+
+  /// The maximum number of values held
+  size_t capacity() const { return capacity_; }
+
+  /// The number of values currently held
+  size_t size() const { return size_; }
+
+  /// Append a value, discarding the oldest if the buffer is full
+  void push(T value)
+  {
+    (*storage_)[head_] = value;
+    (*storage_)[head_ + capacity_] = value;
+    head_ = head_ + 1 == capacity_ ? 0 : head_ + 1;
+    size_ = std::min(size_ + 1, capacity_);
+  }
+
+  /// Append values, discarding the oldest if the buffer becomes full
+  template<class Derived>
+  void push(const Eigen::DenseBase<Derived>& values)
+  {
+    Eigen::Index n = values.size();
+    Eigen::Index first = std::max<Eigen::Index>(0, n - Eigen::Index(capacity_));
+    for (Eigen::Index i = first; i < n; ++i) {
+      push(values.derived().coeff(i));
+    }
+  }
+
+  /// Remove all values
+  void clear()
+  {
+    head_ = 0;
+    size_ = 0;
+  }
+
+  /// Offset in storage() of the oldest value of the contiguous window
+  size_t offset() const { return head_ + capacity_ - size_; }
+
+  /// Pointer to the oldest value, with the others following contiguously
+  const T* data() const { return storage_->data() + offset(); }
+
+  /// The most recent value
+  T back() const { return (*storage_)[head_ + capacity_ - 1]; }
+
+  /// The oldest value
+  T front() const { return *data(); }
+
+  /// The mirrored storage of size `2 * capacity()`
+  const std::shared_ptr<std::vector<T>>& storage() const { return storage_; }
+
+private:
+  size_t capacity_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+  std::shared_ptr<std::vector<T>> storage_;
+};
+
+/**
+   @brief One scrolling trace of a StreamingPlot
+
+   Instances are created by StreamingPlot::add_series() and remain owned by
+   the StreamingPlot.  Appending only touches the `c++` ring buffers; matplotlib
+   sees the new data at the next StreamingPlot::update().
+*/
+class StreamSeries
+{
+public:
+  /// Append a point
+  void append(double x, double y)
+  {
+    x_.push(x);
+    y_.push(y);
+    track(y);
+    evict();
+    dirty_ = true;
+  }
+
+  /// Append a point whose x-coordinate is the number of points appended so far
+  void append(double y) { append(double(count_), y); }
+
+  /**
+     @brief Append a batch of points
+
+     @param x The x-coordinates
+     @param y The y-coordinates, of the same length as x
+     @throw std::invalid_argument if the lengths differ
+  */
+  void append(const Eigen::ArrayXd& x, const Eigen::ArrayXd& y)
+  {
+    if (x.size() != y.size()) {
+      throw(std::invalid_argument("x and y lengths differ in append()"));
+    }
+    if (y.size() == 0) {
+      return;
+    }
+    x_.push(x);
+    y_.push(y);
+    for (Eigen::Index i = 0; i < y.size(); ++i) {
+      track(y[i]);
+    }
+    evict();
+    dirty_ = true;
+  }
+
+  /// The number of points held, which is at most capacity()
+  size_t size() const { return y_.size(); }
+
+  /// The maximum number of points held
+  size_t capacity() const { return y_.capacity(); }
+
+  /// The matplotlib `Line2D` displaying this series
+  const pybind11::object& line() const { return line_; }
+
+private:
+  friend class StreamingPlot;
+
+  StreamSeries(pybind11::object ax, pybind11::object line, size_t capacity)
+    : ax_(std::move(ax))
+    , line_(std::move(line))
+    , x_(capacity)
+    , y_(capacity)
+    , xarr_(view(x_.storage()))
+    , yarr_(view(y_.storage()))
+  {}
+
+  // Record the next value in the candidates for the window extrema.  A
+  // value is dropped once a later one is at least as extreme, so each deque
+  // is monotonic and its front is the extremum of the window.
+  void track(double y)
+  {
+    if (not std::isnan(y)) {
+      while (not lows_.empty() and lows_.back().second >= y) {
+        lows_.pop_back();
+      }
+      lows_.emplace_back(count_, y);
+      while (not highs_.empty() and highs_.back().second <= y) {
+        highs_.pop_back();
+      }
+      highs_.emplace_back(count_, y);
+    }
+    ++count_;
+  }
+
+  // Drop the candidates that have left the ring buffer
+  void evict()
+  {
+    size_t oldest = count_ - y_.size();
+    while (not lows_.empty() and lows_.front().first < oldest) {
+      lows_.pop_front();
+    }
+    while (not highs_.empty() and highs_.front().first < oldest) {
+      highs_.pop_front();
+    }
+  }
+
+  // The extrema of the buffered values, ignoring NaN, or +inf and -inf if
+  // there are none
+  double ymin() const
+  {
+    return lows_.empty() ? std::numeric_limits<double>::infinity()
+                         : lows_.front().second;
+  }
+
+  double ymax() const
+  {
+    return highs_.empty() ? -std::numeric_limits<double>::infinity()
+                          : highs_.front().second;
+  }
+
+  // Push the current window to the Line2D
+  void sync()
+  {
+    auto window = pybind11::slice(ssize_t(x_.offset()),
+                                  ssize_t(x_.offset() + x_.size()),
+                                  1);
+    line_.attr("set_data")(xarr_[window], yarr_[window]);
+    dirty_ = false;
+  }
+
+  pybind11::object ax_;
+  pybind11::object line_;
+  RingBuffer<double> x_;
+  RingBuffer<double> y_;
+  pybind11::array_t<double> xarr_;
+  pybind11::array_t<double> yarr_;
+  std::deque<std::pair<size_t, double>> lows_;
+  std::deque<std::pair<size_t, double>> highs_;
+  size_t count_ = 0;
+  bool dirty_ = false;
+};
+
+/**
+   @brief Live plotting of scrolling traces using matplotlib blitting.
+
+   Each series keeps its most recent points in a RingBuffer and is drawn by a
+   single persistent, animated `Line2D` whose data is replaced with `set_data`
+   from numpy views of the ring.  Frames are composed by restoring a cached
+   background and drawing only the animated lines, then blitting, which is far
+   cheaper than redrawing the whole figure.  The background, including axes
+   and tick labels, is only redrawn when the view limits must change: the
+   x-limits jump ahead by half a window when the newest point scrolls out of
+   view, and the y-limits follow the values held by the series of each axes.
+   They expand when a value falls outside them, and shrink once the values
+   span less than half of them, so a spike stretches the axis only while it
+   is displayed.
+   ```
+   auto [fig, ax] = mplotpp::tuple<2>(plt.attr("subplots")());
+   plt.attr("show")("block"_a = false);
+   mplotpp::StreamingPlot stream(fig, 60);
+   auto& trace = stream.add_series(ax, 1000000, py::dict("color"_a = "C0"));
+   while (running) {
+     trace.append(t, sample());
+     stream.update();
+   }
+   ```
+   update() may be called as often as convenient; it only redraws when a
+   series has changed and at most at the target frame rate.  Note that recent
+   matplotlib versions copy the data passed to `set_data`, so each frame still
+   copies the visible window once, but nothing is rebuilt or reallocated on
+   the `c++` side.
+*/
+class StreamingPlot
+{
+public:
+  /**
+     @brief Construct a streaming plot on an existing figure
+
+     @param fig The matplotlib figure, which should already be shown
+     (non-blocking) if an interactive backend is used
+     @param fps The maximum number of frames drawn per second.  Zero or a
+     negative value disables throttling.
+  */
+  explicit StreamingPlot(pybind11::object fig, double fps = 60)
+    : fig_(std::move(fig))
+    , canvas_(fig_.attr("canvas"))
+    , state_(std::make_shared<State>())
+    , interval_(fps > 0 ? 1.0 / fps : 0.0)
+  {
+    std::weak_ptr<State> weak = state_;
+    cid_ = canvas_.attr("mpl_connect")(
+      "draw_event",
+      pybind11::cpp_function([weak](pybind11::object) {
+        if (auto state = weak.lock()) {
+          state->background.reset();
+        }
+      }));
+  }
+
+  StreamingPlot(const StreamingPlot&) = delete;
+  StreamingPlot& operator=(const StreamingPlot&) = delete;
+
+  ~StreamingPlot()
+  {
+    try {
+      canvas_.attr("mpl_disconnect")(cid_);
+    } catch (...) {
+    }
+  }
+
+  /**
+     @brief Add a trace to one of the axes of the figure
+
+     @param ax The axes to draw on
+     @param capacity The number of most recent points displayed
+     @param kwargs Keyword arguments for `ax.plot()` such as `color`
+     @return The new series, which remains valid for the lifetime of this
+     object
+  */
+  StreamSeries& add_series(pybind11::object ax,
+                           size_t capacity,
+                           pybind11::dict kwargs = pybind11::dict())
+  {
+    auto [line] = tuple<1>(ax.attr("plot")(pybind11::list(),
+                                           pybind11::list(),
+                                           pybind11::arg("animated") = true,
+                                           **kwargs));
+    series_.emplace_back(new StreamSeries(ax, line, capacity));
+    limits_stale_ = true;
+    return *series_.back();
+  }
+
+  /**
+     @brief Draw a frame if any series has changed
+
+     @param force If true, draw even if the target frame rate would be
+     exceeded
+     @return true if a frame was drawn
+  */
+  bool update(bool force = false)
+  {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - last_frame_;
+    if (not force and elapsed.count() < interval_) {
+      return false;
+    }
+    bool dirty = false;
+    for (auto& s : series_) {
+      if (s->dirty_) {
+        s->sync();
+        dirty = true;
+      }
+    }
+    if (not dirty and not force) {
+      return false;
+    }
+    last_frame_ = now;
+
+    if (update_limits() or not state_->background) {
+      // Draws the static artists and invalidates the background
+      canvas_.attr("draw")();
+      state_->background = std::make_unique<pybind11::object>(
+        canvas_.attr("copy_from_bbox")(fig_.attr("bbox")));
+    } else {
+      canvas_.attr("restore_region")(*state_->background);
+    }
+    for (auto& s : series_) {
+      s->ax_.attr("draw_artist")(s->line_);
+    }
+    canvas_.attr("blit")(fig_.attr("bbox"));
+    canvas_.attr("flush_events")();
+    return true;
+  }
+
+private:
+  // Shared with the draw_event callback, which may outlive this object
+  struct State
+  {
+    std::unique_ptr<pybind11::object> background;
+  };
+
+  // Adjust view limits to the data, returning true if any changed
+  bool update_limits()
+  {
+    bool changed = limits_stale_;
+    limits_stale_ = false;
+    for (auto& s : series_) {
+      if (s->size() == 0) {
+        continue;
+      }
+      auto [x0, x1] = tuple<2>(s->ax_.attr("get_xlim")());
+      double xmin = x0.cast<double>();
+      double xmax = x1.cast<double>();
+      double first = s->x_.front();
+      double last = s->x_.back();
+      if (last > xmax or first < xmin) {
+        double width = std::max(last - first, std::abs(last) * 1e-12);
+        if (width == 0) {
+          width = 1;
+        }
+        s->ax_.attr("set_xlim")(last - width, last + width / 2);
+        changed = true;
+      }
+    }
+
+    // The y-limits of each axes span the buffered values of all its series
+    for (size_t k = 0; k < series_.size(); ++k) {
+      const auto& ax = series_[k]->ax_;
+      bool done = false;
+      for (size_t j = 0; j < k and not done; ++j) {
+        done = series_[j]->ax_.is(ax);
+      }
+      if (done) {
+        continue;
+      }
+      double lo = std::numeric_limits<double>::infinity();
+      double hi = -std::numeric_limits<double>::infinity();
+      for (size_t j = k; j < series_.size(); ++j) {
+        if (series_[j]->ax_.is(ax)) {
+          lo = std::min(lo, series_[j]->ymin());
+          hi = std::max(hi, series_[j]->ymax());
+        }
+      }
+      if (not(lo <= hi)) {
+        continue;
+      }
+      double margin =
+        hi > lo ? 0.1 * (hi - lo) : std::max(0.1 * std::abs(hi), 0.5);
+      lo -= margin;
+      hi += margin;
+      auto [y0, y1] = tuple<2>(ax.attr("get_ylim")());
+      double ymin = y0.cast<double>();
+      double ymax = y1.cast<double>();
+      // Shrinking waits until it halves the range, so that the background
+      // is not redrawn for every small change
+      if (lo + margin < ymin or hi - margin > ymax or
+          hi - lo < 0.5 * (ymax - ymin)) {
+        ax.attr("set_ylim")(lo, hi);
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  pybind11::object fig_;
+  pybind11::object canvas_;
+  std::shared_ptr<State> state_;
+  std::deque<std::unique_ptr<StreamSeries>> series_;
+  pybind11::object cid_;
+  double interval_;
+  std::chrono::steady_clock::time_point last_frame_;
+  bool limits_stale_ = false;
+};
+
+}
@@ -0,0 +1,530 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mplot++/mplot++.h>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+/**
+   @file trace.h
+   @brief Opt-in instrumentation of calls across the `c++`/python boundary.
+
+   Calls written as
+   ```
+   MPLOTPP_ATTR(ax, "plot")(x, y, "lw"_a = 2);
+   ```
+   are identical to `ax.attr("plot")(x, y, "lw"_a = 2)` unless the macro
+   `MPLOTPP_TRACE` is defined when `mplot++/trace.h` is included, in which case
+   every such call records its wall time split into GIL wait, attribute lookup,
+   argument conversion and python execution, together with the number of
+   bytes converted from Eigen or `std::vector` arguments.  Without
+   `MPLOTPP_TRACE` the macro expands to the plain call, so instrumentation
+   costs nothing.
+
+   Recorded events are exported with mplotpp::Tracer::write_chrome_trace() for
+   viewing in `chrome://tracing` or Perfetto, and summarised per call site with
+   mplotpp::Tracer::summary().  mplotpp::trace_matplotlib() additionally times
+   matplotlib's layout engines, figure drawing and the Agg renderer methods,
+   so that time inside a `savefig` or `draw` call can be attributed to layout
+   or rasterisation.
+*/
+
+#ifdef MPLOTPP_TRACE
+#define MPLOTPP_ATTR(obj, name)                                                \
+  ::mplotpp::TracedAttr((obj), (name), __FILE__, __LINE__)
+#define MPLOTPP_TRACE_CONCAT_(a, b) a##b
+#define MPLOTPP_TRACE_CONCAT(a, b) MPLOTPP_TRACE_CONCAT_(a, b)
+#define MPLOTPP_TRACE_SCOPE(name)                                              \
+  ::mplotpp::TraceScope MPLOTPP_TRACE_CONCAT(mplotpp_trace_scope_, __LINE__)(  \
+    (name), __FILE__, __LINE__)
+#else
+#define MPLOTPP_ATTR(obj, name) (obj).attr(name)
+#define MPLOTPP_TRACE_SCOPE(name) static_cast<void>(0)
+#endif
+
+namespace mplotpp {
+
+/**
+   @brief One timed interval recorded by the Tracer
+
+   Times are nanoseconds of `std::chrono::steady_clock`.  The phase durations
+   are only set for calls made through MPLOTPP_ATTR.
+*/
+struct TraceEvent
+{
+  std::string category;
+  std::string name;
+  std::string file;
+  int line = 0;
+  int64_t start = 0;
+  int64_t duration = 0;
+  std::thread::id thread;
+  size_t bytes = 0;
+  int64_t gil_wait = 0;
+  int64_t lookup = 0;
+  int64_t cast = 0;
+};
+
+/**
+   @brief Process-wide collector of TraceEvent records
+
+   Recording is thread-safe.  Recording starts disabled, unless some
+   translation unit of the program includes `mplot++/trace.h` with
+   `MPLOTPP_TRACE` defined, and can be switched off and on at run time.
+*/
+class Tracer
+{
+public:
+  /// The single Tracer of the process
+  static Tracer& instance()
+  {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  /// The current time in nanoseconds, as used for TraceEvent
+  static int64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+  }
+
+  /// Start or stop recording
+  void enable(bool on = true) { enabled_ = on; }
+
+  /// Whether events are being recorded
+  bool enabled() const { return enabled_; }
+
+  /// Add an event
+  void record(TraceEvent event)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.push_back(std::move(event));
+  }
+
+  /// A copy of the events recorded so far
+  std::vector<TraceEvent> events() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+  }
+
+  /// Discard all events
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_.clear();
+  }
+
+  /**
+     @brief Write all events in the Chrome trace-event JSON format
+
+     Calls made through MPLOTPP_ATTR appear as a span containing nested
+     spans for the GIL wait, lookup, cast and python phases.
+
+     @param path The file to write
+     @throw std::runtime_error if the file cannot be written
+  */
+  void write_chrome_trace(const std::string& path) const
+  {
+    std::ofstream out(path);
+    if (not out) {
+      throw(std::runtime_error("Cannot write " + path));
+    }
+    auto events = this->events();
+    std::map<std::thread::id, int> tids;
+    int pid = int(::getpid());
+    bool first = true;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    auto emit = [&](const std::string& cat,
+                    const std::string& name,
+                    int64_t start,
+                    int64_t duration,
+                    int tid,
+                    const std::string& args) {
+      out << (first ? "\n  " : ",\n  ") << "{\"ph\": \"X\", \"cat\": "
+          << quote(cat) << ", \"name\": " << quote(name)
+          << ", \"ts\": " << double(start) / 1e3
+          << ", \"dur\": " << double(duration) / 1e3 << ", \"pid\": " << pid
+          << ", \"tid\": " << tid << ", \"args\": {" << args << "}}";
+      first = false;
+    };
+    for (const auto& e : events) {
+      int tid = tids.emplace(e.thread, int(tids.size()) + 1).first->second;
+      std::string args;
+      if (not e.file.empty()) {
+        args = "\"site\": " + quote(e.file + ":" + std::to_string(e.line));
+      }
+      if (e.category == "call") {
+        if (not args.empty()) {
+          args += ", ";
+        }
+        args += "\"bytes\": " + std::to_string(e.bytes) +
+                ", \"gil_wait_us\": " + std::to_string(e.gil_wait / 1000) +
+                ", \"cast_us\": " + std::to_string(e.cast / 1000);
+      }
+      emit(e.category, e.name, e.start, e.duration, tid, args);
+      if (e.category == "call") {
+        int64_t t = e.start;
+        emit("gil", "gil wait", t, e.gil_wait, tid, "");
+        t += e.gil_wait;
+        emit("lookup", "lookup", t, e.lookup, tid, "");
+        t += e.lookup;
+        emit("cast", "cast", t, e.cast, tid, "");
+        t += e.cast;
+        emit("python", "python", t, e.start + e.duration - t, tid, "");
+      }
+    }
+    out << "\n]}\n";
+  }
+
+  /**
+     @brief Print a table of the recorded events, aggregated by call site and
+     sorted by total time
+
+     @param out The stream to print to
+  */
+  void summary(std::ostream& out) const
+  {
+    struct Totals
+    {
+      size_t count = 0;
+      int64_t total = 0, max = 0, gil_wait = 0, lookup = 0, cast = 0;
+      size_t bytes = 0;
+    };
+    std::map<std::string, Totals> sites;
+    for (const auto& e : events()) {
+      std::string key = e.category + " " + e.name;
+      if (not e.file.empty()) {
+        key += " (" + e.file + ":" + std::to_string(e.line) + ")";
+      }
+      auto& t = sites[key];
+      ++t.count;
+      t.total += e.duration;
+      t.max = std::max(t.max, e.duration);
+      t.gil_wait += e.gil_wait;
+      t.lookup += e.lookup;
+      t.cast += e.cast;
+      t.bytes += e.bytes;
+    }
+    std::vector<std::pair<std::string, Totals>> sorted(sites.begin(),
+                                                       sites.end());
+    std::sort(sorted.begin(), sorted.end(), [](auto& a, auto& b) {
+      return a.second.total > b.second.total;
+    });
+
+    auto ms = [](int64_t ns) { return double(ns) / 1e6; };
+    out << std::right << std::setw(8) << "count" << std::setw(12)
+        << "total ms" << std::setw(10) << "mean ms" << std::setw(10)
+        << "max ms" << std::setw(10) << "gil ms" << std::setw(10)
+        << "lookup ms" << std::setw(10) << "cast ms" << std::setw(12)
+        << "bytes"
+        << "  site\n";
+    out << std::fixed << std::setprecision(3);
+    for (auto& [key, t] : sorted) {
+      out << std::setw(8) << t.count << std::setw(12) << ms(t.total)
+          << std::setw(10) << ms(t.total) / double(t.count) << std::setw(10)
+          << ms(t.max) << std::setw(10) << ms(t.gil_wait) << std::setw(10)
+          << ms(t.lookup) << std::setw(10) << ms(t.cast) << std::setw(12)
+          << t.bytes << "  " << key << "\n";
+    }
+    out << std::defaultfloat;
+  }
+
+private:
+  Tracer()
+    : enabled_(false)
+  {}
+
+  static std::string quote(const std::string& s)
+  {
+    std::string out = "\"";
+    for (char c : s) {
+      if (c == '"' or c == '\\') {
+        out += '\\';
+        out += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+    return out + "\"";
+  }
+
+  std::atomic<bool> enabled_;
+  mutable std::mutex mutex_;
+  std::vector<TraceEvent> events_;
+};
+
+#ifdef MPLOTPP_TRACE
+namespace {
+/**
+   @private
+   @brief Enables the Tracer before main() in programs built for tracing.
+
+   This has internal linkage, so that the inline functions of this header
+   are the same in every translation unit whether or not it defines
+   `MPLOTPP_TRACE`.
+*/
+[[maybe_unused]] const bool trace_enabled_at_startup =
+  (Tracer::instance().enable(), true);
+}
+#endif
+
+namespace detail {
+
+/**
+   @private
+   @brief Number of bytes copied when an argument is converted to python
+*/
+template<class T>
+size_t
+converted_bytes(const T& arg)
+{
+  if constexpr (std::is_base_of<Eigen::EigenBase<T>, T>::value) {
+    return size_t(arg.size()) * sizeof(typename T::Scalar);
+  } else {
+    return 0;
+  }
+}
+
+template<class T, class Alloc>
+size_t
+converted_bytes(const std::vector<T, Alloc>& arg)
+{
+  return std::is_arithmetic<T>::value ? arg.size() * sizeof(T) : 0;
+}
+
+/**
+   @private
+   @brief Convert an argument to python ahead of a traced call.  Keyword
+   arguments, unpacking proxies and python objects are passed through.
+*/
+template<class T>
+decltype(auto)
+trace_cast(T&& arg)
+{
+  using U = std::decay_t<T>;
+  // The argument and keyword unpacking proxies are also handles
+  if constexpr (std::is_base_of<pybind11::handle, U>::value or
+                std::is_base_of<pybind11::arg, U>::value) {
+    return U(std::forward<T>(arg));
+  } else {
+    return pybind11::cast(std::forward<T>(arg));
+  }
+}
+
+}
+
+/**
+   @brief Proxy created by MPLOTPP_ATTR when `MPLOTPP_TRACE` is defined
+
+   Calling it looks up the attribute and calls it exactly as
+   `obj.attr(name)(args...)` would, recording a TraceEvent in the "call"
+   category.
+*/
+class TracedAttr
+{
+public:
+  TracedAttr(pybind11::handle obj, const char* name, const char* file, int line)
+    : obj_(obj)
+    , name_(name)
+    , file_(file)
+    , line_(line)
+  {}
+
+  /// The attribute itself, for uses other than calling it
+  operator pybind11::object() const { return obj_.attr(name_); }
+
+  template<class... Args>
+  pybind11::object operator()(Args&&... args) const
+  {
+    Tracer& tracer = Tracer::instance();
+    if (not tracer.enabled()) {
+      return obj_.attr(name_)(std::forward<Args>(args)...);
+    }
+
+    TraceEvent event;
+    event.category = "call";
+    event.name = name_;
+    event.file = file_;
+    event.line = line_;
+    event.thread = std::this_thread::get_id();
+    event.start = Tracer::now();
+    pybind11::gil_scoped_acquire gil;
+    int64_t t1 = Tracer::now();
+    event.gil_wait = t1 - event.start;
+
+    struct Record
+    {
+      TraceEvent& event;
+      ~Record()
+      {
+        event.duration = Tracer::now() - event.start;
+        Tracer::instance().record(std::move(event));
+      }
+    } record{ event };
+
+    pybind11::object method = obj_.attr(name_);
+    int64_t t2 = Tracer::now();
+    event.lookup = t2 - t1;
+    event.bytes = (size_t(0) + ... + detail::converted_bytes(args));
+    auto converted =
+      std::make_tuple(detail::trace_cast(std::forward<Args>(args))...);
+    event.cast = Tracer::now() - t2;
+    return std::apply(method, std::move(converted));
+  }
+
+private:
+  pybind11::handle obj_;
+  const char* name_;
+  const char* file_;
+  int line_;
+};
+
+/**
+   @brief Record the duration of a `c++` scope in the "scope" category.
+   Normally used through MPLOTPP_TRACE_SCOPE.
+*/
+class TraceScope
+{
+public:
+  TraceScope(const char* name, const char* file, int line)
+    : active_(Tracer::instance().enabled())
+  {
+    if (active_) {
+      event_.category = "scope";
+      event_.name = name;
+      event_.file = file;
+      event_.line = line;
+      event_.thread = std::this_thread::get_id();
+      event_.start = Tracer::now();
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+  ~TraceScope()
+  {
+    if (active_) {
+      event_.duration = Tracer::now() - event_.start;
+      Tracer::instance().record(std::move(event_));
+    }
+  }
+
+private:
+  bool active_;
+  TraceEvent event_;
+};
+
+/**
+   @brief Time matplotlib's own drawing stages
+
+   Wraps `FigureCanvasAgg.draw`, `Figure.draw`, `Figure.savefig`, the
+   layout engines and the drawing methods of the Agg renderer so that each
+   call records a TraceEvent in the "matplotlib" category.  Nesting of the
+   events shows how long a draw spends in layout and in rasterisation.  The
+   wrappers are installed once, on the matplotlib classes, and only record
+   while the Tracer is enabled.  Nothing is installed if the Tracer is not
+   enabled when this is called, as it is not without `MPLOTPP_TRACE`.
+*/
+inline void
+trace_matplotlib()
+{
+  static bool installed = false;
+  if (installed or not Tracer::instance().enabled()) {
+    return;
+  }
+  pybind11::dict scope;
+  pybind11::exec(R"(
+def install(record):
+    import functools
+    import time
+    import matplotlib.figure
+    from matplotlib.backends import backend_agg
+
+    def timed(f, label):
+        @functools.wraps(f)
+        def wrapper(*args, **kwargs):
+            start = time.perf_counter_ns()
+            try:
+                return f(*args, **kwargs)
+            finally:
+                record(label, time.perf_counter_ns() - start)
+        wrapper._mplotpp_traced = True
+        return wrapper
+
+    def wrap(cls, name, label):
+        f = cls.__dict__.get(name)
+        if f is not None and not getattr(f, '_mplotpp_traced', False):
+            setattr(cls, name, timed(f, label))
+
+    wrap(backend_agg.FigureCanvasAgg, 'draw', 'agg.canvas.draw')
+    wrap(matplotlib.figure.Figure, 'draw', 'figure.draw')
+    wrap(matplotlib.figure.Figure, 'savefig', 'figure.savefig')
+    wrap(matplotlib.figure.Figure, 'tight_layout', 'layout.tight_layout')
+    try:
+        import matplotlib.layout_engine as engines
+        for cls in (engines.TightLayoutEngine, engines.ConstrainedLayoutEngine):
+            wrap(cls, 'execute', 'layout.' + cls.__name__)
+    except ImportError:
+        pass
+
+    # The renderer binds several methods of its C++ implementation to each
+    # instance, so these are wrapped after construction.
+    methods = ('draw_path', 'draw_markers', 'draw_path_collection',
+               'draw_image', 'draw_text', 'draw_mathtext', 'draw_quad_mesh',
+               'draw_gouraud_triangle', 'draw_gouraud_triangles')
+    renderer = backend_agg.RendererAgg
+    original_init = renderer.__init__
+    if not getattr(original_init, '_mplotpp_traced', False):
+        @functools.wraps(original_init)
+        def init(self, *args, **kwargs):
+            original_init(self, *args, **kwargs)
+            for m in methods:
+                f = getattr(self, m, None)
+                if f is not None and not getattr(f, '_mplotpp_traced', False):
+                    setattr(self, m, timed(f, 'agg.' + m))
+        init._mplotpp_traced = True
+        renderer.__init__ = init
+)",
+                 scope);
+  scope["install"](pybind11::cpp_function([](std::string label, int64_t ns) {
+    Tracer& tracer = Tracer::instance();
+    if (not tracer.enabled()) {
+      return;
+    }
+    TraceEvent event;
+    event.category = "matplotlib";
+    event.name = std::move(label);
+    event.thread = std::this_thread::get_id();
+    event.duration = ns;
+    event.start = Tracer::now() - ns;
+    tracer.record(std::move(event));
+  }));
+  installed = true;
+}
+
+}
@@ -0,0 +1,530 @@
+// Copyright (c) by TassieBruce
+// Distributed under the MIT License
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mplot++/mapped.h>
+#include <mplot++/mplot++.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace mplotpp {
+
+/**
+   @brief A python module that is imported on first use.
+
+   Importing `matplotlib.pyplot` is a large part of the start-up time of a
+   short-lived plotting tool.  A LazyModule defers it until the module is
+   actually needed, so that code paths that end up not plotting do not pay
+   for it.  If no interpreter is running at that point one is started, and
+   finalised when the program exits
+   ```
+   mplotpp::LazyModule plt("matplotlib.pyplot");
+   ...
+   if (have_data) {
+     auto [fig, ax] = mplotpp::tuple<2>(plt.attr("subplots")());
+   }
+   ```
+   A LazyModule may be a global: it does not touch python when destroyed
+   after the interpreter has been finalised.
+*/
+class LazyModule
+{
+public:
+  /**
+     @brief Construct without importing
+
+     @param name The module to import on first use
+  */
+  explicit LazyModule(std::string name)
+    : name_(std::move(name))
+  {}
+
+  LazyModule(const LazyModule&) = delete;
+  LazyModule& operator=(const LazyModule&) = delete;
+
+  ~LazyModule()
+  {
+    if (not Py_IsInitialized()) {
+      module_.release();
+    }
+  }
+
+  /// The module, imported if necessary
+  const pybind11::module_& get()
+  {
+    if (not module_) {
+      ensure_interpreter();
+      module_ = pybind11::module_::import(name_.c_str());
+    }
+    return module_;
+  }
+
+  /// An attribute of the module, importing it if necessary
+  pybind11::object attr(const char* name) { return get().attr(name); }
+
+  /// Whether the module has been imported
+  bool imported() const { return bool(module_); }
+
+  /**
+     @brief Start an interpreter, to be finalised at exit, unless one is
+     already running
+  */
+  static void ensure_interpreter()
+  {
+    if (not Py_IsInitialized()) {
+      static std::unique_ptr<pybind11::scoped_interpreter> guard;
+      guard = std::make_unique<pybind11::scoped_interpreter>();
+    }
+  }
+
+private:
+  std::string name_;
+  pybind11::module_ module_;
+};
+
+namespace detail {
+
+/**
+   @private
+   @brief Write all of a buffer to a descriptor, retrying on EINTR
+
+   Sockets are written without raising SIGPIPE, so a peer that has gone
+   away is reported as a failed write rather than killing the process.
+*/
+inline bool
+write_all(int fd, const void* data, size_t size)
+{
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 and errno == ENOTSOCK) {
+      n = ::write(fd, p, size);
+    }
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+/// @private
+using Deadline = std::chrono::steady_clock::time_point;
+
+/**
+   @private
+   @brief Read exactly `size` bytes from a descriptor, retrying on EINTR, and
+   failing if they have not arrived by the deadline
+*/
+inline bool
+read_all(int fd, void* data, size_t size, Deadline deadline = Deadline::max())
+{
+  char* p = static_cast<char*>(data);
+  while (size > 0) {
+    if (deadline != Deadline::max()) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+      pollfd pfd{ fd, POLLIN, 0 };
+      int ready = left.count() > 0 ? ::poll(&pfd, 1, int(left.count())) : 0;
+      if (ready < 0 and errno == EINTR) {
+        continue;
+      }
+      if (ready <= 0) {
+        return false;
+      }
+    }
+    ssize_t n = ::read(fd, p, size);
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+/**
+   @private
+   @brief Send a length-prefixed message
+*/
+inline bool
+send_frame(int fd, const std::string& message)
+{
+  uint64_t size = message.size();
+  return write_all(fd, &size, sizeof(size)) and
+         write_all(fd, message.data(), message.size());
+}
+
+/**
+   @private
+   @brief Receive a length-prefixed message of at most `max_size` bytes
+*/
+inline bool
+receive_frame(int fd,
+              std::string& message,
+              uint64_t max_size = std::numeric_limits<uint64_t>::max(),
+              Deadline deadline = Deadline::max())
+{
+  uint64_t size;
+  if (not read_all(fd, &size, sizeof(size), deadline) or size > max_size or
+      size > message.max_size()) {
+    return false;
+  }
+  message.resize(size);
+  return read_all(fd, &message[0], size, deadline);
+}
+
+/**
+   @private
+   @brief The address of a Unix domain socket
+*/
+inline sockaddr_un
+unix_address(const std::string& path)
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw(std::invalid_argument("Socket path is too long: " + path));
+  }
+  std::strcpy(address.sun_path, path.c_str());
+  return address;
+}
+
+/**
+   @private
+   @brief Whether the process at the other end of a Unix domain socket runs as
+   the same user as this one
+*/
+inline bool
+same_user(int fd)
+{
+  ucred credentials{};
+  socklen_t size = sizeof(credentials);
+  return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 and
+         credentials.uid == ::getuid();
+}
+
+}
+
+/**
+   @brief A pre-warmed interpreter that runs plotting jobs in forked children.
+
+   Most of the run time of a short-lived plotting tool goes into starting the
+   interpreter and importing matplotlib.  A Zygote pays this once: it starts
+   an interpreter, selects a backend and imports the requested modules, then
+   waits for jobs on a Unix domain socket.  Each job runs in a child process
+   forked from the warm zygote, so it starts in a few milliseconds with
+   everything imported, and cannot disturb the state of the zygote or of
+   other jobs.
+
+   Jobs are `c++` handlers registered by name in the program that runs the
+   zygote.  A handler receives the request payload, which is an arbitrary
+   byte string such as a file name or serialised parameters, and returns a
+   reply payload
+   ```
+   // The server, started once
+   mplotpp::Zygote zygote("/tmp/plots.sock");
+   zygote.handle("report", [](const std::string& csv) {
+     auto plt = py::module_::import("matplotlib.pyplot");
+     ...
+     plt.attr("savefig")(csv + ".png");
+     return std::string("ok");
+   });
+   zygote.serve();
+
+   // A client, in any short-lived tool
+   auto reply = mplotpp::zygote_request("/tmp/plots.sock", "report", "a.csv");
+   ```
+   Within a single long-running program, fork() offers the same isolation
+   without a socket.
+
+   The socket is created accessible only to the user running the zygote, and
+   connections from processes of other users are closed unanswered, as are
+   requests larger than `max_request` or not received within
+   `request_timeout`.  The zygote is single-threaded and must be the only
+   user of the interpreter, and it reads requests one client at a time, so
+   a stalled client delays the others by up to `request_timeout`.  The
+   request "shutdown" makes serve() return.
+*/
+class Zygote
+{
+public:
+  /// A job handler, called in a child process with the GIL held
+  using Handler = std::function<std::string(const std::string&)>;
+
+  /// The largest job name or payload accepted, in bytes
+  static constexpr uint64_t max_request = uint64_t(64) << 20;
+
+  /// The time a client has to send its whole request
+  static constexpr std::chrono::milliseconds request_timeout{ 5000 };
+
+  /**
+     @brief Prepare a zygote.  Nothing is started until serve().
+
+     @param socket_path The Unix domain socket to listen on
+     @param modules The modules to import before accepting jobs
+     @param backend The matplotlib backend to select, or empty for the default
+  */
+  explicit Zygote(std::string socket_path,
+                  std::vector<std::string> modules = { "matplotlib.pyplot" },
+                  std::string backend = "Agg")
+    : socket_path_(std::move(socket_path))
+    , modules_(std::move(modules))
+    , backend_(std::move(backend))
+  {}
+
+  /**
+     @brief Register a job handler
+
+     @param job The job name used by clients
+     @param handler The handler
+  */
+  void handle(const std::string& job, Handler handler)
+  {
+    handlers_[job] = std::move(handler);
+  }
+
+  /**
+     @brief Run a function in a child process forked from this process
+
+     The calling thread must hold the GIL and be the only thread using the
+     interpreter.  In the child, the interpreter is reinitialised after the
+     fork, `f` is called, and the child exits without finalising python.
+
+     @param f The function to call in the child.  Its return value is the exit
+     status of the child.
+     @return The process id of the child
+     @throw std::runtime_error if the fork fails
+  */
+  template<class F>
+  static pid_t fork(F&& f)
+  {
+    std::fflush(nullptr);
+    PyOS_BeforeFork();
+    pid_t pid = ::fork();
+    if (pid == 0) {
+      PyOS_AfterFork_Child();
+      int status = 1;
+      try {
+        status = f();
+      } catch (std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+      } catch (...) {
+        std::fprintf(stderr, "Unknown exception in zygote child\n");
+      }
+      std::fflush(nullptr);
+      ::_exit(status);
+    }
+    PyOS_AfterFork_Parent();
+    if (pid < 0) {
+      detail::throw_errno("Cannot fork", "zygote");
+    }
+    return pid;
+  }
+
+  /**
+     @brief Start the interpreter, preload the modules and serve jobs until a
+     "shutdown" request or stop()
+
+     If an interpreter is already running it is used as it is.
+
+     @throw std::runtime_error if the socket cannot be created or a module
+     cannot be imported
+  */
+  void serve()
+  {
+    LazyModule::ensure_interpreter();
+    try {
+      if (not backend_.empty()) {
+        pybind11::module_::import("matplotlib").attr("use")(backend_);
+      }
+      for (const auto& m : modules_) {
+        pybind11::module_::import(m.c_str());
+      }
+    } catch (pybind11::error_already_set& e) {
+      throw(std::runtime_error(e.what()));
+    }
+
+    int server = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server < 0) {
+      detail::throw_errno("Cannot create socket", socket_path_);
+    }
+    auto address = detail::unix_address(socket_path_);
+    ::unlink(socket_path_.c_str());
+    // Only the owner may connect, as jobs run with the zygote's privileges
+    mode_t mask = ::umask(0077);
+    int bound =
+      ::bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::umask(mask);
+    if (bound != 0 or ::listen(server, 64) != 0) {
+      ::close(server);
+      detail::throw_errno("Cannot listen on", socket_path_);
+    }
+
+    stop_ = false;
+    while (not stop_) {
+      reap();
+      pollfd pfd{ server, POLLIN, 0 };
+      int ready = ::poll(&pfd, 1, 1000);
+      if (ready <= 0) {
+        continue;
+      }
+      int client = ::accept4(server, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0) {
+        continue;
+      }
+      // Clients are served one at a time, so a client that is slow, sends
+      // too much or cannot be served is dropped after at most
+      // request_timeout, delaying the clients queued behind it by as much
+      auto deadline = std::chrono::steady_clock::now() + request_timeout;
+      std::string job;
+      std::string payload;
+      try {
+        if (detail::same_user(client) and
+            detail::receive_frame(client, job, max_request, deadline) and
+            detail::receive_frame(client, payload, max_request, deadline)) {
+          dispatch(client, job, payload);
+        }
+      } catch (std::exception& e) {
+        std::fprintf(stderr, "zygote: %s\n", e.what());
+      }
+      ::close(client);
+    }
+
+    ::close(server);
+    ::unlink(socket_path_.c_str());
+    for (pid_t pid : children_) {
+      while (::waitpid(pid, nullptr, 0) < 0 and errno == EINTR) {
+      }
+    }
+    children_.clear();
+  }
+
+  /**
+     @brief Make serve() return after the current poll interval.  This is
+     safe to call from a signal handler.
+  */
+  void stop() { stop_ = true; }
+
+private:
+  void dispatch(int client, const std::string& job, const std::string& payload)
+  {
+    if (job == "shutdown") {
+      detail::send_frame(client, std::string(1, '\0'));
+      detail::send_frame(client, "");
+      stop_ = true;
+      return;
+    }
+    auto it = handlers_.find(job);
+    if (it == handlers_.end()) {
+      detail::send_frame(client, std::string(1, '\1'));
+      detail::send_frame(client, "Unknown job " + job);
+      return;
+    }
+    const Handler& handler = it->second;
+    children_.push_back(fork([&]() {
+      std::string reply;
+      char status = 0;
+      try {
+        reply = handler(payload);
+      } catch (std::exception& e) {
+        status = 1;
+        reply = e.what();
+      } catch (...) {
+        status = 1;
+        reply = "Unknown exception in handler for " + job;
+      }
+      bool sent = detail::send_frame(client, std::string(1, status)) and
+                  detail::send_frame(client, reply);
+      return sent and status == 0 ? 0 : 1;
+    }));
+  }
+
+  /// Collect the finished job children, leaving other children of the
+  /// process to their owners
+  void reap()
+  {
+    children_.erase(std::remove_if(children_.begin(),
+                                   children_.end(),
+                                   [](pid_t pid) {
+                                     return ::waitpid(pid, nullptr, WNOHANG) !=
+                                            0;
+                                   }),
+                    children_.end());
+  }
+
+  std::string socket_path_;
+  std::vector<std::string> modules_;
+  std::string backend_;
+  std::map<std::string, Handler> handlers_;
+  std::vector<pid_t> children_;
+  std::atomic<bool> stop_{ false };
+};
+
+/**
+   @brief Submit a job to a Zygote and wait for its reply
+
+   @param socket_path The socket the zygote listens on
+   @param job The name of a registered job, or "shutdown"
+   @param payload The request payload
+   @return The reply payload returned by the handler
+   @throw std::runtime_error if the zygote cannot be reached, or the handler
+   failed, in which case the message is the handler's error
+*/
+inline std::string
+zygote_request(const std::string& socket_path,
+               const std::string& job,
+               const std::string& payload = "")
+{
+  int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    detail::throw_errno("Cannot create socket", socket_path);
+  }
+  auto address = detail::unix_address(socket_path);
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    ::close(fd);
+    detail::throw_errno("Cannot connect to", socket_path);
+  }
+  std::string status;
+  std::string reply;
+  bool ok = detail::send_frame(fd, job) and detail::send_frame(fd, payload) and
+            detail::receive_frame(fd, status) and
+            detail::receive_frame(fd, reply);
+  ::close(fd);
+  if (not ok or status.size() != 1) {
+    throw(std::runtime_error("Job " + job + " did not complete"));
+  }
+  if (status[0] != '\0') {
+    throw(std::runtime_error(reply));
+  }
+  return reply;
+}
+
+}